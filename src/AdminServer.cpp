@@ -0,0 +1,125 @@
+#include "AdminServer.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+namespace {
+
+const std::size_t maxRequest = 8192;  // Beyond that without the end of the header, the client is dropped
+
+}
+
+AdminServer::AdminServer(uv_loop_t * loopInit, const Handler & handlerInit) :
+		loop { loopInit }, handler(handlerInit), listenFd { -1 }, listenPoll() {
+}
+
+AdminServer::~AdminServer() {
+	if (listenFd >= 0)
+		::close(listenFd);
+}
+
+bool AdminServer::listen(const int port) {
+	listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (listenFd < 0)
+		return false;
+	const int enable = 1;
+	setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons(port);
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(listenFd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || ::listen(listenFd, 16) != 0)
+		return false;
+	uv_poll_init(loop, &listenPoll, listenFd);
+	listenPoll.data = this;
+	uv_poll_start(&listenPoll, UV_READABLE, [](uv_poll_t * poll, int, int) {
+		static_cast<AdminServer *>(poll->data)->onAccept();
+	});
+	return true;
+}
+
+void AdminServer::onAccept() {
+	int fd;
+	while ((fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+		auto client = new Client();
+		client->server = this;
+		client->fd = fd;
+		uv_poll_init(loop, &client->poll, fd);
+		client->poll.data = client;
+		uv_poll_start(&client->poll, UV_READABLE, onClientEvent);
+	}
+}
+
+void AdminServer::onClientEvent(uv_poll_t * poll, const int status, const int events) {
+	auto & client = *static_cast<Client *>(poll->data);
+	if (status < 0)
+		client.server->close(client);
+	else if (events & UV_WRITABLE)
+		client.server->onWritable(client);
+	else
+		client.server->onReadable(client);
+}
+
+void AdminServer::onReadable(Client & client) {
+	char buffer[1024];
+	bool ended { false };
+	while (true) {
+		const auto n = read(client.fd, buffer, sizeof(buffer));
+		if (n > 0)
+			client.input.append(buffer, n);
+		else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		else if (n < 0) {
+			close(client);
+			return;
+		} else {
+			ended = true;
+			break;
+		}
+	}
+	const auto headerEnd = client.input.find("\r\n\r\n");
+	if (headerEnd == std::string::npos) {
+		if (ended || client.input.size() > maxRequest)
+			close(client);
+		return;
+	}
+	// Request line: method, URL, version
+	const auto methodEnd = client.input.find(' ');
+	const auto urlEnd = methodEnd == std::string::npos ? methodEnd : client.input.find(' ', methodEnd + 1);
+	if (urlEnd == std::string::npos || urlEnd > headerEnd) {
+		close(client);
+		return;
+	}
+	const auto body = handler(client.input.substr(0, methodEnd),
+			client.input.substr(methodEnd + 1, urlEnd - methodEnd - 1));
+	client.output = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: "
+			+ std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+	uv_poll_start(&client.poll, UV_WRITABLE, onClientEvent);
+	onWritable(client);
+}
+
+void AdminServer::onWritable(Client & client) {
+	while (!client.output.empty()) {
+		const auto n = write(client.fd, client.output.data(), client.output.size());
+		if (n < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				close(client);
+			return;
+		}
+		client.output.erase(0, n);
+	}
+	close(client);
+}
+
+void AdminServer::close(Client & client) {
+	uv_poll_stop(&client.poll);
+	uv_close(reinterpret_cast<uv_handle_t *>(&client.poll), [](uv_handle_t * handle) {
+		auto client = static_cast<Client *>(handle->data);
+		::close(client->fd);
+		delete client;
+	});
+}
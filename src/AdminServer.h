@@ -0,0 +1,62 @@
+#pragma once
+#include <uv.h>
+#include <cstddef>
+#include <functional>
+#include <string>
+
+/**
+ * Serves plain HTTP requests to the admin endpoint on a port of its own, bound to the loopback
+ * interface, so that only processes on the host can reach it; with uWS, which listens on all
+ * interfaces and doesn't tell the address of the peer of an HTTP request. Sockets are polled by
+ * the event loop, so that requests are handled by the event loop thread, as the statistics they
+ * read are only updated by it. One request per connection, which is closed after the reply.
+ */
+class AdminServer {
+public:
+	/**
+	 * Handles a request, given its method and URL, and returns the body of the reply.
+	 */
+	using Handler = std::function<std::string(const std::string & method, const std::string & url)>;
+
+private:
+	/**
+	 * Connection from a client.
+	 */
+	struct Client {
+		AdminServer * server;
+		int fd;
+		uv_poll_t poll;
+		std::string input;  // Request received so far
+		std::string output;  // Reply not yet sent
+	};
+
+	uv_loop_t * loop;
+	Handler handler;
+	int listenFd;
+	uv_poll_t listenPoll;
+
+	static void onClientEvent(uv_poll_t * poll, const int status, const int events);
+	void onAccept();
+	void onReadable(Client & client);
+	void onWritable(Client & client);
+	void close(Client & client);
+
+public:
+	/**
+	 * Constructs a server, not listening yet.
+	 * @param loopInit the event loop
+	 * @param handlerInit handles requests
+	 */
+	AdminServer(uv_loop_t * loopInit, const Handler & handlerInit);
+
+	~AdminServer();
+
+	AdminServer(const AdminServer &) = delete;
+	AdminServer & operator=(const AdminServer &) = delete;
+
+	/**
+	 * Starts listening on the given port of the loopback interface.
+	 * @return false if the port can't be listened to
+	 */
+	bool listen(const int port);
+};
@@ -0,0 +1,62 @@
+#include "AdmissionControl.h"
+#include "Logger.h"
+#include <cstdio>
+
+AdmissionControl::AdmissionControl(const LatencyHistogram & replyLatencyInit) :
+		replyLatency(replyLatencyInit), latencyBudget { 0 }, maxBacklog { 0 }, windowStartLatency(replyLatencyInit),
+		windowPercentile { 0 }, nAdmitted { 0 }, nRefusedSessions { 0 },
+		nRefusedLatency { 0 }, nShed { 0 } {
+}
+
+void AdmissionControl::setLimits(const long long latencyBudgetInit, const std::size_t maxBacklogInit) {
+	latencyBudget = latencyBudgetInit * 1000;
+	maxBacklog = maxBacklogInit;
+}
+
+void AdmissionControl::rollWindow() {
+	LatencyHistogram window(replyLatency);
+	window.subtract(windowStartLatency);
+	windowPercentile = window.percentile(.99);
+	windowStartLatency = replyLatency;
+}
+
+Session * AdmissionControl::admit(SessionTable & sessions) {
+	if (latencyBudget > 0 && windowPercentile > static_cast<uint64_t>(latencyBudget)) {
+		++nRefusedLatency;
+		Logger::log(LogEvent::overloaded, 0, windowPercentile / 1e3, latencyBudget / 1e3);
+		return nullptr;
+	}
+	const auto session = sessions.acquire();
+	if (session == nullptr) {
+		++nRefusedSessions;
+		Logger::log(LogEvent::refused);
+		return nullptr;
+	}
+	++nAdmitted;
+	return session;
+}
+
+bool AdmissionControl::onBacklog(Session & session, const std::size_t backlog) {
+	if (!session.shedding) {
+		session.shedding = true;
+		Logger::log(LogEvent::shedding, session.id, backlog, maxBacklog);
+	} else if (backlog <= maxBacklog / 2) {
+		// Down to half the limit, so that handling does not flip on and off with every reply
+		session.shedding = false;
+		Logger::log(LogEvent::caughtUp, session.id, backlog);
+		return false;
+	}
+	++nShed;
+	return true;
+}
+
+std::string AdmissionControl::stats() const {
+	char text[300];
+	snprintf(text, sizeof(text),
+			"{\"latency_budget_us\":%.3f,\"window_p99_us\":%.3f,\"max_backlog\":%zu,\"admitted\":%llu,"
+					"\"refused_sessions\":%llu,\"refused_latency\":%llu,\"shed_messages\":%llu}", latencyBudget / 1e3,
+			windowPercentile / 1e3, maxBacklog, static_cast<unsigned long long>(nAdmitted),
+			static_cast<unsigned long long>(nRefusedSessions), static_cast<unsigned long long>(nRefusedLatency),
+			static_cast<unsigned long long>(nShed));
+	return text;
+}
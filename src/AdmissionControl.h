@@ -0,0 +1,114 @@
+#pragma once
+#include "BinaryProtocol.h"
+#include "LatencyHistogram.h"
+#include "Session.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * Keeps the program responsive under load, rather than slowing down every vehicle:
+ * - connections are refused while the 99th percentile of the time taken to reply to messages
+ *   exceeds a budget, over the latest complete window of one second, moved on by a timer;
+ * - messages from a connection are dropped while the replies not yet sent to it exceed a
+ *   number of bytes, as the client is not reading them: replies it would only read late are
+ *   of no use to a control loop, and would pile up without bound. As telemetry keeps coming,
+ *   the client gets the replies to the latest messages once it catches up. Hello messages of
+ *   the binary protocol are never dropped, as the client waits for the reply before sending
+ *   anything else.
+ * Every refusal and every dropped message is counted, by reason, and the changes in
+ * behaviour are logged with the values that caused them. Must be used by one thread only.
+ */
+class AdmissionControl {
+	const LatencyHistogram & replyLatency;
+	long long latencyBudget;  // In nanoseconds; 0 for none
+	std::size_t maxBacklog;  // In bytes; 0 for none
+	LatencyHistogram windowStartLatency;  // replyLatency at the start of the window
+	uint64_t windowPercentile;  // 99th percentile of the reply latency over the latest complete window
+	uint64_t nAdmitted;
+	uint64_t nRefusedSessions;  // Connections refused as all sessions were in use
+	uint64_t nRefusedLatency;  // Connections refused as replies took longer than the budget
+	uint64_t nShed;  // Messages dropped as the client did not read replies
+
+public:
+	static const long long windowLength = 1000000;  // Period of rollWindow(), in microseconds
+
+	/**
+	 * Constructs the controller, with no limits.
+	 * @param replyLatencyInit the time taken to reply to messages
+	 */
+	AdmissionControl(const LatencyHistogram & replyLatencyInit);
+
+	AdmissionControl(const AdmissionControl &) = delete;
+	AdmissionControl & operator=(const AdmissionControl &) = delete;
+
+	/**
+	 * Sets the limits.
+	 * @param latencyBudgetInit the 99th percentile of the reply latency above which connections
+	 * are refused, in microseconds; 0 for none
+	 * @param maxBacklogInit the bytes not yet sent to a connection above which its messages are
+	 * dropped; 0 for none
+	 */
+	void setLimits(const long long latencyBudgetInit, const std::size_t maxBacklogInit);
+
+	/**
+	 * @return whether a latency budget is set, and rollWindow() is to be called
+	 */
+	bool hasLatencyBudget() const {
+		return latencyBudget > 0;
+	}
+
+	/**
+	 * Ends the current window, taking the percentile of the reply latency over it, and starts
+	 * the next one; to be called every windowLength, whether connections come or not.
+	 */
+	void rollWindow();
+
+	/**
+	 * Decides whether a new connection is admitted, and if so gives it a session.
+	 * @param sessions the sessions
+	 * @return the session of the connection, nullptr if it is to be refused; the refusal has
+	 * been counted and logged
+	 */
+	Session * admit(SessionTable & sessions);
+
+	/**
+	 * Decides whether a message is dropped, rather than handled.
+	 * @param session the session of the connection the message comes from
+	 * @param backlog the bytes not yet sent to the connection
+	 * @return true if the message is to be dropped; it has been counted
+	 */
+	bool shed(Session & session, const std::size_t backlog) {
+		if (maxBacklog == 0 || (!session.shedding && backlog <= maxBacklog))
+			return false;
+		return onBacklog(session, backlog);
+	}
+
+	/**
+	 * Decides whether a message is dropped, rather than handled, as shed() does, except for the
+	 * hello messages of the binary protocol, which always are handled.
+	 * @param session the session of the connection the message comes from
+	 * @param backlog the bytes not yet sent to the connection
+	 * @param data the message payload
+	 * @param length the payload length
+	 * @param isBinary whether the message came in a binary frame
+	 * @return true if the message is to be dropped; it has been counted
+	 */
+	bool shed(Session & session, const std::size_t backlog, const char * data, const std::size_t length,
+			const bool isBinary) {
+		if (maxBacklog == 0 || (!session.shedding && backlog <= maxBacklog))
+			return false;
+		BinaryHello hello;
+		return !(isBinary && readBinary(data, length, BinaryType::hello, hello)) && onBacklog(session, backlog);
+	}
+
+	/**
+	 * Part of shed(), off the common path.
+	 */
+	bool onBacklog(Session & session, const std::size_t backlog);
+
+	/**
+	 * @return the limits and counters, in JSON format
+	 */
+	std::string stats() const;
+};
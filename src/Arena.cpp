@@ -0,0 +1,49 @@
+#include "Arena.h"
+#include <algorithm>
+
+namespace {
+
+thread_local MonotonicArena * currentArena = nullptr;
+
+}
+
+MonotonicArena::MonotonicArena(const std::size_t blockSizeInit) :
+		blockSize { blockSizeInit }, current { 0 }, used { 0 } {
+}
+
+MonotonicArena::MonotonicArena(const MonotonicArena & other) :
+		blockSize { other.blockSize }, current { 0 }, used { 0 } {
+}
+
+MonotonicArena::~MonotonicArena() {
+	for (auto & block : blocks)
+		::operator delete(block.data);
+}
+
+void MonotonicArena::nextBlock(const std::size_t size) {
+	// Blocks returned by operator new are aligned for any fundamental type, so offset 0 is always aligned
+	if (current < blocks.size())
+		++current;
+	while (current < blocks.size() && blocks[current].size < size)
+		++current;
+	if (current == blocks.size()) {
+		Block block;
+		block.size = std::max(blockSize, size);
+		block.data = static_cast<char *>(::operator new(block.size));
+		blocks.push_back(block);
+	}
+	used = 0;
+}
+
+void MonotonicArena::reset() {
+	current = 0;
+	used = 0;
+}
+
+MonotonicArena * MonotonicArena::getCurrent() {
+	return currentArena;
+}
+
+void MonotonicArena::setCurrent(MonotonicArena * arena) {
+	currentArena = arena;
+}
@@ -0,0 +1,151 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+/**
+ * Monotonic memory arena: allocation bumps a pointer within the current block, deallocation
+ * does nothing, and reset() makes all memory available again at once. Memory is handed back
+ * to the system only when the arena is destroyed, so that after the first few uses the arena
+ * doesn't allocate from the heap at all.
+ */
+class MonotonicArena {
+	struct Block {
+		char * data;
+		std::size_t size;
+	};
+
+	std::vector<Block> blocks;  // Blocks allocated so far, in order of allocation
+	std::size_t blockSize;  // Size of the blocks allocated when the current one is exhausted
+	std::size_t current;  // Index in `blocks` of the block allocations are taken from
+	std::size_t used;  // Bytes taken from the current block
+
+	/**
+	 * Moves to the next block large enough for the given request, allocating it if needed.
+	 */
+	void nextBlock(const std::size_t size);
+
+public:
+	/**
+	 * Constructs an empty arena; no memory is allocated until the first request.
+	 * @param blockSizeInit the default size of the blocks of memory requested to the system
+	 */
+	MonotonicArena(const std::size_t blockSizeInit = 64 * 1024);
+
+	/**
+	 * Constructs an empty arena with the same block size as the given one. Memory is never
+	 * shared between arenas.
+	 */
+	MonotonicArena(const MonotonicArena & other);
+
+	MonotonicArena & operator=(const MonotonicArena &) = delete;
+
+	~MonotonicArena();
+
+	/**
+	 * Returns a block of memory of the given size and alignment, valid until the next reset().
+	 */
+	void * allocate(const std::size_t size, const std::size_t alignment) {
+		const auto offset = (used + alignment - 1) & ~(alignment - 1);
+		if (current < blocks.size() && offset + size <= blocks[current].size) {
+			used = offset + size;
+			return blocks[current].data + offset;
+		}
+		nextBlock(size);
+		auto result = blocks[current].data + used;
+		used += size;
+		return result;
+	}
+
+	/**
+	 * Makes all memory allocated from the arena available again. All objects allocated from
+	 * the arena must have been destroyed.
+	 */
+	void reset();
+
+	/**
+	 * Returns the arena allocations of the calling thread are taken from, nullptr if none.
+	 */
+	static MonotonicArena * getCurrent();
+
+	/**
+	 * Sets the arena allocations of the calling thread are taken from; nullptr for the heap.
+	 */
+	static void setCurrent(MonotonicArena * arena);
+};
+
+/**
+ * Standard allocator taking memory from the current arena of the calling thread, at the time
+ * the allocator is constructed, or from the heap if there is none. It can be used where
+ * containers construct allocators on the spot, as nlohmann::basic_json does: then, objects
+ * must be destroyed while the same arena is current as when they were constructed, which is
+ * what ArenaScope is for.
+ */
+template<typename T> class ArenaAllocator {
+	template<typename U> friend class ArenaAllocator;
+	MonotonicArena * arena;
+
+public:
+	using value_type = T;
+
+	ArenaAllocator() :
+			arena { MonotonicArena::getCurrent() } {
+	}
+
+	template<typename U> ArenaAllocator(const ArenaAllocator<U> & other) :
+			arena { other.arena } {
+	}
+
+	T * allocate(const std::size_t n) {
+		if (arena == nullptr)
+			return static_cast<T *>(::operator new(n * sizeof(T)));
+		return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T)));
+	}
+
+	void deallocate(T * p, const std::size_t) {
+		if (arena == nullptr)
+			::operator delete(p);
+	}
+
+	// nlohmann::basic_json calls these directly, instead of going through std::allocator_traits
+	template<typename U, typename ... Args> void construct(U * p, Args&&... args) {
+		::new (static_cast<void *>(p)) U(std::forward<Args>(args)...);
+	}
+
+	template<typename U> void destroy(U * p) {
+		p->~U();
+	}
+
+	template<typename U> bool operator==(const ArenaAllocator<U> & other) const {
+		return arena == other.arena;
+	}
+
+	template<typename U> bool operator!=(const ArenaAllocator<U> & other) const {
+		return arena != other.arena;
+	}
+};
+
+/**
+ * Makes the given arena current for the calling thread for the lifetime of the object, and
+ * resets it when the object is destroyed. Objects allocated from the arena must be declared
+ * after the ArenaScope, in the same block, so that they are destroyed before the reset.
+ */
+class ArenaScope {
+	MonotonicArena & arena;
+	MonotonicArena * previous;
+
+public:
+	ArenaScope(MonotonicArena & arenaInit) :
+			arena(arenaInit), previous { MonotonicArena::getCurrent() } {
+		MonotonicArena::setCurrent(&arena);
+	}
+
+	~ArenaScope() {
+		MonotonicArena::setCurrent(previous);
+		arena.reset();
+	}
+
+	ArenaScope(const ArenaScope &) = delete;
+	ArenaScope & operator=(const ArenaScope &) = delete;
+};
@@ -0,0 +1,127 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "Messages.h"
+#include <cstring>
+#include <type_traits>
+
+/**
+ * Binary protocol, an alternative to the Socket.IO text frames of the simulator for in-house
+ * clients, such as replay drivers, fleet simulators and hardware-in-the-loop rigs. Messages
+ * are fixed size, little-endian structs, each carried by a WebSocket binary frame, so that
+ * decoding one takes a length check and a memcpy().
+ *
+ * A client switches to the protocol by sending a hello message; the server replies with its
+ * own hello, and from then on answers binary telemetry with binary steering commands, in the
+ * same order, with the same sequence number. Binary telemetry received before the hello is
+ * ignored. Text frames are handled as usual at any time.
+ *
+ * Clients driving many vehicles, such as fleet simulators, can instead send the telemetry of
+ * all of them in one batch message, and get the steering commands back in one batch reply,
+ * in the same order. Vehicles are identified by their position in the batch, which must be
+ * the same from one batch to the next.
+ */
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "Binary messages are read and written as they are laid out in memory, which must be little-endian"
+#endif
+
+const uint32_t binaryMagic = 0x42444950;  // "PIDB"
+const uint16_t binaryVersion = 1;
+
+enum class BinaryType : uint16_t {
+	hello,  // Client to server to switch to the binary protocol, and server to client in reply
+	telemetry,  // Client to server
+	steer,  // Server to client
+	telemetryBatch,  // Client to server, followed by the telemetry of each vehicle
+	steerBatch  // Server to client, followed by the steering command for each vehicle
+};
+
+struct BinaryHeader {
+	uint32_t magic;  // binaryMagic
+	uint16_t version;  // binaryVersion
+	BinaryType type;
+};
+
+struct BinaryHello {
+	BinaryHeader header;
+};
+
+struct BinaryTelemetry {
+	BinaryHeader header;
+	uint32_t sequence;  // Chosen by the client, echoed in the reply
+	uint32_t reserved;
+	double cte;  // Cross-track error
+	double speed;  // Speed in mph
+};
+
+struct BinarySteer {
+	BinaryHeader header;
+	uint32_t sequence;  // Sequence number of the telemetry replied to
+	uint32_t reserved;
+	double steering;  // Steering angle, in [-1, 1]
+	double throttle;
+};
+
+/**
+ * Start of a batch message; followed by `count` Telemetry structs in a telemetry batch, or by
+ * `count` SteerCommand structs in a steering batch.
+ */
+struct BinaryBatch {
+	BinaryHeader header;
+	uint32_t sequence;  // Chosen by the client, echoed in the reply
+	uint32_t count;  // Number of vehicles, at most maxBatchCount
+};
+
+/**
+ * Maximum number of vehicles in a batch.
+ */
+const uint32_t maxBatchCount = 4096;
+
+static_assert(sizeof(BinaryHeader) == 8 && sizeof(BinaryTelemetry) == 32 && sizeof(BinarySteer) == 32
+		&& sizeof(BinaryBatch) == 16 && sizeof(Telemetry) == 16 && sizeof(SteerCommand) == 16,
+		"Binary messages must have no padding");
+
+/**
+ * Copies a binary message out of a frame.
+ * @param data the frame
+ * @param length the frame length in bytes
+ * @param type the message type expected
+ * @param message filled with the message, if successful
+ * @return true if the frame holds a message of the expected type and of this protocol version
+ */
+template<typename Message> bool readBinary(const char * data, const std::size_t length, const BinaryType type,
+		Message & message) {
+	static_assert(std::is_trivially_copyable<Message>::value, "Binary messages are copied as they are in memory");
+	if (length != sizeof(Message))
+		return false;
+	memcpy(&message, data, sizeof(Message));
+	return message.header.magic == binaryMagic && message.header.version == binaryVersion
+			&& message.header.type == type;
+}
+
+/**
+ * Reads the start of a batch message out of a frame, and checks the frame length against the
+ * number of vehicles; the entries are left in the frame, they follow the BinaryBatch struct.
+ * @param data the frame
+ * @param length the frame length in bytes
+ * @param type the message type expected
+ * @param entrySize size in bytes of each entry
+ * @param batch filled with the start of the message, if successful
+ * @return true if the frame holds a batch of the expected type and of this protocol version
+ */
+inline bool readBinaryBatch(const char * data, const std::size_t length, const BinaryType type,
+		const std::size_t entrySize, BinaryBatch & batch) {
+	if (length < sizeof(BinaryBatch))
+		return false;
+	memcpy(&batch, data, sizeof(BinaryBatch));
+	return batch.header.magic == binaryMagic && batch.header.version == binaryVersion && batch.header.type == type
+			&& batch.count <= maxBatchCount && length == sizeof(BinaryBatch) + batch.count * entrySize;
+}
+
+/**
+ * @return the header of a message of the given type
+ */
+inline BinaryHeader makeBinaryHeader(const BinaryType type) {
+	return BinaryHeader { binaryMagic, binaryVersion, type };
+}
@@ -0,0 +1,71 @@
+#include "Config.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+using namespace std;
+
+const char * invalidConfigValue(const ControlConfig & config) {
+	const pair<const char *, double> coefficients[] = { { "steering_p", config.steeringP }, { "steering_i",
+			config.steeringI }, { "steering_d", config.steeringD }, { "throttle_p", config.throttleP }, { "throttle_i",
+			config.throttleI }, { "throttle_d", config.throttleD } };
+	for (const auto & coefficient : coefficients)
+		if (!(coefficient.second >= 0) || !isfinite(coefficient.second))
+			return coefficient.first;
+	if (!(config.targetSpeed >= 0 && config.targetSpeed <= 100))
+		return "target_speed";
+	if (!(config.twiddleInterval >= 1 && config.twiddleInterval <= 86400))
+		return "twiddle_interval";
+	if (!(config.busyPoll >= 0 && config.busyPoll <= 1e6))
+		return "busy_poll";
+	return nullptr;
+}
+
+ConfigStore::ConfigStore(const ControlConfig & initial) :
+		current { new ControlConfig(initial) }, epoch { 0 }, nReaders { 0 } {
+	for (auto & readerEpoch : readerEpochs)
+		readerEpoch.store(0, memory_order_relaxed);
+}
+
+ConfigStore::~ConfigStore() {
+	delete current.load();
+	for (auto & config : retired)
+		delete config.first;
+}
+
+size_t ConfigStore::registerReader() {
+	const auto reader = nReaders.fetch_add(1);
+	assert(reader < maxReaders);
+	/* Until its epoch is stored, the reader is seen at epoch 0, which prevents any reclaim;
+	 * not being registered yet, it can't hold any configuration. */
+	readerEpochs[reader].store(epoch.load());
+	return reader;
+}
+
+uint64_t ConfigStore::publish(const ControlConfig & config) {
+	lock_guard<mutex> lock(writerMutex);
+	auto newConfig = new ControlConfig(config);
+	newConfig->version = read()->version + 1;
+	const auto old = current.exchange(newConfig, memory_order_acq_rel);
+	/* A reader that goes through a quiescent state after this point sees the new epoch,
+	 * and can't be holding the old configuration afterwards. */
+	const auto retireEpoch = epoch.fetch_add(1) + 1;
+	retired.emplace_back(old, retireEpoch);
+	reclaim();
+	return newConfig->version;
+}
+
+void ConfigStore::reclaim() {
+	auto minEpoch = numeric_limits<uint64_t>::max();
+	const auto n = nReaders.load();
+	for (size_t i = 0; i < n; ++i)
+		minEpoch = min(minEpoch, readerEpochs[i].load(memory_order_acquire));
+	auto it = remove_if(begin(retired), end(retired), [minEpoch](const pair<const ControlConfig *, uint64_t> & config) {
+		if (config.second > minEpoch)
+			return false;
+		delete config.first;
+		return true;
+	});
+	retired.erase(it, end(retired));
+}
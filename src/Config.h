@@ -0,0 +1,96 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+/**
+ * Parameters of the controllers, and of the event loop, that can be changed while the program
+ * runs.
+ */
+struct ControlConfig {
+	double steeringP, steeringI, steeringD;  // Steering controller coefficients
+	double throttleP, throttleI, throttleD;  // Throttle controller coefficients
+	double targetSpeed;  // Speed the throttle controller tries to keep, in mph
+	double twiddleInterval;  // Time between two iterations of twiddle, in seconds
+	double busyPoll;  // Time the event loop polls for events without sleeping after every event, in microseconds; 0 to sleep right away
+	uint64_t version;  // Incremented every time a new configuration is published
+};
+
+/**
+ * Checks that the values of a configuration are within range: coefficients non-negative, a
+ * target speed between 0 and 100 mph, a twiddle interval between 1 s and a day, and a busy
+ * polling time between 0 and 1 s.
+ * @return the name of the first value out of range, as in the admin endpoint; nullptr if none
+ */
+const char * invalidConfigValue(const ControlConfig & config);
+
+/**
+ * Holds the current configuration, and allows it to be replaced while threads running the
+ * controllers keep reading it, without them ever taking a lock (read-copy-update).
+ *
+ * A new configuration is published by swapping a pointer; the previous one is retired, and
+ * deleted once every reader has gone through a quiescent state, a point where it holds no
+ * pointer to a configuration. Every thread that reads the configuration must register itself
+ * once, before its first read, and must call quiescent() regularly, e.g. after handling every
+ * message; pointers obtained from read() are valid until the thread's next call to quiescent().
+ */
+class ConfigStore {
+	static const size_t maxReaders = 64;
+
+	std::atomic<const ControlConfig *> current;
+	std::atomic<uint64_t> epoch;  // Incremented every time a configuration is retired
+	std::atomic<size_t> nReaders;
+	std::array<std::atomic<uint64_t>, maxReaders> readerEpochs;  // Epoch seen by every reader at its latest quiescent state
+	std::mutex writerMutex;  // Serialises writers, readers never take it
+	std::vector<std::pair<const ControlConfig *, uint64_t>> retired;  // Retired configurations, with their retirement epoch
+
+	/**
+	 * Deletes the retired configurations no reader can still be holding.
+	 */
+	void reclaim();
+
+public:
+	/**
+	 * Constructs the store with the given initial configuration.
+	 * @param initial the configuration; its version is taken as it is
+	 */
+	ConfigStore(const ControlConfig & initial);
+
+	~ConfigStore();
+
+	ConfigStore(const ConfigStore &) = delete;
+	ConfigStore & operator=(const ConfigStore &) = delete;
+
+	/**
+	 * Registers the calling thread as a reader. Thread-safe.
+	 * @return the reader identifier, to be passed to quiescent()
+	 */
+	size_t registerReader();
+
+	/**
+	 * Returns the current configuration. Lock-free and wait-free.
+	 */
+	const ControlConfig * read() const {
+		return current.load(std::memory_order_acquire);
+	}
+
+	/**
+	 * Tells that the calling reader holds no pointer returned by read(). Lock-free and wait-free.
+	 * @param reader the reader identifier, as returned by registerReader()
+	 */
+	void quiescent(const size_t reader) {
+		readerEpochs[reader].store(epoch.load(std::memory_order_seq_cst), std::memory_order_release);
+	}
+
+	/**
+	 * Publishes a new configuration, whose version is set to the current version plus 1.
+	 * Thread-safe; it doesn't wait for readers.
+	 * @param config the new configuration
+	 * @return the version of the published configuration
+	 */
+	uint64_t publish(const ControlConfig & config);
+};
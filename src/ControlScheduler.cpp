@@ -0,0 +1,136 @@
+#include "ControlScheduler.h"
+#include <algorithm>
+#include <cstdio>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+namespace {
+
+const std::size_t maxSlots = 64;
+const long long minTick = 100000;  // nanoseconds
+
+}
+
+ControlScheduler::ControlScheduler(const long long periodInit, const std::size_t capacity) :
+		period { periodInit * 1000 }, nSlots { static_cast<std::size_t>(std::max(1LL,
+				std::min(static_cast<long long>(maxSlots), period / minTick))) }, tick { period
+				/ static_cast<long long>(nSlots) }, task(), timerFd { -1 }, slots(nSlots), slotOf(capacity, nSlots), indexInSlot(
+				capacity, 0), nextSlot { 0 }, nVehicles { 0 }, startTime { 0 }, nTicks { 0 }, nMissed { 0 }, jitter() {
+}
+
+ControlScheduler::~ControlScheduler() {
+	if (timerFd >= 0)
+		close(timerFd);
+}
+
+bool ControlScheduler::start(const bool nonBlocking) {
+	timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | (nonBlocking ? TFD_NONBLOCK : 0));
+	return timerFd >= 0;
+}
+
+void ControlScheduler::setTimer(const bool armed) {
+	itimerspec spec {};
+	if (armed) {
+		// The first tick is one tick away; LatencyHistogram::now() uses CLOCK_MONOTONIC as well
+		startTime = LatencyHistogram::now();
+		nTicks = 0;
+		const long long first = startTime + tick;
+		spec.it_value.tv_sec = first / 1000000000;
+		spec.it_value.tv_nsec = first % 1000000000;
+		spec.it_interval.tv_sec = tick / 1000000000;
+		spec.it_interval.tv_nsec = tick % 1000000000;
+	}
+	if (timerFd >= 0)
+		timerfd_settime(timerFd, armed ? TFD_TIMER_ABSTIME : 0, &spec, nullptr);
+}
+
+void ControlScheduler::add(Session & session) {
+	if (session.id >= slotOf.size()) {
+		slotOf.resize(session.id + 1, nSlots);
+		indexInSlot.resize(session.id + 1, 0);
+	}
+	if (slotOf[session.id] != nSlots)
+		return;
+	session.setSamplePeriod(getPeriod());
+	auto & slot = slots[nextSlot];
+	slotOf[session.id] = nextSlot;
+	indexInSlot[session.id] = slot.size();
+	slot.push_back(&session);
+	nextSlot = (nextSlot + 1) % nSlots;
+	if (nVehicles++ == 0)
+		setTimer(true);
+}
+
+void ControlScheduler::remove(Session & session) {
+	if (session.id >= slotOf.size() || slotOf[session.id] == nSlots)
+		return;
+	const auto slotIndex = slotOf[session.id];
+	// The last session of the slot takes the place of the removed one
+	auto & slot = slots[slotIndex];
+	const auto index = indexInSlot[session.id];
+	slot[index] = slot.back();
+	indexInSlot[slot[index]->id] = index;
+	slot.pop_back();
+	slotOf[session.id] = nSlots;
+	// The slot is refilled from the latest slot added to, which is one of the fullest
+	const auto latest = (nextSlot + nSlots - 1) % nSlots;
+	if (latest != slotIndex && !slots[latest].empty()) {
+		const auto moved = slots[latest].back();
+		slots[latest].pop_back();
+		slotOf[moved->id] = slotIndex;
+		indexInSlot[moved->id] = slot.size();
+		slot.push_back(moved);
+	}
+	nextSlot = latest;
+	session.setSamplePeriod(0);
+	if (--nVehicles == 0)
+		setTimer(false);
+}
+
+void ControlScheduler::onTimer() {
+	uint64_t expirations = 0;
+	if (read(timerFd, &expirations, sizeof(expirations)) == sizeof(expirations))
+		onTicks(expirations);
+}
+
+void ControlScheduler::onTicks(const uint64_t expirations) {
+	if (nVehicles == 0)
+		// Expired before the timer was disarmed
+		return;
+	// When late by a period or more, every vehicle runs once
+	const auto nDue = std::min<uint64_t>(expirations, nSlots);
+	nMissed += expirations - 1;
+	nTicks += expirations - nDue;
+	for (uint64_t i = 0; i < nDue; ++i) {
+		++nTicks;
+		const long long due = startTime + static_cast<long long>(nTicks) * tick;
+		// Tick n runs the slot n - 1, the first tick being tick 1
+		auto & slot = slots[(nTicks - 1) % nSlots];
+		for (std::size_t j = 0; j < slot.size(); ++j) {
+			jitter.record(LatencyHistogram::now() - due);
+			task(*slot[j]);
+		}
+	}
+}
+
+long long ControlScheduler::untilNextTick() const {
+	if (nVehicles == 0)
+		return -1;
+	return std::max(0LL, startTime + static_cast<long long>(nTicks + 1) * tick - LatencyHistogram::now());
+}
+
+void ControlScheduler::runDue() {
+	if (nVehicles == 0)
+		return;
+	const auto expired = static_cast<uint64_t>((LatencyHistogram::now() - startTime) / tick);
+	if (expired > nTicks)
+		onTicks(expired - nTicks);
+}
+
+std::string ControlScheduler::stats() const {
+	char text[300];
+	snprintf(text, sizeof(text), "{\"period_us\":%.3f,\"tick_us\":%.3f,\"vehicles\":%zu,\"ticks\":%llu,\"missed_ticks\":%llu,"
+			"\"jitter\":%s}", period / 1e3, tick / 1e3, nVehicles, static_cast<unsigned long long>(nTicks),
+			static_cast<unsigned long long>(nMissed), jitter.summary().c_str());
+	return text;
+}
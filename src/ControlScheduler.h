@@ -0,0 +1,136 @@
+#pragma once
+#include "LatencyHistogram.h"
+#include "Session.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * Runs the controllers of every vehicle at a fixed rate, from the latest telemetry, rather
+ * than whenever telemetry arrives: the control rate no longer follows the jitter of the
+ * simulator, and the controllers run with a constant sample period.
+ *
+ * The period is split into ticks, driven by a timerfd. Vehicles are spread over the ticks
+ * of a period, as the slots of a wheel, so that their work is spread evenly too: slots never
+ * differ by more than one vehicle, as a removal moves the latest vehicle added to the slot
+ * left short. Adding and removing a vehicle, and moving on to the next tick, take constant
+ * time; a tick runs only the vehicles in its slot. The timer is disarmed while there are no
+ * vehicles.
+ *
+ * The delay between the time a vehicle is due and the time it runs is recorded, as the
+ * jitter of the schedule. Must be used by one thread only, which either polls fd() for
+ * reading and calls onTimer(), or calls runDue() when untilNextTick() says so.
+ */
+class ControlScheduler {
+public:
+	/**
+	 * Runs the controllers of a vehicle and sends the result.
+	 */
+	using Task = std::function<void(Session & session)>;
+
+private:
+	const long long period;  // In nanoseconds
+	const std::size_t nSlots;
+	const long long tick;  // period / nSlots, in nanoseconds
+	Task task;
+	int timerFd;
+	std::vector<std::vector<Session *>> slots;
+	std::vector<uint32_t> slotOf;  // Indexed by session id; the slot the session is in, nSlots if none
+	std::vector<uint32_t> indexInSlot;  // Indexed by session id
+	std::size_t nextSlot;  // Slot for the next vehicle added; the slots before it have one vehicle more than the others
+	std::size_t nVehicles;
+	long long startTime;  // When the timer was armed, in nanoseconds from a monotonic clock
+	uint64_t nTicks;  // Ticks since the timer was armed
+	uint64_t nMissed;  // Ticks that expired together with the next one, as the thread was late
+	LatencyHistogram jitter;
+
+	/**
+	 * Arms or disarms the timer.
+	 */
+	void setTimer(const bool armed);
+
+public:
+	/**
+	 * Constructs the scheduler.
+	 * @param periodInit the control period, in microseconds
+	 * @param capacity the number of sessions expected, that is one past the highest session
+	 * id; sessions with higher ids can be added all the same
+	 */
+	ControlScheduler(const long long periodInit, const std::size_t capacity);
+
+	~ControlScheduler();
+
+	ControlScheduler(const ControlScheduler &) = delete;
+	ControlScheduler & operator=(const ControlScheduler &) = delete;
+
+	/**
+	 * Creates the timer; not needed by threads that call runDue() instead of polling it.
+	 * @param nonBlocking whether the timer is read without blocking, as needed by event loops
+	 * that poll for readiness first: the timer may be disarmed in between. io_uring needs it
+	 * blocking, to wait on it rather than fail.
+	 * @return false on failure
+	 */
+	bool start(const bool nonBlocking);
+
+	/**
+	 * Sets what is run for every vehicle when due.
+	 */
+	void setTask(const Task & taskInit) {
+		task = taskInit;
+	}
+
+	/**
+	 * @return the descriptor of the timer, readable when ticks have expired
+	 */
+	int fd() const {
+		return timerFd;
+	}
+
+	/**
+	 * @return the control period, in seconds
+	 */
+	double getPeriod() const {
+		return period / 1e9;
+	}
+
+	/**
+	 * Adds a vehicle, to be run once per period from the next tick of its slot, and sets the
+	 * sample period of its controllers.
+	 */
+	void add(Session & session);
+
+	/**
+	 * Removes a vehicle; nothing happens if it was not added. The latest vehicle added to the
+	 * slot before nextSlot takes its place, if in another slot: the interval between two runs
+	 * of that vehicle is then shorter, or longer, once.
+	 */
+	void remove(Session & session);
+
+	/**
+	 * Reads the number of ticks expired from the timer, and runs the vehicles due.
+	 */
+	void onTimer();
+
+	/**
+	 * Runs the vehicles due in the given number of ticks expired.
+	 */
+	void onTicks(const uint64_t expirations);
+
+	/**
+	 * @return the time until the next tick is due, in nanoseconds; 0 if due already, -1 if
+	 * there are no vehicles
+	 */
+	long long untilNextTick() const;
+
+	/**
+	 * Runs the vehicles due by now, as told by the clock rather than by the timer.
+	 */
+	void runDue();
+
+	/**
+	 * @return the period, counters and jitter percentiles in microseconds, in JSON format
+	 */
+	std::string stats() const;
+};
@@ -0,0 +1,234 @@
+#include "FrameCheck.h"
+#include "json.hpp"
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <sstream>
+#include <vector>
+
+using json = nlohmann::json;
+
+namespace {
+
+const char * kindName(const FrameKind kind) {
+	switch (kind) {
+	case FrameKind::manual:
+		return "manual";
+	case FrameKind::telemetry:
+		return "telemetry";
+	default:
+		return "other";
+	}
+}
+
+// Checks if the SocketIO event has JSON data.
+// If there is data the JSON object in string format will be returned,
+// else the empty string "" will be returned.
+std::string hasData(std::string s) {
+	auto found_null = s.find("null");
+	auto b1 = s.find_first_of("[");
+	auto b2 = s.find_last_of("]");
+	if (found_null != std::string::npos) {
+		return "";
+	} else if (b1 != std::string::npos && b2 != std::string::npos) {
+		return s.substr(b1, b2 - b1 + 1);
+	}
+	return "";
+}
+
+/**
+ * Parses a text in full with nlohmann::json, failing on objects with duplicate keys, whose
+ * value depends on the parser.
+ * @return false if the text isn't valid JSON, or has duplicate keys
+ */
+bool parseStrict(const std::string & text, json & j) {
+	std::vector<std::vector<std::string>> keys;  // Keys seen so far in each object being parsed
+	bool duplicate { false };
+	try {
+		j = json::parse(text, [&keys, &duplicate](int, json::parse_event_t event, json & parsed) {
+			switch (event) {
+			case json::parse_event_t::object_start:
+				keys.emplace_back();
+				break;
+			case json::parse_event_t::object_end:
+				keys.pop_back();
+				break;
+			case json::parse_event_t::key: {
+				const auto & key = parsed.get_ref<const std::string &>();
+				for (const auto & seen : keys.back())
+					duplicate = duplicate || seen == key;
+				keys.back().push_back(key);
+				break;
+			}
+			default:
+				break;
+			}
+			return true;
+		});
+	} catch (const std::exception &) {
+		return false;
+	}
+	return !duplicate;
+}
+
+/**
+ * Reads a telemetry value as the original implementation did, with std::stod() on a string.
+ * std::stod() also takes leading whitespace, trailing characters, hexadecimal numbers,
+ * infinities and NaN, which the simulator never sends; values are only compared when the
+ * string is exactly a JSON number.
+ * @return false if the value isn't a string holding exactly a JSON number
+ */
+bool referenceNumber(const json & value, double & number) {
+	if (!value.is_string())
+		return false;
+	const auto & text = value.get_ref<const std::string &>();
+	if (text.empty() || text.find_first_not_of("+-.0123456789eE") != std::string::npos)
+		return false;
+	json parsed;
+	if (!parseStrict(text, parsed) || !parsed.is_number())
+		return false;
+	std::size_t end;
+	try {
+		number = std::stod(text, &end);
+	} catch (const std::exception &) {
+		return false;
+	}
+	return end == text.size();
+}
+
+/**
+ * Decodes a frame as the original implementation did: hasData(), then nlohmann::json::parse()
+ * of the whole array.
+ * @return false if the frame has no reference outcome: the original implementation throws an
+ * exception on it, or drops it as a manual driving event for a `null` that is not an element
+ * of the array, e.g. within the camera image
+ */
+bool referenceDecode(const char * data, const std::size_t length, FrameKind & kind, Telemetry & telemetry,
+		double & steeringAngle) {
+	kind = FrameKind::other;
+	if (length <= 2 || data[0] != '4' || data[1] != '2')
+		return true;
+	const std::string frame(data, length);
+	const auto s = hasData(frame);
+	json j;
+	const auto b1 = frame.find_first_of("[");
+	const auto b2 = frame.find_last_of("]");
+	if (b1 == std::string::npos) {
+		kind = FrameKind::manual;
+		return true;
+	}
+	// Frames cut short may be decoded either way
+	if (b2 == std::string::npos || b2 < b1)
+		return false;
+	// Socket.IO sends nothing but the array after the event code
+	static const char whitespace[] = " \t\n\r";
+	if (frame.find_first_not_of(whitespace, 2) != b1 || frame.find_last_not_of(whitespace) != b2)
+		return false;
+	if (s == "") {
+		// The original implementation is only right if a null is an element of the array
+		kind = FrameKind::manual;
+		if (!parseStrict(frame.substr(b1, b2 - b1 + 1), j) || !j.is_array())
+			return false;
+		for (const auto & element : j)
+			if (element.is_null())
+				return true;
+		return false;
+	}
+	// The simulator sends events with one argument
+	if (!parseStrict(s, j) || !j.is_array() || j.empty() || j.size() > 2 || !j[0].is_string())
+		return false;
+	if (j[0].get_ref<const std::string &>() != "telemetry")
+		return true;
+	// j[1] is the data JSON object
+	if (j.size() < 2 || !j[1].is_object())
+		return false;
+	const auto & values = j[1];
+	const auto cte = values.find("cte");
+	const auto speed = values.find("speed");
+	if (cte == values.end() || speed == values.end() || !referenceNumber(*cte, telemetry.cte)
+			|| !referenceNumber(*speed, telemetry.speed))
+		return false;
+	kind = FrameKind::telemetry;
+	// The original implementation doesn't read the steering angle; std::stod() would throw on a bad one
+	const auto angle = values.find("steering_angle");
+	if (angle == values.end())
+		steeringAngle = std::numeric_limits<double>::quiet_NaN();
+	else if (!referenceNumber(*angle, steeringAngle))
+		return false;
+	return true;
+}
+
+/**
+ * Compares two values bit for bit.
+ */
+bool same(const double a, const double b) {
+	return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+/**
+ * Checks a value read back from a steering command message.
+ */
+void checkSteerValue(const json & values, const char * key, const double expected, std::ostringstream & out) {
+	const auto it = values.find(key);
+	if (it == values.end()) {
+		out << key << " missing; ";
+		return;
+	}
+	if (!std::isfinite(expected)) {
+		if (!it->is_null())
+			out << key << " is " << it->dump() << " instead of null; ";
+		return;
+	}
+	if (!it->is_number() || !same(it->get<double>(), expected)) {
+		char text[64];
+		snprintf(text, sizeof(text), "%.17g", expected);
+		out << key << " is " << it->dump() << " instead of " << text << "; ";
+	}
+}
+
+}
+
+FrameKind checkFrame(const char * data, const std::size_t length, TelemetryExtractor & extractor,
+		MonotonicArena & arena, Telemetry & telemetry, double & steeringAngle, std::string & mismatch) {
+	mismatch.clear();
+	const auto kind = decodeFrame(data, length, extractor, arena, telemetry, steeringAngle);
+
+	FrameKind expectedKind;
+	Telemetry expected { 0, 0 };
+	double expectedAngle;
+	if (!referenceDecode(data, length, expectedKind, expected, expectedAngle))
+		return kind;
+	std::ostringstream out;
+	out.precision(17);
+	if (kind != expectedKind)
+		out << "decoded as " << kindName(kind) << " instead of " << kindName(expectedKind);
+	else if (kind == FrameKind::telemetry && !(telemetry.cte == expected.cte && telemetry.speed == expected.speed))
+		// Compared with ==, as the reference reads -0 as an integer
+		out << "decoded cte=" << telemetry.cte << " speed=" << telemetry.speed << " instead of cte=" << expected.cte
+				<< " speed=" << expected.speed;
+	else if (kind == FrameKind::telemetry && std::isfinite(steeringAngle) && steeringAngle != expectedAngle)
+		// The steering angle may be left out, when it comes after the values needed
+		out << "decoded steering_angle=" << steeringAngle << " instead of " << expectedAngle;
+	mismatch = out.str();
+	return kind;
+}
+
+std::string checkSteerMessage(const SteerCommand & command) {
+	char message[maxSteerMessage];
+	const auto length = writeSteerMessage(message, command);
+	json j;
+	std::ostringstream out;
+	if (length < 2 || memcmp(message, "42", 2) != 0 || !parseStrict(std::string(message + 2, length - 2), j))
+		out << "not valid JSON; ";
+	else if (!j.is_array() || j.size() != 2 || j[0] != "steer" || !j[1].is_object() || j[1].size() != 2)
+		out << "not a steer event; ";
+	else {
+		checkSteerValue(j[1], "steering_angle", command.steering, out);
+		checkSteerValue(j[1], "throttle", command.throttle, out);
+	}
+	auto mismatch = out.str();
+	if (!mismatch.empty())
+		mismatch = std::string(message, length) + ": " + mismatch.substr(0, mismatch.size() - 2);
+	return mismatch;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "FrameDecoder.h"
+#include <cstddef>
+#include <string>
+
+/**
+ * Differential checks of the message path against the original implementation: hasData(),
+ * which takes any frame with "null" for a manual driving event, then nlohmann::json::parse()
+ * of the whole array and std::stod() of the values. A frame has a reference outcome only if
+ * the original implementation handles it without throwing an exception, and it is an event
+ * with at most one argument, as the simulator sends them, without duplicate keys, and with
+ * values that are strings holding exactly a JSON number. Frames with a `null` that is not an
+ * element of the array have none either, as the message path reads them as they are meant.
+ * Other frames may be decoded either way, as the fast path doesn't look past the values it
+ * needs.
+ */
+
+/**
+ * Decodes a frame with decodeFrame(), and compares the result with the reference.
+ * @param data the frame
+ * @param length the frame length in bytes
+ * @param extractor the extractor of the session the frame belongs to
+ * @param arena memory for the message path parser, reset before returning
+ * @param telemetry filled with the telemetry values decoded, if the frame holds telemetry
+ * @param steeringAngle set to the steering angle decoded, in degrees, if the frame holds
+ * telemetry; NaN if not reported
+ * @param mismatch set to a description of the difference, empty if there is none
+ * @return the frame kind, as decoded by decodeFrame()
+ */
+FrameKind checkFrame(const char * data, const std::size_t length, TelemetryExtractor & extractor,
+		MonotonicArena & arena, Telemetry & telemetry, double & steeringAngle, std::string & mismatch);
+
+/**
+ * Checks that the message written by writeSteerMessage() for a command is read back by
+ * nlohmann::json with the same values, bit for bit; NaN and infinities are to be written as
+ * null.
+ * @return a description of the difference, empty if there is none
+ */
+std::string checkSteerMessage(const SteerCommand & command);
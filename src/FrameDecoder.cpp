@@ -0,0 +1,36 @@
+#include "FrameDecoder.h"
+#include "FrameScanner.h"
+#include "LazyJson.h"
+#include <limits>
+
+FrameKind decodeFrame(const char * data, const std::size_t length, TelemetryExtractor & extractor,
+		MonotonicArena & arena, Telemetry & telemetry, double & steeringAngle) {
+	// "42" at the start of the message means there's a websocket message event.
+	// The 4 signifies a websocket message
+	// The 2 signifies a websocket event
+	if (length <= 2 || data[0] != '4' || data[1] != '2')
+		return FrameKind::other;
+	if (extractor.extract(data, length, telemetry, steeringAngle))
+		return FrameKind::telemetry;
+
+	// The event has JSON data if it holds an array without a null element
+	const auto frame = scanFrame(data, length);
+	if (!frame.hasArray || frame.hasNull)
+		return FrameKind::manual;
+
+	// The element index comes from the arena, reset when leaving the function
+	ArenaScope messageScope(arena);
+	LazyJson j;
+	j.parse(data + frame.begin, data + frame.end + 1);
+	if (!j.at(0).equals("telemetry"))
+		return FrameKind::other;
+	// j[1] is the data JSON object; members after cte and speed, e.g. the image, are not parsed
+	LazyJson values;
+	if (!values.parse(j.at(1)) || !values.find("cte").getNumber(telemetry.cte)
+			|| !values.find("speed").getNumber(telemetry.speed))
+		return FrameKind::other;
+	if (!values.find("steering_angle").getNumber(steeringAngle))
+		steeringAngle = std::numeric_limits<double>::quiet_NaN();
+	extractor.learn(data, length);
+	return FrameKind::telemetry;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include "Arena.h"
+#include "Messages.h"
+#include "TelemetryExtractor.h"
+#include <cstddef>
+
+/**
+ * What a frame received from the simulator is about.
+ */
+enum class FrameKind {
+	other,  // Not a message event, or no event handled here
+	manual,  // The simulator is driven manually; it expects a "manual" event in reply
+	telemetry  // Telemetry to reply to with a steering command
+};
+
+/**
+ * Decodes a frame received from the simulator. Telemetry laid out as the previous frames is
+ * handled by the extractor fast path; anything else is classified by scanFrame() and, if it
+ * holds JSON data, read with LazyJson, and the extractor learns its layout.
+ * @param data the frame
+ * @param length the frame length in bytes
+ * @param extractor the extractor of the session the frame belongs to
+ * @param arena memory for the parser, reset before returning
+ * @param telemetry filled with the telemetry values, if the frame holds telemetry
+ * @param steeringAngle set to the steering angle the simulator reports, in degrees, if the frame
+ * holds telemetry; NaN if it doesn't report it
+ * @return the frame kind
+ */
+FrameKind decodeFrame(const char * data, const std::size_t length, TelemetryExtractor & extractor,
+		MonotonicArena & arena, Telemetry & telemetry, double & steeringAngle);
@@ -0,0 +1,352 @@
+#include "FrameScanner.h"
+#include <cstdint>
+#include <cstring>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FRAME_SCANNER_X86
+#endif
+
+namespace {
+
+/**
+ * Bit masks for a block of 64 bytes: bit i is set if byte i is of the given class.
+ */
+struct BlockMasks {
+	uint64_t quote;  // "
+	uint64_t backslash;  // a backslash
+	uint64_t structural;  // [ ] { } n
+	uint64_t string;  // Between an odd-numbered quote and the next one, ignoring escapes
+};
+
+/**
+ * Bit i of the result is the XOR of bits 0 to i of x. Applied to the quote mask, it sets the
+ * bits from every opening quote up to, and excluding, the matching closing quote.
+ */
+inline uint64_t prefixXor(uint64_t x) {
+	x ^= x << 1;
+	x ^= x << 2;
+	x ^= x << 4;
+	x ^= x << 8;
+	x ^= x << 16;
+	x ^= x << 32;
+	return x;
+}
+
+/*
+ * The classifiers below fill in the masks of a block. When the block starts within a string,
+ * and holds neither quotes nor backslashes, as most of the camera image, the block is string
+ * all along: only the quote and backslash masks are computed, the others are left to 0.
+ */
+
+#ifdef FRAME_SCANNER_X86
+
+void classifySse2(const char * block, const bool inString, BlockMasks & masks) {
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	__m128i bytes[4];
+	masks.quote = masks.backslash = masks.structural = masks.string = 0;
+	for (unsigned i = 0; i < 4; ++i) {
+		bytes[i] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block + 16 * i));
+		masks.quote |= uint64_t(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes[i], quote)))) << 16 * i;
+		masks.backslash |= uint64_t(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes[i], backslash))))
+				<< 16 * i;
+	}
+	if (inString && (masks.quote | masks.backslash) == 0)
+		return;
+	// Setting bit 5 turns [ and ] into { and }
+	const __m128i bit5 = _mm_set1_epi8(0x20);
+	const __m128i openBrace = _mm_set1_epi8('{');
+	const __m128i closeBrace = _mm_set1_epi8('}');
+	const __m128i n = _mm_set1_epi8('n');
+	for (unsigned i = 0; i < 4; ++i) {
+		const __m128i folded = _mm_or_si128(bytes[i], bit5);
+		const __m128i structural = _mm_or_si128(
+				_mm_or_si128(_mm_cmpeq_epi8(folded, openBrace), _mm_cmpeq_epi8(folded, closeBrace)),
+				_mm_cmpeq_epi8(bytes[i], n));
+		masks.structural |= uint64_t(static_cast<uint16_t>(_mm_movemask_epi8(structural))) << 16 * i;
+	}
+	masks.string = prefixXor(masks.quote);
+}
+
+/**
+ * Skips the blocks starting at `pos` holding neither quotes nor backslashes.
+ * @return the position of the first block holding either, or of the last, partial block
+ */
+std::size_t skipStringSse2(const char * data, std::size_t pos, const std::size_t length) {
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	for (; pos + 64 <= length; pos += 64) {
+		__m128i found = _mm_setzero_si128();
+		for (unsigned i = 0; i < 4; ++i) {
+			const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + pos + 16 * i));
+			found = _mm_or_si128(found, _mm_or_si128(_mm_cmpeq_epi8(bytes, quote), _mm_cmpeq_epi8(bytes, backslash)));
+		}
+		if (_mm_movemask_epi8(found) != 0)
+			break;
+	}
+	return pos;
+}
+
+__attribute__((target("avx2"))) std::size_t skipStringAvx2(const char * data, std::size_t pos,
+		const std::size_t length) {
+	const __m256i quote = _mm256_set1_epi8('"');
+	const __m256i backslash = _mm256_set1_epi8('\\');
+	for (; pos + 64 <= length; pos += 64) {
+		const __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + pos));
+		const __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + pos + 32));
+		const __m256i found = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(lo, quote), _mm256_cmpeq_epi8(lo, backslash)),
+				_mm256_or_si256(_mm256_cmpeq_epi8(hi, quote), _mm256_cmpeq_epi8(hi, backslash)));
+		if (!_mm256_testz_si256(found, found))
+			break;
+	}
+	return pos;
+}
+
+__attribute__((target("avx2,pclmul"))) void classifyAvx2(const char * block, const bool inString,
+		BlockMasks & masks) {
+	const __m256i quote = _mm256_set1_epi8('"');
+	const __m256i backslash = _mm256_set1_epi8('\\');
+	const __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(block));
+	const __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(block + 32));
+	masks.quote = uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, quote))))
+			| uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, quote)))) << 32;
+	masks.backslash = uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, backslash))))
+			| uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, backslash)))) << 32;
+	masks.structural = masks.string = 0;
+	if (inString && (masks.quote | masks.backslash) == 0)
+		return;
+	// Setting bit 5 turns [ and ] into { and }
+	const __m256i bit5 = _mm256_set1_epi8(0x20);
+	const __m256i openBrace = _mm256_set1_epi8('{');
+	const __m256i closeBrace = _mm256_set1_epi8('}');
+	const __m256i n = _mm256_set1_epi8('n');
+	const __m256i foldedLo = _mm256_or_si256(lo, bit5);
+	const __m256i foldedHi = _mm256_or_si256(hi, bit5);
+	const __m256i structuralLo = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(foldedLo, openBrace), _mm256_cmpeq_epi8(foldedLo, closeBrace)),
+			_mm256_cmpeq_epi8(lo, n));
+	const __m256i structuralHi = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(foldedHi, openBrace), _mm256_cmpeq_epi8(foldedHi, closeBrace)),
+			_mm256_cmpeq_epi8(hi, n));
+	masks.structural = uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(structuralLo)))
+			| uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(structuralHi))) << 32;
+	// The prefix XOR is a carry-less multiplication by all ones
+	masks.string = static_cast<uint64_t>(_mm_cvtsi128_si64(
+			_mm_clmulepi64_si128(_mm_set_epi64x(0, static_cast<long long>(masks.quote)), _mm_set1_epi8(-1), 0)));
+}
+
+#endif
+
+void classifyScalar(const char * block, const bool inString, BlockMasks & masks) {
+	masks.quote = masks.backslash = masks.structural = 0;
+	for (unsigned i = 0; i < 64; ++i) {
+		const uint64_t bit = uint64_t(1) << i;
+		switch (block[i]) {
+		case '"':
+			masks.quote |= bit;
+			break;
+		case '\\':
+			masks.backslash |= bit;
+			break;
+		case '[':
+		case ']':
+		case '{':
+		case '}':
+		case 'n':
+			masks.structural |= bit;
+			break;
+		default:
+			break;
+		}
+	}
+	masks.string = prefixXor(masks.quote);
+}
+
+std::size_t skipStringScalar(const char * data, std::size_t pos, const std::size_t length) {
+	for (; pos + 64 <= length; pos += 64)
+		for (unsigned i = 0; i < 64; ++i)
+			if (data[pos + i] == '"' || data[pos + i] == '\\')
+				return pos;
+	return pos;
+}
+
+/**
+ * Implementation of the scanning steps for an instruction set.
+ */
+struct Kernels {
+	void (*classify)(const char * block, const bool inString, BlockMasks & masks);
+	std::size_t (*skipString)(const char * data, std::size_t pos, const std::size_t length);
+};
+
+/**
+ * @return the kernels for an instruction set, which must be supported
+ */
+Kernels kernelsFor(const ScanKernel kernel) {
+	switch (kernel) {
+#ifdef FRAME_SCANNER_X86
+	case ScanKernel::avx2:
+		return Kernels { classifyAvx2, skipStringAvx2 };
+	case ScanKernel::sse2:
+		return Kernels { classifySse2, skipStringSse2 };
+#endif
+	default:
+		return Kernels { classifyScalar, skipStringScalar };
+	}
+}
+
+/**
+ * Picks the fastest kernels the processor supports.
+ */
+Kernels selectKernels() {
+	if (scanKernelSupported(ScanKernel::avx2))
+		return kernelsFor(ScanKernel::avx2);
+	if (scanKernelSupported(ScanKernel::sse2))
+		return kernelsFor(ScanKernel::sse2);
+	return kernelsFor(ScanKernel::scalar);
+}
+
+const Kernels fastestKernels = selectKernels();
+
+/**
+ * Scanning state, carried over from one block to the next.
+ */
+struct Scanner {
+	Kernels kernels;
+	const char * data;
+	std::size_t length;
+	FrameInfo info;
+	unsigned depth;  // Nesting depth of arrays and objects
+	bool inString;  // Whether the previous block ended within a string
+	bool escaped;  // Whether the previous block ended with a backslash escaping the next character
+	bool done;  // Whether the array has been closed
+
+	/**
+	 * Handles a structural character outside strings.
+	 */
+	void structural(const std::size_t pos) {
+		switch (data[pos]) {
+		case '[':
+		case '{':
+			if (depth == 0 && data[pos] == '[' && !info.hasArray) {
+				info.begin = pos;
+				info.hasArray = true;
+			}
+			++depth;
+			break;
+		case ']':
+		case '}':
+			if (depth > 0 && --depth == 0 && info.hasArray)
+				done = true;
+			if (done)
+				info.end = pos;
+			break;
+		default:  // n
+			if (depth == 1 && info.hasArray && pos + 4 <= length && memcmp(data + pos, "null", 4) == 0)
+				info.hasNull = true;
+		}
+	}
+
+	/**
+	 * Handles a block of 64 bytes starting at `pos`, which must hold a backslash; one byte at a time.
+	 */
+	void blockWithEscapes(const char * block, const std::size_t pos, const std::size_t n) {
+		for (std::size_t i = 0; i < n && !done; ++i) {
+			const char c = block[i];
+			if (inString) {
+				if (escaped)
+					escaped = false;
+				else if (c == '\\')
+					escaped = true;
+				else if (c == '"')
+					inString = false;
+			} else if (c == '"')
+				inString = true;
+			else if (c == '[' || c == ']' || c == '{' || c == '}' || c == 'n')
+				structural(pos + i);
+		}
+	}
+
+	/**
+	 * Handles a block of 64 bytes starting at `pos`; only the first `n` bytes belong to the frame.
+	 */
+	void block(const char * block, const std::size_t pos, const std::size_t n) {
+		BlockMasks masks;
+		kernels.classify(block, inString, masks);
+		if (masks.backslash != 0 || escaped) {
+			blockWithEscapes(block, pos, n);
+			return;
+		}
+		const uint64_t stringMask = masks.string ^ (inString ? ~uint64_t(0) : 0);
+		inString = (stringMask >> 63) != 0;
+		uint64_t outside = masks.structural & ~stringMask;
+		if (n < 64)
+			outside &= (uint64_t(1) << n) - 1;
+		while (outside != 0 && !done) {
+			structural(pos + __builtin_ctzll(outside));
+			outside &= outside - 1;
+		}
+	}
+};
+
+/**
+ * Scans a frame with the given kernels; see scanFrame().
+ */
+FrameInfo scan(const char * data, const std::size_t length, const Kernels & kernels) {
+	Scanner scanner;
+	scanner.kernels = kernels;
+	scanner.data = data;
+	scanner.length = length;
+	scanner.info.isEvent = length > 2 && data[0] == '4' && data[1] == '2';
+	scanner.info.hasArray = false;
+	scanner.info.hasNull = false;
+	scanner.info.begin = scanner.info.end = 0;
+	scanner.depth = 0;
+	scanner.inString = scanner.escaped = scanner.done = false;
+
+	std::size_t pos = 0;
+	while (pos + 64 <= length && !scanner.done) {
+		// Long strings, such as the camera image, are skipped over without classifying their bytes
+		if (scanner.inString && !scanner.escaped) {
+			pos = kernels.skipString(data, pos, length);
+			if (pos + 64 > length)
+				break;
+		}
+		scanner.block(data + pos, pos, 64);
+		pos += 64;
+	}
+	if (pos < length && !scanner.done) {
+		// The last, partial block is padded with blanks
+		char tail[64];
+		memset(tail, ' ', sizeof(tail));
+		memcpy(tail, data + pos, length - pos);
+		scanner.block(tail, pos, length - pos);
+	}
+	scanner.info.hasArray = scanner.info.hasArray && scanner.done;
+	return scanner.info;
+}
+
+}
+
+bool scanKernelSupported(const ScanKernel kernel) {
+#ifdef FRAME_SCANNER_X86
+	__builtin_cpu_init();
+	switch (kernel) {
+	case ScanKernel::avx2:
+		return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("pclmul");
+	case ScanKernel::sse2:
+		return __builtin_cpu_supports("sse2");
+	default:
+		return true;
+	}
+#else
+	return kernel == ScanKernel::scalar;
+#endif
+}
+
+FrameInfo scanFrame(const char * data, const std::size_t length) {
+	return scan(data, length, fastestKernels);
+}
+
+FrameInfo scanFrame(const char * data, const std::size_t length, const ScanKernel kernel) {
+	return scan(data, length, kernelsFor(kernel));
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstddef>
+
+/**
+ * Structure of a Socket.IO frame, as determined by scanFrame().
+ */
+struct FrameInfo {
+	bool isEvent;  // Whether the frame starts with "42", i.e. it is a message event
+	bool hasArray;  // Whether the frame holds a complete JSON array, spanning [begin, end]
+	bool hasNull;  // Whether a `null` is an element of the array, outside strings and nested values
+	std::size_t begin;  // Position of the array's opening bracket
+	std::size_t end;  // Position of the array's closing bracket
+};
+
+/**
+ * Classifies a Socket.IO frame in a single pass over its bytes: the "42" event prefix, the
+ * JSON array that follows it, and whether the array has a `null` element, as in
+ * `42["telemetry",null]`, sent by the simulator in manual mode. Brackets and `null`
+ * appearing within strings, e.g. in the camera image, are ignored.
+ *
+ * Bytes are classified 64 at a time with AVX2 or SSE2, depending on what the processor
+ * supports, or one at a time on other architectures. Positions inside strings are found
+ * from the quote positions, without looking at the bytes one by one, unless the 64 bytes
+ * contain a backslash. Within a string, blocks are only searched for the closing quote, so
+ * the camera image costs little more than a memchr().
+ * @param data the frame
+ * @param length the frame length in bytes
+ * @return the frame structure
+ */
+FrameInfo scanFrame(const char * data, const std::size_t length);
+
+/**
+ * Instruction sets the scanner has kernels for. The scalar kernels are always compiled, as
+ * the reference the others are tested against.
+ */
+enum class ScanKernel {
+	scalar,
+	sse2,  // x86 only
+	avx2  // x86 only, with PCLMULQDQ
+};
+
+/**
+ * @return whether the kernels for the given instruction set can run on this processor
+ */
+bool scanKernelSupported(const ScanKernel kernel);
+
+/**
+ * Classifies a frame as scanFrame() does, with the kernels for the given instruction set,
+ * which must be supported.
+ */
+FrameInfo scanFrame(const char * data, const std::size_t length, const ScanKernel kernel);
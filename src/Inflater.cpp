@@ -0,0 +1,158 @@
+#include "Inflater.h"
+#include <algorithm>
+
+namespace {
+
+const std::size_t initialOutput = 16384;
+
+// Removed from the end of every message by the compressor, restored before decompressing
+const unsigned char flushTrailer[] = { 0x00, 0x00, 0xFF, 0xFF };
+
+/**
+ * @return the string without its leading and trailing spaces and tabs
+ */
+std::string trim(const std::string & text) {
+	const auto begin = text.find_first_not_of(" \t");
+	if (begin == std::string::npos)
+		return std::string();
+	return text.substr(begin, text.find_last_not_of(" \t") - begin + 1);
+}
+
+/**
+ * @return the window size of a *_max_window_bits parameter, from 8 to 15; 0 if invalid
+ */
+int windowBitsValue(const std::string & value) {
+	if (value.size() == 1 && value[0] >= '8' && value[0] <= '9')
+		return value[0] - '0';
+	if (value.size() == 2 && value[0] == '1' && value[1] >= '0' && value[1] <= '5')
+		return 10 + value[1] - '0';
+	return 0;
+}
+
+}
+
+Inflater::Inflater(const int windowBits) :
+		stream(), output(initialOutput), outputLength { 0 } {
+	// Raw deflate
+	inflateInit2(&stream, -windowBits);
+}
+
+Inflater::~Inflater() {
+	inflateEnd(&stream);
+}
+
+bool Inflater::inflate(const char * data, const std::size_t length, const std::size_t maxLength) {
+	outputLength = 0;
+	stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+	stream.avail_in = length;
+	bool trailer = false;
+	while (true) {
+		if (outputLength == output.size()) {
+			if (output.size() >= maxLength)
+				return false;
+			output.resize(std::min(2 * output.size(), maxLength));
+		}
+		stream.next_out = reinterpret_cast<Bytef *>(output.data() + outputLength);
+		stream.avail_out = output.size() - outputLength;
+		const auto result = ::inflate(&stream, Z_SYNC_FLUSH);
+		outputLength = output.size() - stream.avail_out;
+		if (result == Z_STREAM_END) {
+			// The final block of a stream: the next message starts a new one
+			inflateReset(&stream);
+			return true;
+		}
+		if (result != Z_OK && result != Z_BUF_ERROR)
+			return false;
+		if (stream.avail_in == 0 && stream.avail_out > 0) {
+			if (trailer)
+				return true;
+			stream.next_in = const_cast<Bytef *>(flushTrailer);
+			stream.avail_in = sizeof(flushTrailer);
+			trailer = true;
+		}
+	}
+}
+
+void Inflater::reset(const int windowBits) {
+	inflateReset2(&stream, -windowBits);
+	outputLength = 0;
+}
+
+InflaterPool::InflaterPool() :
+		inflaters() {
+}
+
+std::unique_ptr<Inflater> InflaterPool::acquire(const int windowBits) {
+	if (inflaters.empty())
+		return std::unique_ptr<Inflater>(new Inflater(windowBits));
+	auto inflater = std::move(inflaters.back());
+	inflaters.pop_back();
+	if (windowBits != maxWindowBits)
+		inflater->reset(windowBits);
+	return inflater;
+}
+
+void InflaterPool::release(std::unique_ptr<Inflater> inflater) {
+	if (!inflater)
+		return;
+	inflater->reset();
+	inflaters.push_back(std::move(inflater));
+}
+
+std::string negotiateDeflate(const std::string & offers, int & windowBits) {
+	// Offers are separated by commas, their parameters by semicolons
+	for (std::size_t begin = 0; begin < offers.size();) {
+		auto end = offers.find(',', begin);
+		if (end == std::string::npos)
+			end = offers.size();
+		const auto offer = offers.substr(begin, end - begin);
+		begin = end + 1;
+
+		std::vector<std::string> parameters;
+		for (std::size_t parameterBegin = 0; parameterBegin <= offer.size();) {
+			auto parameterEnd = offer.find(';', parameterBegin);
+			if (parameterEnd == std::string::npos)
+				parameterEnd = offer.size();
+			parameters.push_back(trim(offer.substr(parameterBegin, parameterEnd - parameterBegin)));
+			parameterBegin = parameterEnd + 1;
+		}
+		if (parameters[0] != "permessage-deflate")
+			continue;
+
+		bool valid { true };
+		bool serverNoContextTakeover { false }, clientNoContextTakeover { false };
+		int serverBits { 0 }, clientBits { 0 };  // 0 if not offered, -1 if offered without a value
+		for (std::size_t i = 1; i < parameters.size() && valid; ++i) {
+			const auto & parameter = parameters[i];
+			const auto equal = parameter.find('=');
+			const auto name = trim(parameter.substr(0, equal));
+			auto value = equal == std::string::npos ? std::string() : trim(parameter.substr(equal + 1));
+			if (value.size() >= 2 && value.front() == '"' && value.back() == '"')
+				value = value.substr(1, value.size() - 2);
+			if (name == "server_no_context_takeover" && equal == std::string::npos && !serverNoContextTakeover)
+				serverNoContextTakeover = true;
+			else if (name == "client_no_context_takeover" && equal == std::string::npos && !clientNoContextTakeover)
+				// The window may be kept all the same: the client just doesn't refer to it
+				clientNoContextTakeover = true;
+			else if (name == "server_max_window_bits" && serverBits == 0)
+				valid = (serverBits = windowBitsValue(value)) > 0;
+			else if (name == "client_max_window_bits" && clientBits == 0)
+				valid = (clientBits = equal == std::string::npos ? -1 : windowBitsValue(value)) != 0;
+			else
+				valid = false;
+		}
+		if (!valid)
+			continue;
+
+		// The server never compresses, so it keeps no window either
+		std::string response = "permessage-deflate; server_no_context_takeover";
+		if (serverBits > 0)
+			response += "; server_max_window_bits=" + std::to_string(serverBits);
+		if (clientBits > 0)
+			response += "; client_max_window_bits=" + std::to_string(clientBits);
+		// zlib compresses with a window of 2^9 bytes when asked for 2^8, hence a window no smaller
+		windowBits = clientBits > 0 ? std::max(clientBits, 9) : maxWindowBits;
+		return response;
+	}
+	return std::string();
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <zlib.h>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Largest sliding window of permessage-deflate, as a base-2 logarithm: 32 KB.
+ */
+const int maxWindowBits = 15;
+
+/**
+ * Decompresses the messages of a WebSocket connection that negotiated permessage-deflate
+ * (RFC 7692). The sliding window is kept from one message to the next, so that clients may
+ * compress with context takeover: telemetry messages repeat the same keys, and often the same
+ * values, which a shared window turns into back-references.
+ */
+class Inflater {
+	z_stream stream;
+	std::vector<char> output;
+	std::size_t outputLength;
+
+public:
+	/**
+	 * @param windowBits the base-2 logarithm of the largest window the client may use, from 8
+	 * to 15, as negotiated
+	 */
+	Inflater(const int windowBits = maxWindowBits);
+	~Inflater();
+
+	Inflater(const Inflater &) = delete;
+	Inflater & operator=(const Inflater &) = delete;
+
+	/**
+	 * Decompresses a message.
+	 * @param data the compressed payload
+	 * @param length its length
+	 * @param maxLength the maximum decompressed length
+	 * @return false if the payload is corrupt, or decompresses to more than maxLength bytes
+	 */
+	bool inflate(const char * data, const std::size_t length, const std::size_t maxLength);
+
+	/**
+	 * @return the latest message decompressed; valid until the next call to inflate()
+	 */
+	const char * data() const {
+		return output.data();
+	}
+
+	/**
+	 * @return the length of the latest message decompressed
+	 */
+	std::size_t length() const {
+		return outputLength;
+	}
+
+	/**
+	 * Forgets the sliding window, for use with another connection; the memory is kept, unless
+	 * the window size changes.
+	 * @param windowBits the base-2 logarithm of the largest window the next client may use
+	 */
+	void reset(const int windowBits = maxWindowBits);
+};
+
+/**
+ * Inflaters given back by closed connections, to be reused by new ones: setting up the zlib
+ * state takes over 40 KB of allocations per connection.
+ */
+class InflaterPool {
+	std::vector<std::unique_ptr<Inflater>> inflaters;
+
+public:
+	InflaterPool();
+
+	/**
+	 * @param windowBits the base-2 logarithm of the largest window the client may use
+	 * @return an inflater with an empty sliding window of that size
+	 */
+	std::unique_ptr<Inflater> acquire(const int windowBits);
+
+	/**
+	 * Gives back an inflater; nullptr is ignored.
+	 */
+	void release(std::unique_ptr<Inflater> inflater);
+};
+
+/**
+ * Negotiates permessage-deflate: messages from the client may be compressed, messages to the
+ * client never are. The first offer whose parameters are valid is accepted. Window sizes
+ * offered are honoured: `server_max_window_bits` is echoed, as it can't be exceeded by a
+ * server that doesn't compress, and `client_max_window_bits` with a value sets the window of
+ * the client, which is echoed as well.
+ * @param offers value of the Sec-WebSocket-Extensions request header
+ * @param windowBits set to the base-2 logarithm of the largest window the client may use
+ * @return the Sec-WebSocket-Extensions response header value; empty if the client did not
+ * offer permessage-deflate with valid parameters
+ */
+std::string negotiateDeflate(const std::string & offers, int & windowBits);
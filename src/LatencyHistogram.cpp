@@ -0,0 +1,63 @@
+#include "LatencyHistogram.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+LatencyHistogram::LatencyHistogram() :
+		counts(), total { 0 }, maxValue { 0 } {
+}
+
+long long LatencyHistogram::now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+unsigned LatencyHistogram::bucketOf(const uint64_t value) {
+	// Values below nSubBuckets get a bucket each; above, the position of the leading bit picks the group
+	if (value < nSubBuckets)
+		return value;
+	const unsigned leadingBit = 63 - __builtin_clzll(value);
+	const unsigned shift = leadingBit - subBucketBits;
+	return (shift + 1) * nSubBuckets + ((value >> shift) - nSubBuckets);
+}
+
+uint64_t LatencyHistogram::bucketTop(const unsigned bucket) {
+	if (bucket < nSubBuckets)
+		return bucket;
+	const unsigned shift = bucket / nSubBuckets - 1;
+	const uint64_t first = static_cast<uint64_t>(nSubBuckets + bucket % nSubBuckets) << shift;
+	return first + ((uint64_t(1) << shift) - 1);
+}
+
+uint64_t LatencyHistogram::percentile(const double fraction) const {
+	if (total == 0)
+		return 0;
+	const auto rank = std::max<uint64_t>(1, static_cast<uint64_t>(fraction * total + .5));
+	uint64_t seen = 0;
+	for (unsigned bucket = 0; bucket < nBuckets; ++bucket) {
+		seen += counts[bucket];
+		if (seen >= rank)
+			return std::min(bucketTop(bucket), maxValue);
+	}
+	return maxValue;
+}
+
+void LatencyHistogram::subtract(const LatencyHistogram & earlier) {
+	for (unsigned bucket = 0; bucket < nBuckets; ++bucket)
+		counts[bucket] -= earlier.counts[bucket];
+	total -= earlier.total;
+}
+
+void LatencyHistogram::reset() {
+	counts.fill(0);
+	total = 0;
+	maxValue = 0;
+}
+
+std::string LatencyHistogram::summary() const {
+	char text[200];
+	snprintf(text, sizeof(text), "{\"count\":%llu,\"p50\":%.3f,\"p99\":%.3f,\"p99.9\":%.3f,\"max\":%.3f}",
+			static_cast<unsigned long long>(total), percentile(.5) / 1e3, percentile(.99) / 1e3,
+			percentile(.999) / 1e3, maxValue / 1e3);
+	return text;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <string>
+
+/**
+ * Histogram of durations in nanoseconds, with buckets of logarithmically growing width: each
+ * power of 2 is split into 32 buckets, so that percentiles are accurate to about 3%, from
+ * nanoseconds to minutes, in constant memory. Recording a value takes a few instructions and
+ * never allocates. Not thread-safe.
+ */
+class LatencyHistogram {
+	static const unsigned subBucketBits = 5;
+	static const unsigned nSubBuckets = 1 << subBucketBits;
+	static const unsigned nBuckets = (64 - subBucketBits + 1) * nSubBuckets;
+
+	std::array<uint64_t, nBuckets> counts;
+	uint64_t total;  // Number of values recorded
+	uint64_t maxValue;
+
+	/**
+	 * @return the bucket of a value
+	 */
+	static unsigned bucketOf(const uint64_t value);
+
+	/**
+	 * @return the highest value that falls in a bucket
+	 */
+	static uint64_t bucketTop(const unsigned bucket);
+
+public:
+	LatencyHistogram();
+
+	/**
+	 * @return the current time in nanoseconds from a monotonic clock
+	 */
+	static long long now();
+
+	/**
+	 * Records a duration.
+	 * @param nanoseconds the duration; negative durations are recorded as 0
+	 */
+	void record(const long long nanoseconds) {
+		const uint64_t value = nanoseconds > 0 ? nanoseconds : 0;
+		++counts[bucketOf(value)];
+		++total;
+		if (value > maxValue)
+			maxValue = value;
+	}
+
+	/**
+	 * @param fraction the fraction of values, in [0, 1]
+	 * @return an upper bound, within 3%, of the given fraction of the recorded values; 0 if none
+	 */
+	uint64_t percentile(const double fraction) const;
+
+	/**
+	 * @return the number of values recorded
+	 */
+	uint64_t count() const {
+		return total;
+	}
+
+	/**
+	 * Removes the values recorded by an earlier copy of this histogram, leaving those recorded
+	 * since. The maximum is kept, as it can't be told whether it was recorded since.
+	 */
+	void subtract(const LatencyHistogram & earlier);
+
+	/**
+	 * Forgets all values recorded.
+	 */
+	void reset();
+
+	/**
+	 * @return count and percentiles in microseconds, in JSON format
+	 */
+	std::string summary() const;
+};
@@ -0,0 +1,320 @@
+#include "LazyJson.h"
+#include "Numbers.h"
+#include <cstring>
+#include <string>
+
+namespace {
+
+const char * skipWhitespace(const char * p, const char * end) {
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+		++p;
+	return p;
+}
+
+/**
+ * Expects a string starting at p. The closing quote is searched with memchr(); a quote is
+ * only taken for an escape if preceded by an odd number of backslashes.
+ * @return past the closing quote, nullptr if there is no such string
+ */
+const char * skipString(const char * p, const char * end) {
+	for (const char * from = p + 1; from < end;) {
+		auto quote = static_cast<const char *>(memchr(from, '"', end - from));
+		if (quote == nullptr)
+			return nullptr;
+		const char * q = quote;
+		while (q > p + 1 && q[-1] == '\\')
+			--q;
+		if ((quote - q) % 2 == 0)
+			return quote + 1;
+		from = quote + 1;
+	}
+	return nullptr;
+}
+
+/**
+ * Expects a number or a literal starting at p.
+ * @return past its last character
+ */
+const char * skipScalar(const char * p, const char * end) {
+	while (p < end && *p != ',' && *p != ']' && *p != '}' && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r')
+		++p;
+	return p;
+}
+
+/**
+ * Expects an array or object starting at p; nested values are only checked for balanced brackets.
+ * @return past the closing bracket, nullptr if there is none
+ */
+const char * skipContainer(const char * p, const char * end) {
+	unsigned depth = 0;
+	while (p < end) {
+		switch (*p) {
+		case '"':
+			p = skipString(p, end);
+			if (p == nullptr)
+				return nullptr;
+			continue;
+		case '[':
+		case '{':
+			++depth;
+			break;
+		case ']':
+		case '}':
+			if (--depth == 0)
+				return p + 1;
+			break;
+		default:
+			break;
+		}
+		++p;
+	}
+	return nullptr;
+}
+
+int hexDigit(const char c) {
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+/**
+ * Reads the four hexadecimal digits of a \u escape sequence starting at p.
+ * @return the code unit, -1 if invalid
+ */
+long codeUnit(const char * p, const char * end) {
+	if (end - p < 4)
+		return -1;
+	long unit = 0;
+	for (int i = 0; i < 4; ++i) {
+		const int digit = hexDigit(p[i]);
+		if (digit < 0)
+			return -1;
+		unit = unit * 16 + digit;
+	}
+	return unit;
+}
+
+void appendUtf8(std::string & text, const long codePoint) {
+	if (codePoint < 0x80)
+		text += static_cast<char>(codePoint);
+	else if (codePoint < 0x800) {
+		text += static_cast<char>(0xC0 | (codePoint >> 6));
+		text += static_cast<char>(0x80 | (codePoint & 0x3F));
+	} else if (codePoint < 0x10000) {
+		text += static_cast<char>(0xE0 | (codePoint >> 12));
+		text += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+		text += static_cast<char>(0x80 | (codePoint & 0x3F));
+	} else {
+		text += static_cast<char>(0xF0 | (codePoint >> 18));
+		text += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+		text += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+		text += static_cast<char>(0x80 | (codePoint & 0x3F));
+	}
+}
+
+/**
+ * Decodes the escape sequences in the content of a string, spanning [p, end).
+ * @return false if an escape sequence is invalid
+ */
+bool unescape(const char * p, const char * end, std::string & text) {
+	text.clear();
+	while (p < end) {
+		if (*p != '\\') {
+			text += *p++;
+			continue;
+		}
+		if (++p == end)
+			return false;
+		switch (*p++) {
+		case '"':
+			text += '"';
+			break;
+		case '\\':
+			text += '\\';
+			break;
+		case '/':
+			text += '/';
+			break;
+		case 'b':
+			text += '\b';
+			break;
+		case 'f':
+			text += '\f';
+			break;
+		case 'n':
+			text += '\n';
+			break;
+		case 'r':
+			text += '\r';
+			break;
+		case 't':
+			text += '\t';
+			break;
+		case 'u': {
+			long codePoint = codeUnit(p, end);
+			if (codePoint < 0 || (codePoint >= 0xDC00 && codePoint < 0xE000))
+				return false;
+			p += 4;
+			if (codePoint >= 0xD800 && codePoint < 0xDC00) {
+				// High surrogate, to be followed by a low one
+				if (end - p < 6 || p[0] != '\\' || p[1] != 'u')
+					return false;
+				const long low = codeUnit(p + 2, end);
+				if (low < 0xDC00 || low >= 0xE000)
+					return false;
+				codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+				p += 6;
+			}
+			appendUtf8(text, codePoint);
+			break;
+		}
+		default:
+			return false;
+		}
+	}
+	return true;
+}
+
+}
+
+bool LazyValue::isNull() const {
+	return end - begin == 4 && memcmp(begin, "null", 4) == 0;
+}
+
+bool LazyValue::equals(const char * s) const {
+	if (begin == nullptr || *begin != '"')
+		return false;
+	const auto n = strlen(s);
+	if (memchr(begin + 1, '\\', end - begin - 2) == nullptr)
+		return end - begin == static_cast<std::ptrdiff_t>(n + 2) && memcmp(begin + 1, s, n) == 0;
+	std::string text;
+	return unescape(begin + 1, end - 1, text) && text == s;
+}
+
+bool LazyValue::getNumber(double & number) const {
+	const char * first = begin;
+	const char * last = end;
+	if (first == nullptr || first == last)
+		return false;
+	if (*first == '"') {
+		++first;
+		--last;
+		if (memchr(first, '\\', last - first) != nullptr) {
+			std::string text;
+			return unescape(first, last, text) && parseDouble(text.data(), text.data() + text.size(), number);
+		}
+	}
+	// The closing quote, or the delimiter following the value, stops parseDouble() from reading past it
+	return parseDouble(first, last, number);
+}
+
+bool LazyJson::parse(const char * begin, const char * endInit) {
+	elements.clear();
+	end = endInit;
+	cursor = skipWhitespace(begin, end);
+	complete = true;
+	valid = false;
+	if (cursor == end || (*cursor != '[' && *cursor != '{'))
+		return false;
+	isObject = *cursor == '{';
+	cursor = skipWhitespace(cursor + 1, end);
+	valid = true;
+	if (cursor < end && *cursor == (isObject ? '}' : ']'))
+		return true;
+	complete = false;
+	return true;
+}
+
+bool LazyJson::fail() {
+	complete = true;
+	valid = false;
+	return false;
+}
+
+bool LazyJson::next() {
+	if (complete)
+		return false;
+
+	// The previous element, if an array or object, has only been delimited up to its start
+	if (!elements.empty()) {
+		auto & previous = elements.back().value;
+		if (*previous.begin == '[' || *previous.begin == '{') {
+			previous.end = skipContainer(previous.begin, end);
+			if (previous.end == nullptr)
+				return fail();
+			cursor = previous.end;
+		}
+		cursor = skipWhitespace(cursor, end);
+		if (cursor == end)
+			return fail();
+		if (*cursor == (isObject ? '}' : ']')) {
+			complete = true;
+			return false;
+		}
+		if (*cursor != ',')
+			return fail();
+		cursor = skipWhitespace(cursor + 1, end);
+	}
+
+	Element element;
+	if (isObject) {
+		if (cursor == end || *cursor != '"')
+			return fail();
+		element.key.begin = cursor;
+		element.key.end = skipString(cursor, end);
+		if (element.key.end == nullptr)
+			return fail();
+		cursor = skipWhitespace(element.key.end, end);
+		if (cursor == end || *cursor != ':')
+			return fail();
+		cursor = skipWhitespace(cursor + 1, end);
+	}
+	if (cursor == end)
+		return fail();
+	element.value.begin = cursor;
+	switch (*cursor) {
+	case '"':
+		element.value.end = skipString(cursor, end);
+		if (element.value.end == nullptr)
+			return fail();
+		break;
+	case '[':
+	case '{':
+		// Skipped only if the next element is asked for
+		element.value.end = end;
+		break;
+	default:
+		// Numbers must be followed by a delimiter, for parseDouble() not to read past the text
+		element.value.end = skipScalar(cursor, end);
+		if (element.value.end == cursor || element.value.end == end)
+			return fail();
+		break;
+	}
+	cursor = element.value.end;
+	elements.push_back(element);
+	return true;
+}
+
+LazyValue LazyJson::at(const std::size_t index) {
+	while (elements.size() <= index)
+		if (!next())
+			return LazyValue();
+	return elements[index].value;
+}
+
+LazyValue LazyJson::find(const char * key) {
+	if (!isObject)
+		return LazyValue();
+	std::size_t i = 0;
+	while (true) {
+		if (i == elements.size() && !next())
+			return LazyValue();
+		if (elements[i].key.equals(key))
+			return elements[i].value;
+		++i;
+	}
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include "Arena.h"
+#include <cstddef>
+#include <vector>
+
+/**
+ * Text of a JSON value within a message, not decoded until asked for.
+ */
+struct LazyValue {
+	const char * begin { nullptr };  // First character of the value; nullptr if there is no such value
+	const char * end { nullptr };  // Past the last character; strings include their quotes. For
+	                               // arrays and objects, may be the end of the enclosing text
+
+	/**
+	 * @return true if there is such a value
+	 */
+	bool exists() const {
+		return begin != nullptr;
+	}
+
+	/**
+	 * @return true if the value is null
+	 */
+	bool isNull() const;
+
+	/**
+	 * @return true if the value is a string equal to the given one, once its escape sequences are decoded
+	 */
+	bool equals(const char * s) const;
+
+	/**
+	 * Reads a number, or a string holding a number, as the simulator sends the telemetry values.
+	 * @param value set to the number, if successful
+	 * @return true if successful
+	 */
+	bool getNumber(double & value) const;
+};
+
+/**
+ * Read-only view of a JSON array or object, parsed on demand. Elements are only delimited,
+ * up to the one asked for: strings are skipped by searching for their closing quote, nested
+ * arrays and objects by matching their brackets, and nothing is decoded nor copied until
+ * asked for. Large values never read, such as the camera image in telemetry messages, cost
+ * neither allocations nor parsing, and those after the elements asked for are not even looked
+ * at.
+ *
+ * The text must outlive the view. The element index is allocated from the current arena, if
+ * any, when the view is constructed; see ArenaScope.
+ */
+class LazyJson {
+	struct Element {
+		LazyValue key;  // For objects
+		LazyValue value;
+	};
+
+	std::vector<Element, ArenaAllocator<Element>> elements;  // Elements delimited so far
+	const char * cursor { nullptr };  // Where the next element starts
+	const char * end { nullptr };
+	bool isObject { false };
+	bool complete { true };  // Whether all elements have been delimited, or the text is malformed
+	bool valid { false };  // Whether no error has been found so far
+
+	/**
+	 * Delimits the next element.
+	 * @return false if there are no more elements, or the text is malformed
+	 */
+	bool next();
+
+	bool fail();
+
+public:
+	/**
+	 * Starts a view of an array or object; elements are delimited when asked for.
+	 * @param begin the first character of the text; leading whitespace is allowed
+	 * @param end past the last character of the text; the array or object need not end there
+	 * @return false if the text doesn't start with an array or object
+	 */
+	bool parse(const char * begin, const char * end);
+
+	/**
+	 * Starts a view of an array or object held by another view.
+	 */
+	bool parse(const LazyValue & value) {
+		return parse(value.begin, value.end);
+	}
+
+	/**
+	 * @return the element at the given index of an array, or the value of an object member
+	 * in document order; a non-existing value if there is none, or the text is malformed
+	 */
+	LazyValue at(const std::size_t index);
+
+	/**
+	 * Looks up a member of an object. Keys are compared as they are written, unless they hold
+	 * escape sequences, which are then decoded.
+	 * @return the member's value; a non-existing value if there is none, or the text is malformed
+	 */
+	LazyValue find(const char * key);
+
+	/**
+	 * @return false if malformed text has been found while delimiting elements
+	 */
+	bool isValid() const {
+		return valid;
+	}
+};
@@ -0,0 +1,205 @@
+#include "Logger.h"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+namespace {
+
+const char magic[8] = { 'P', 'I', 'D', 'L', 'O', 'G', '1', '\0' };
+
+}
+
+Logger::Logger(const size_t capacityLog2) :
+		buffer(size_t(1) << capacityLog2), mask { (size_t(1) << capacityLog2) - 1 }, enqueuePos { 0 }, dequeuePos { 0 },
+		nDropped { 0 }, stopping { false }, file { nullptr }, echo { true } {
+	for (size_t i = 0; i < buffer.size(); ++i)
+		buffer[i].sequence.store(i, memory_order_relaxed);
+}
+
+Logger::~Logger() {
+	stop();
+}
+
+Logger & Logger::instance() {
+	static Logger logger(12);
+	return logger;
+}
+
+bool Logger::push(const LogRecord & record) {
+	// Bounded multi-producer queue, see http://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+	auto pos = enqueuePos.load(memory_order_relaxed);
+	Cell * cell;
+	while (true) {
+		cell = &buffer[pos & mask];
+		const auto sequence = cell->sequence.load(memory_order_acquire);
+		const auto diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+		if (diff == 0) {
+			if (enqueuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed))
+				break;
+		} else if (diff < 0)
+			return false;  // The buffer is full
+		else
+			pos = enqueuePos.load(memory_order_relaxed);
+	}
+	cell->record = record;
+	cell->sequence.store(pos + 1, memory_order_release);
+	return true;
+}
+
+bool Logger::pop(LogRecord & record) {
+	// Only the background thread consumes records
+	auto & cell = buffer[dequeuePos & mask];
+	if (cell.sequence.load(memory_order_acquire) != dequeuePos + 1)
+		return false;
+	record = cell.record;
+	cell.sequence.store(dequeuePos + mask + 1, memory_order_release);
+	++dequeuePos;
+	return true;
+}
+
+bool Logger::start(const std::string & fileName, const bool echoToConsole) {
+	auto & logger = instance();
+	if (!fileName.empty()) {
+		logger.file = fopen(fileName.c_str(), "wb");
+		if (logger.file == nullptr || !writeHeader(logger.file))
+			return false;
+	}
+	logger.echo = echoToConsole;
+	logger.thread = std::thread(&Logger::run, &logger);
+	return true;
+}
+
+void Logger::stop() {
+	auto & logger = instance();
+	if (!logger.thread.joinable())
+		return;
+	logger.stopping = true;
+	logger.thread.join();
+	if (logger.file != nullptr) {
+		fclose(logger.file);
+		logger.file = nullptr;
+	}
+}
+
+bool Logger::log(const LogEvent event, const uint32_t session, const double value0, const double value1,
+		const double value2, const double value3) {
+	LogRecord record;
+	record.timestamp = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count();
+	record.event = event;
+	record.reserved = 0;
+	record.session = session;
+	record.values[0] = value0;
+	record.values[1] = value1;
+	record.values[2] = value2;
+	record.values[3] = value3;
+	auto & logger = instance();
+	if (logger.push(record))
+		return true;
+	logger.nDropped.fetch_add(1, memory_order_relaxed);
+	return false;
+}
+
+void Logger::run() {
+	LogRecord record;
+	while (true) {
+		// Checked before draining the buffer, so that records logged before stop() are not lost
+		const bool lastRound = stopping.load();
+		bool idle = true;
+		while (pop(record)) {
+			output(record);
+			idle = false;
+		}
+		const auto dropped = nDropped.exchange(0, memory_order_relaxed);
+		if (dropped > 0) {
+			record.timestamp = std::chrono::duration_cast<std::chrono::microseconds>(
+					std::chrono::system_clock::now().time_since_epoch()).count();
+			record.event = LogEvent::dropped;
+			record.session = 0;
+			record.values[0] = dropped;
+			record.values[1] = record.values[2] = record.values[3] = 0;
+			output(record);
+		}
+		if (!idle) {
+			if (file != nullptr)
+				fflush(file);
+			if (echo)
+				cout << flush;
+		}
+		if (lastRound)
+			return;
+		if (idle)
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+}
+
+void Logger::output(const LogRecord & record) {
+	if (file != nullptr)
+		fwrite(&record, sizeof(record), 1, file);
+	if (echo && record.event != LogEvent::frame)
+		cout << format(record) << '\n';
+}
+
+std::string Logger::format(const LogRecord & record) {
+	const auto & v = record.values;
+	char text[256];
+	switch (record.event) {
+	case LogEvent::connected:
+		snprintf(text, sizeof(text), "Connected!!!");
+		break;
+	case LogEvent::disconnected:
+		snprintf(text, sizeof(text), "Disconnected");
+		break;
+	case LogEvent::refused:
+		snprintf(text, sizeof(text), "Too many connections, refusing one");
+		break;
+	case LogEvent::bestRun:
+		snprintf(text, sizeof(text), "Best run so far with error = %g and params P =%g, I =%g, D =%g", v[0], v[1], v[2], v[3]);
+		break;
+	case LogEvent::tuningComplete:
+		snprintf(text, sizeof(text), "Params tuning complete");
+		break;
+	case LogEvent::frame:
+		snprintf(text, sizeof(text), "cte=%g speed=%g steering=%g throttle=%g", v[0], v[1], v[2], v[3]);
+		break;
+	case LogEvent::snapshotFailed:
+		snprintf(text, sizeof(text), "Failed to write snapshot");
+		break;
+	case LogEvent::dropped:
+		snprintf(text, sizeof(text), "%.0f log record(s) dropped", v[0]);
+		break;
+	case LogEvent::mismatch:
+		snprintf(text, sizeof(text), "Frame decoded differently from the reference, saved as mismatch-%.0f", v[0]);
+		break;
+	case LogEvent::overloaded:
+		snprintf(text, sizeof(text), "Replies late (99th percentile %.0f us, budget %.0f us), refusing a connection", v[0],
+				v[1]);
+		break;
+	case LogEvent::shedding:
+		snprintf(text, sizeof(text), "Replies not read (%.0f bytes pending, limit %.0f), dropping messages", v[0], v[1]);
+		break;
+	case LogEvent::caughtUp:
+		snprintf(text, sizeof(text), "Replies read (%.0f bytes pending), handling messages again", v[0]);
+		break;
+	case LogEvent::idle:
+		snprintf(text, sizeof(text), "No message for %.2f s, closing", v[0]);
+		break;
+	default:
+		snprintf(text, sizeof(text), "Unknown event %u: %g %g %g %g", static_cast<unsigned>(record.event), v[0], v[1], v[2], v[3]);
+	}
+	return text;
+}
+
+bool Logger::writeHeader(std::FILE * file) {
+	const uint32_t recordSize = sizeof(LogRecord);
+	return fwrite(magic, sizeof(magic), 1, file) == 1 && fwrite(&recordSize, sizeof(recordSize), 1, file) == 1;
+}
+
+bool Logger::readHeader(std::FILE * file) {
+	char fileMagic[sizeof(magic)];
+	uint32_t recordSize;
+	return fread(fileMagic, sizeof(fileMagic), 1, file) == 1 && memcmp(fileMagic, magic, sizeof(magic)) == 0
+			&& fread(&recordSize, sizeof(recordSize), 1, file) == 1 && recordSize == sizeof(LogRecord);
+}
@@ -0,0 +1,135 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Events that can be logged. Every event has a fixed message, completed with up to four numeric
+ * values; see Logger::format(). New events must be added at the end, to keep existing log
+ * files readable.
+ */
+enum class LogEvent : uint16_t {
+	connected,  // A connection has been established
+	disconnected,  // A connection has been closed
+	refused,  // A connection has been refused, as all sessions are in use
+	bestRun,  // Twiddle found a new best error; values: error, P, I, D
+	tuningComplete,  // Twiddle has converged
+	frame,  // Telemetry processed; values: cte, speed, steering, throttle
+	snapshotFailed,  // Writing a snapshot to file failed
+	dropped,  // Log records have been dropped as the buffer was full; values: count
+	mismatch,  // A frame was decoded differently from the reference, see `--verify`; values: frame file number
+	overloaded,  // A connection has been refused, as replies take longer than the budget; values: 99th percentile, budget, in microseconds
+	shedding,  // Messages are dropped, as the client does not read replies; values: bytes not yet sent, limit
+	caughtUp,  // The client has read enough replies for messages to be handled again; values: bytes not yet sent
+	idle,  // A connection is closed, as no message came for the idle timeout; values: seconds since the latest message
+	count  // Number of events, not an event
+};
+
+/**
+ * Binary log record, as it is buffered in memory and written to file.
+ */
+struct LogRecord {
+	int64_t timestamp;  // Microseconds since the epoch
+	LogEvent event;
+	uint16_t reserved;
+	uint32_t session;  // Session the event refers to, if any
+	double values[4];
+};
+
+/**
+ * Asynchronous logger. Logging a record copies it into a fixed size, lock-free ring buffer;
+ * a background thread takes records out of the buffer, writes them to a binary file, and
+ * prints them to console, so that the calling thread never waits on I/O. When the buffer is
+ * full, records are dropped rather than blocking the caller, and the number of dropped records
+ * is logged later on.
+ * Records can be logged from any thread, before start() too: they are held in the buffer
+ * until the background thread is started.
+ */
+class Logger {
+	/**
+	 * Slot in the ring buffer. The sequence number tells whether the slot is free for the
+	 * producer, or holds a record ready for the consumer, for the current lap of the ring.
+	 */
+	struct Cell {
+		std::atomic<size_t> sequence;
+		LogRecord record;
+	};
+
+	std::vector<Cell> buffer;
+	const size_t mask;  // Buffer size minus 1, the size being a power of 2
+	std::atomic<size_t> enqueuePos;  // Next position to be written by producers
+	size_t dequeuePos;  // Next position to be read by the background thread
+	std::atomic<uint64_t> nDropped;  // Records dropped since the latest `dropped` event was logged
+	std::atomic<bool> stopping;
+	std::FILE * file;  // Binary log file, nullptr if none
+	bool echo;  // Whether records are printed to console
+	std::thread thread;
+
+	Logger(const size_t capacityLog2);
+	~Logger();
+
+	/**
+	 * Returns the only instance of the class.
+	 */
+	static Logger & instance();
+
+	bool push(const LogRecord & record);
+	bool pop(LogRecord & record);
+
+	/**
+	 * Body of the background thread.
+	 */
+	void run();
+
+	/**
+	 * Writes a record to file and/or console, as requested.
+	 */
+	void output(const LogRecord & record);
+
+public:
+	Logger(const Logger &) = delete;
+	Logger & operator=(const Logger &) = delete;
+
+	/**
+	 * Starts the background thread. To be called at most once.
+	 * @param fileName the binary log file; if empty, records are not written to file
+	 * @param echoToConsole whether records, other than `frame`, are printed to console
+	 * @return true if successful; false if the file cannot be opened
+	 */
+	static bool start(const std::string & fileName, const bool echoToConsole = true);
+
+	/**
+	 * Writes out records still in the buffer, and stops the background thread.
+	 */
+	static void stop();
+
+	/**
+	 * Logs an event. Never blocks.
+	 * @param event the event
+	 * @param session the session the event refers to, if any
+	 * @param value0, value1, value2, value3 values that complete the event message
+	 * @return true if the record has been buffered, false if it has been dropped
+	 */
+	static bool log(const LogEvent event, const uint32_t session = 0, const double value0 = 0,
+			const double value1 = 0, const double value2 = 0, const double value3 = 0);
+
+	/**
+	 * Returns the text message for a record, without time stamp.
+	 */
+	static std::string format(const LogRecord & record);
+
+	/**
+	 * Writes the header of a binary log file.
+	 * @return true if successful
+	 */
+	static bool writeHeader(std::FILE * file);
+
+	/**
+	 * Reads and checks the header of a binary log file.
+	 * @return true if the file is a binary log file this program can read
+	 */
+	static bool readHeader(std::FILE * file);
+};
@@ -0,0 +1,251 @@
+#include "MessageHandler.h"
+#include "FrameCheck.h"
+#include "FrameDecoder.h"
+#include "Logger.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+const long long snapshotInterval = 1000000;  // microseconds
+const long long timerTick = 10000;  // microseconds
+
+/**
+ * Timers of a session, numbered session id * nSessionTimers + timer; the global timers come
+ * after those of all the sessions.
+ */
+enum SessionTimer : uint32_t {
+	twiddleTimer, idleTimer, nSessionTimers
+};
+
+/**
+ * Timers not tied to a session, numbered sessions.size() * nSessionTimers + timer.
+ */
+enum GlobalTimer : uint32_t {
+	snapshotTimer, admissionTimer, nGlobalTimers
+};
+
+const char manualReply[] = "42[\"manual\",{}]";
+
+/**
+ * Saves a frame decoded differently from the reference, for framecheck to replay. The frame
+ * is written twice, so that the second time it goes through the extractor fast path, as it
+ * may have in the session.
+ * @param dir the directory
+ * @param number the frame number, making up the file name
+ */
+void saveMismatch(const std::string & dir, const unsigned number, const char * data, const std::size_t length) {
+	const auto fileName = dir + "/mismatch-" + std::to_string(number);
+	auto file = fopen(fileName.c_str(), "wb");
+	if (file == nullptr)
+		return;
+	fwrite(data, 1, length, file);
+	fputc('\n', file);
+	fwrite(data, 1, length, file);
+	fclose(file);
+}
+
+}
+
+MessageHandler::MessageHandler(SessionTable & sessionsInit, ConfigStore & configStoreInit,
+		SnapshotWriter * snapshotWriterInit, const bool predictCteInit, const bool logFramesInit,
+		const std::string & verifyDirInit) :
+		sessions(sessionsInit), configStore(configStoreInit), configReader { configStoreInit.registerReader() },
+		snapshotWriter { snapshotWriterInit }, snapshotRecords(), sessionsChanged { false }, predictCte {
+				predictCteInit }, logFrames { logFramesInit }, verifyDir(verifyDirInit), mismatches { 0 }, fixedRate {
+				false }, batchTelemetry(), batchCommands(), batchReply(), latency(), admissionControl(latency), timerWheel(
+				timerTick, sessionsInit.size() * nSessionTimers + nGlobalTimers), idleTimeout { 0 }, idleHandler() {
+	timerWheel.setCallback([this](const uint32_t timer) {
+		onTimer(timer);
+	});
+	if (snapshotWriter != nullptr)
+		timerWheel.schedule(sessions.size() * nSessionTimers + snapshotTimer, timerWheel.ticks(snapshotInterval));
+}
+
+void MessageHandler::onOpen(Session & session) {
+	session.latestActivity = timerWheel.now();
+	if (idleTimeout > 0)
+		timerWheel.schedule(session.id * nSessionTimers + idleTimer, idleTimeout);
+	if (!session.tuneParams)
+		return;
+	// A window under way when the session was saved, or its connection closed, goes on
+	auto remaining = twiddleInterval();
+	const auto now = PID::getCurrentTimestamp();
+	if (session.latestTwiddleTime < 0)
+		session.latestTwiddleTime = now;
+	else
+		remaining -= (now - session.latestTwiddleTime) * 1000;
+	timerWheel.schedule(session.id * nSessionTimers + twiddleTimer, timerWheel.ticks(remaining));
+}
+
+void MessageHandler::onClose(Session & session) {
+	timerWheel.cancel(session.id * nSessionTimers + twiddleTimer);
+	timerWheel.cancel(session.id * nSessionTimers + idleTimer);
+}
+
+void MessageHandler::setAdmissionLimits(const long long latencyBudget, const std::size_t maxBacklog) {
+	admissionControl.setLimits(latencyBudget, maxBacklog);
+	const auto timer = sessions.size() * nSessionTimers + admissionTimer;
+	if (admissionControl.hasLatencyBudget())
+		timerWheel.schedule(timer, timerWheel.ticks(AdmissionControl::windowLength));
+	else
+		timerWheel.cancel(timer);
+}
+
+void MessageHandler::setIdleTimeout(const double seconds) {
+	idleTimeout = timerWheel.ticks(std::llround(seconds * 1e6));
+}
+
+long long MessageHandler::twiddleInterval() {
+	const auto interval = std::llround(configStore.read()->twiddleInterval * 1e6);
+	configStore.quiescent(configReader);
+	return interval;
+}
+
+long long MessageHandler::busyPoll() {
+	const auto spinTime = std::llround(configStore.read()->busyPoll);
+	configStore.quiescent(configReader);
+	return spinTime;
+}
+
+void MessageHandler::onTimer(const uint32_t timer) {
+	if (timer == sessions.size() * nSessionTimers + admissionTimer) {
+		admissionControl.rollWindow();
+		timerWheel.schedule(timer, timerWheel.ticks(AdmissionControl::windowLength));
+		return;
+	}
+	if (timer == sessions.size() * nSessionTimers + snapshotTimer) {
+		// Hand over a snapshot of all sessions to the background writer
+		if (sessionsChanged) {
+			sessions.save(snapshotRecords);
+			snapshotWriter->post(snapshotRecords);
+			sessionsChanged = false;
+		}
+		timerWheel.schedule(timer, timerWheel.ticks(snapshotInterval));
+		return;
+	}
+	auto & session = sessions.at(timer / nSessionTimers);
+	if (timer % nSessionTimers == twiddleTimer) {
+		if (session.twiddle())
+			timerWheel.schedule(timer, timerWheel.ticks(twiddleInterval()));
+		return;
+	}
+	// Messages don't move the timeout, they only record their tick: the timer is moved when it fires
+	const auto idle = timerWheel.now() - session.latestActivity;
+	if (idle < idleTimeout)
+		timerWheel.schedule(timer, idleTimeout - idle);
+	else {
+		Logger::log(LogEvent::idle, session.id, idle * timerTick / 1e6);
+		idleHandler(session);
+	}
+}
+
+Reply MessageHandler::handle(Session & session, const char * data, const std::size_t length, const bool isBinary,
+		const long long receivedTime) {
+	session.latestActivity = timerWheel.now();
+	// Pick up the latest configuration; `config` must not be used after quiescent()
+	const auto config = configStore.read();
+	session.applyConfig(*config);
+	Reply reply;
+	Telemetry telemetry;
+	double steeringAngle = std::numeric_limits<double>::quiet_NaN();  // Not reported by binary telemetry
+	FrameKind kind { FrameKind::other };
+	uint32_t sequence { 0 };
+	if (isBinary) {
+		// Binary protocol, see BinaryProtocol.h
+		BinaryTelemetry message;
+		BinaryBatch batch;
+		if (readBinaryBatch(data, length, BinaryType::telemetryBatch, sizeof(Telemetry), batch)) {
+			batchTelemetry.resize(batch.count);
+			memcpy(batchTelemetry.data(), data + sizeof(BinaryBatch), batch.count * sizeof(Telemetry));
+			bool finite = true;
+			for (const auto & vehicle : batchTelemetry)
+				finite = finite && std::isfinite(vehicle.cte) && std::isfinite(vehicle.speed);
+			if (session.binaryProtocol && finite) {
+				batchCommands.resize(batch.count);
+				session.controlBatch(batchTelemetry.data(), batch.count, *config, receivedTime, batchCommands.data());
+				// The reply is the batch header followed by the commands
+				batchReply.resize(sizeof(BinaryBatch) + batch.count * sizeof(SteerCommand));
+				batch.header = makeBinaryHeader(BinaryType::steerBatch);
+				memcpy(batchReply.data(), &batch, sizeof(BinaryBatch));
+				memcpy(batchReply.data() + sizeof(BinaryBatch), batchCommands.data(), batch.count * sizeof(SteerCommand));
+				reply.data = batchReply.data();
+				reply.length = batchReply.size();
+				reply.binary = reply.control = true;
+			}
+		} else if (readBinary(data, length, BinaryType::telemetry, message)) {
+			if (session.binaryProtocol && std::isfinite(message.cte) && std::isfinite(message.speed)) {
+				telemetry = Telemetry { message.cte, message.speed };
+				sequence = message.sequence;
+				kind = FrameKind::telemetry;
+			}
+		} else if (readBinary(data, length, BinaryType::hello, helloReply)) {
+			session.binaryProtocol = true;
+			helloReply.header = makeBinaryHeader(BinaryType::hello);
+			reply.data = reinterpret_cast<const char *>(&helloReply);
+			reply.length = sizeof(helloReply);
+			reply.binary = true;
+		}
+	} else if (verifyDir.empty())
+		kind = decodeFrame(data, length, session.extractor, session.arena, telemetry, steeringAngle);
+	else {
+		// Every frame is also decoded by the reference parser; frames decoded differently are saved for framecheck to replay
+		std::string mismatch;
+		kind = checkFrame(data, length, session.extractor, session.arena, telemetry, steeringAngle, mismatch);
+		if (!mismatch.empty()) {
+			saveMismatch(verifyDir, ++mismatches, data, length);
+			Logger::log(LogEvent::mismatch, session.id, mismatches);
+		}
+	}
+	if (kind == FrameKind::telemetry) {
+		if (fixedRate) {
+			// The controllers run when the scheduler says so, see tick()
+			session.observe(telemetry, steeringAngle, receivedTime);
+			session.latestSequence = sequence;
+		} else {
+			const auto command = session.control(telemetry, steeringAngle, *config, receivedTime, predictCte);
+			reply = writeCommand(command, isBinary, sequence);
+			reply.control = true;
+			if (logFrames)
+				Logger::log(LogEvent::frame, session.id, telemetry.cte, telemetry.speed, command.steering,
+						command.throttle);
+		}
+		sessionsChanged = true;
+	} else if (kind == FrameKind::manual) {
+		// Manual driving
+		reply.data = manualReply;
+		reply.length = sizeof(manualReply) - 1;
+	}
+	configStore.quiescent(configReader);
+	return reply;
+}
+
+Reply MessageHandler::tick(Session & session) {
+	if (session.latestTelemetryTime < 0)
+		return Reply();
+	const auto config = configStore.read();
+	session.applyConfig(*config);
+	const auto command = session.controlLatest(*config, LatencyEstimator::getCurrentTimestamp(), predictCte);
+	configStore.quiescent(configReader);
+	if (logFrames)
+		Logger::log(LogEvent::frame, session.id, session.latestTelemetry.cte, session.latestTelemetry.speed,
+				command.steering, command.throttle);
+	return writeCommand(command, session.binaryProtocol, session.latestSequence);
+}
+
+Reply MessageHandler::writeCommand(const SteerCommand & command, const bool binary, const uint32_t sequence) {
+	Reply reply;
+	if (binary) {
+		binaryReply = BinarySteer { makeBinaryHeader(BinaryType::steer), sequence, 0, command.steering,
+				command.throttle };
+		reply.data = reinterpret_cast<const char *>(&binaryReply);
+		reply.length = sizeof(binaryReply);
+		reply.binary = true;
+	} else {
+		reply.data = textReply;
+		reply.length = writeSteerMessage(textReply, command);
+	}
+	return reply;
+}
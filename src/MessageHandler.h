@@ -0,0 +1,198 @@
+#pragma once
+#include "AdmissionControl.h"
+#include "BinaryProtocol.h"
+#include "Config.h"
+#include "LatencyHistogram.h"
+#include "Messages.h"
+#include "Session.h"
+#include "Snapshot.h"
+#include "TimerWheel.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * Reply to a message, to be sent back on the same connection.
+ */
+struct Reply {
+	const char * data { nullptr };  // nullptr if there is no reply; valid until the next message is handled
+	std::size_t length { 0 };
+	bool binary { false };  // Whether the reply goes in a binary frame, rather than a text one
+	bool control { false };  // Whether the reply carries control values; if so, the session's latency estimator is to be told when it is sent
+};
+
+/**
+ * Handles the messages received from the simulator, and from clients of the binary protocol,
+ * independently of the network backend: decodes telemetry, runs the controllers of the
+ * session, and writes the reply. Also runs the timers of the sessions, on a TimerWheel: twiddle
+ * windows, idle timeouts, snapshots of all sessions, handed over to the background writer,
+ * and the latency window of admission control.
+ * Network backends poll the timer along with the connections. The handler is a reader of the
+ * ConfigStore, and must be used by one thread only.
+ */
+class MessageHandler {
+	SessionTable & sessions;
+	ConfigStore & configStore;
+	const std::size_t configReader;
+	SnapshotWriter * snapshotWriter;  // nullptr if snapshots are not requested
+	std::vector<SessionTable::Record> snapshotRecords;
+	bool sessionsChanged;  // Whether telemetry has been handled since the latest snapshot
+	const bool predictCte;  // Whether the cross-track error has to be extrapolated to compensate for latency
+	const bool logFrames;  // Whether every telemetry message is logged, with the resulting commands
+	const std::string verifyDir;  // Directory for frames decoded differently from the reference; empty if not verifying
+	unsigned mismatches;  // Number of frames decoded differently from the reference so far
+	bool fixedRate;  // Whether control values are sent by tick(), rather than in reply to telemetry
+	std::vector<Telemetry> batchTelemetry;  // Reused for every batch message
+	std::vector<SteerCommand> batchCommands;
+	std::vector<char> batchReply;
+	char textReply[maxSteerMessage];
+	BinarySteer binaryReply;
+	BinaryHello helloReply;
+	LatencyHistogram latency;
+	AdmissionControl admissionControl;
+	TimerWheel timerWheel;
+	uint64_t idleTimeout;  // In ticks of timerWheel; 0 if connections never time out
+	std::function<void(Session &)> idleHandler;
+
+	/**
+	 * Called by timerWheel when a timer fires.
+	 */
+	void onTimer(const uint32_t timer);
+
+	/**
+	 * @return the twiddle interval of the current configuration, in microseconds
+	 */
+	long long twiddleInterval();
+
+	/**
+	 * Writes a message carrying control values.
+	 * @param binary whether the message is of the binary protocol, rather than Socket.IO
+	 * @param sequence the sequence number of the telemetry message, for the binary protocol
+	 * @return the message, valid until the next message is written
+	 */
+	Reply writeCommand(const SteerCommand & command, const bool binary, const uint32_t sequence);
+
+public:
+	/**
+	 * Constructs the handler, and registers it as a reader of the configuration; to be called
+	 * by the thread that will use it.
+	 * @param sessionsInit the sessions, which are saved to snapshots
+	 * @param configStoreInit the configuration
+	 * @param snapshotWriterInit the snapshot writer, nullptr if snapshots are not requested
+	 * @param predictCteInit whether the cross-track error has to be extrapolated to compensate for latency
+	 * @param logFramesInit whether every telemetry message is logged
+	 * @param verifyDirInit directory where frames decoded differently from the reference are
+	 * saved; if empty, frames are not checked against the reference
+	 */
+	MessageHandler(SessionTable & sessionsInit, ConfigStore & configStoreInit, SnapshotWriter * snapshotWriterInit,
+			const bool predictCteInit, const bool logFramesInit, const std::string & verifyDirInit);
+
+	MessageHandler(const MessageHandler &) = delete;
+	MessageHandler & operator=(const MessageHandler &) = delete;
+
+	/**
+	 * Handles a message.
+	 * @param session the session of the connection the message comes from
+	 * @param data the message payload
+	 * @param length the payload length
+	 * @param isBinary whether the message came in a binary frame, rather than a text one
+	 * @param receivedTime when the message was received, in microseconds from a monotonic
+	 * clock, as the network backend knows it; the controllers take it as the time of the telemetry
+	 * @return the reply, if any
+	 */
+	Reply handle(Session & session, const char * data, const std::size_t length, const bool isBinary,
+			const long long receivedTime);
+
+	/**
+	 * Starts the timers of a session, when a connection takes it: twiddle windows, if tuning
+	 * is in progress, and the idle timeout.
+	 */
+	void onOpen(Session & session);
+
+	/**
+	 * Stops the timers of a session, when its connection is closed.
+	 */
+	void onClose(Session & session);
+
+	/**
+	 * Sets the limits of admission control, and starts the timer that moves its latency
+	 * window on, if needed; see AdmissionControl::setLimits().
+	 */
+	void setAdmissionLimits(const long long latencyBudget, const std::size_t maxBacklog);
+
+	/**
+	 * Sets the time after which a connection with no messages is closed.
+	 * @param seconds the timeout; 0 means connections never time out
+	 */
+	void setIdleTimeout(const double seconds);
+
+	/**
+	 * Sets how connections are closed on idle timeout; to be set by the network backend.
+	 * @param handler closes the connection of a session, calling onClose()
+	 */
+	void setIdleHandler(const std::function<void(Session &)> & handler) {
+		idleHandler = handler;
+	}
+
+	/**
+	 * @return the timers, whose descriptor is to be polled by the network backend, see
+	 * TimerWheel::onTimer()
+	 */
+	TimerWheel & timers() {
+		return timerWheel;
+	}
+
+	const TimerWheel & timers() const {
+		return timerWheel;
+	}
+
+	/**
+	 * @return the time the event loop polls for events without sleeping after every event,
+	 * from the current configuration, in microseconds; 0 if it sleeps right away
+	 */
+	long long busyPoll();
+
+	/**
+	 * Makes telemetry be taken in only, rather than replied to with control values; the
+	 * network backend then sends the control values returned by tick() at a fixed rate.
+	 * Batch messages are still replied to.
+	 */
+	void setFixedRate(const bool enable) {
+		fixedRate = enable;
+	}
+
+	/**
+	 * Runs the controllers of a session from its latest telemetry, as scheduled by a
+	 * ControlScheduler.
+	 * @param session the session
+	 * @return the message carrying the control values, to be sent on the connection of the
+	 * session; none if no telemetry has been received yet
+	 */
+	Reply tick(Session & session);
+
+	/**
+	 * @return the time from the reception of messages to the sending of their replies, in
+	 * nanoseconds, as recorded by the network backend: from the time the kernel received them
+	 * if the backend knows it, or else from the time the event loop handed them over
+	 */
+	LatencyHistogram & replyLatency() {
+		return latency;
+	}
+
+	const LatencyHistogram & replyLatency() const {
+		return latency;
+	}
+
+	/**
+	 * @return the admission of connections and messages, which network backends go through
+	 */
+	AdmissionControl & admission() {
+		return admissionControl;
+	}
+
+	const AdmissionControl & admission() const {
+		return admissionControl;
+	}
+};
@@ -0,0 +1,15 @@
+#include "Messages.h"
+#include <cstring>
+
+std::size_t writeSteerMessage(char * buffer, const SteerCommand & command) {
+	static const char prefix[] = "42[\"steer\",{\"steering_angle\":";
+	static const char separator[] = ",\"throttle\":";
+	char * p = buffer;
+	memcpy(p, prefix, sizeof(prefix) - 1);
+	p = formatDouble(p + sizeof(prefix) - 1, command.steering);
+	memcpy(p, separator, sizeof(separator) - 1);
+	p = formatDouble(p + sizeof(separator) - 1, command.throttle);
+	*p++ = '}';
+	*p++ = ']';
+	return p - buffer;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include "Numbers.h"
+#include <cstddef>
+
+/**
+ * Measures received from the simulator for one vehicle.
+ */
+struct Telemetry {
+	double cte;  // Cross-track error
+	double speed;  // Speed in mph
+};
+
+/**
+ * Steering angle, in degrees, that the simulator applies and reports for a steering value of 1.
+ */
+const double maxSteeringDegrees = 25.;
+
+/**
+ * Control values sent back to the simulator for one vehicle.
+ */
+struct SteerCommand {
+	double steering;  // Steering angle, in [-1, 1]
+	double throttle;
+};
+
+/**
+ * Maximum length of a steering command message.
+ */
+const std::size_t maxSteerMessage = 48 + 2 * maxFormattedDouble;
+
+/**
+ * Writes the Socket.IO event carrying a steering command, as the JSON serialiser would, but
+ * with the numbers formatted by formatDouble().
+ * @param buffer room for maxSteerMessage characters
+ * @return the message length
+ */
+std::size_t writeSteerMessage(char * buffer, const SteerCommand & command);
@@ -0,0 +1,172 @@
+#include "Numa.h"
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+namespace {
+
+// From <numaif.h>, which comes with libnuma
+const int mpolBind = 2;  // MPOL_BIND
+const unsigned mpolMfMove = 1 << 1;  // MPOL_MF_MOVE
+
+/**
+ * Parses a CPU list, such as "0-3,8-11", keeping the CPUs in the given set.
+ */
+std::vector<int> parseCpuList(const std::string & list, const cpu_set_t & allowed) {
+	std::vector<int> cpus;
+	std::istringstream ranges(list);
+	std::string range;
+	while (std::getline(ranges, range, ',')) {
+		if (range.empty() || range[0] == '\n')
+			continue;
+		const auto dash = range.find('-');
+		const int first = std::atoi(range.c_str());
+		const int last = dash == std::string::npos ? first : std::atoi(range.c_str() + dash + 1);
+		for (int cpu = first; cpu <= last; ++cpu)
+			if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))
+				cpus.push_back(cpu);
+	}
+	return cpus;
+}
+
+/**
+ * Opens a counter of the node cache event of the calling thread, in user space.
+ * @param result PERF_COUNT_HW_CACHE_RESULT_ACCESS for all node loads, PERF_COUNT_HW_CACHE_RESULT_MISS for remote ones
+ * @return the descriptor, -1 if the event is not available
+ */
+int openNodeLoads(const unsigned result) {
+	perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HW_CACHE;
+	attr.config = PERF_COUNT_HW_CACHE_NODE | PERF_COUNT_HW_CACHE_OP_READ << 8 | result << 16;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+}
+
+NumaTopology NumaTopology::read() {
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	sched_getaffinity(0, sizeof(allowed), &allowed);
+	NumaTopology topology;
+	const auto dir = opendir("/sys/devices/system/node");
+	if (dir != nullptr) {
+		while (const auto entry = readdir(dir)) {
+			int node;
+			if (sscanf(entry->d_name, "node%d", &node) != 1 || node < 0)
+				continue;
+			std::ifstream file(std::string("/sys/devices/system/node/") + entry->d_name + "/cpulist");
+			std::string list;
+			std::getline(file, list);
+			if (static_cast<std::size_t>(node) >= topology.nodeCpus.size())
+				topology.nodeCpus.resize(node + 1);
+			topology.nodeCpus[node] = parseCpuList(list, allowed);
+		}
+		closedir(dir);
+	}
+	if (topology.nodeCpus.empty()) {
+		topology.nodeCpus.resize(1);
+		for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+			if (CPU_ISSET(cpu, &allowed))
+				topology.nodeCpus[0].push_back(cpu);
+	}
+	return topology;
+}
+
+int NumaTopology::nodeOf(const int cpu) const {
+	for (std::size_t node = 0; node < nodeCpus.size(); ++node)
+		for (const auto nodeCpu : nodeCpus[node])
+			if (nodeCpu == cpu)
+				return node;
+	return 0;
+}
+
+int NumaTopology::currentNode() {
+	unsigned cpu = 0;
+	unsigned node = 0;
+	if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0)
+		return 0;
+	return node;
+}
+
+std::vector<int> NumaTopology::cpus() const {
+	std::vector<int> all;
+	for (const auto & node : nodeCpus)
+		all.insert(all.end(), node.begin(), node.end());
+	return all;
+}
+
+NodeMemory::NodeMemory(const std::size_t lengthInit, const int nodeInit) :
+		data { nullptr }, length { 0 }, node { -1 } {
+	const std::size_t pageSize = sysconf(_SC_PAGESIZE);
+	length = (lengthInit + pageSize - 1) / pageSize * pageSize;
+	data = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (data == MAP_FAILED) {
+		data = nullptr;
+		return;
+	}
+	if (nodeInit < 0 || nodeInit >= static_cast<int>(8 * sizeof(unsigned long)))
+		return;
+	const unsigned long mask = 1UL << nodeInit;
+	if (syscall(SYS_mbind, data, length, mpolBind, &mask, 8 * sizeof(mask), mpolMfMove) == 0)
+		node = nodeInit;
+}
+
+NodeMemory::~NodeMemory() {
+	if (data != nullptr)
+		munmap(data, length);
+}
+
+std::size_t NodeMemory::locate(std::vector<std::size_t> & pagesPerNode) const {
+	const std::size_t pageSize = sysconf(_SC_PAGESIZE);
+	const auto nPages = data != nullptr ? length / pageSize : 0;
+	std::vector<void *> pages(nPages);
+	std::vector<int> status(nPages, -1);
+	for (std::size_t i = 0; i < nPages; ++i)
+		pages[i] = static_cast<char *>(data) + i * pageSize;
+	// With no target nodes, move_pages() only reports the node of every page, or an error for pages not yet touched
+	if (nPages > 0 && syscall(SYS_move_pages, 0, nPages, pages.data(), nullptr, status.data(), 0) != 0)
+		status.assign(nPages, -1);
+	for (const auto pageNode : status)
+		if (pageNode >= 0) {
+			if (static_cast<std::size_t>(pageNode) >= pagesPerNode.size())
+				pagesPerNode.resize(pageNode + 1, 0);
+			++pagesPerNode[pageNode];
+		}
+	return nPages;
+}
+
+NodeAccessCounter::NodeAccessCounter() :
+		loadsFd { openNodeLoads(PERF_COUNT_HW_CACHE_RESULT_ACCESS) }, missesFd { -1 } {
+	if (loadsFd < 0)
+		return;
+	missesFd = openNodeLoads(PERF_COUNT_HW_CACHE_RESULT_MISS);
+	if (missesFd < 0) {
+		close(loadsFd);
+		loadsFd = -1;
+	}
+}
+
+NodeAccessCounter::~NodeAccessCounter() {
+	if (loadsFd >= 0) {
+		close(loadsFd);
+		close(missesFd);
+	}
+}
+
+bool NodeAccessCounter::read(uint64_t & loads, uint64_t & misses) const {
+	return loadsFd >= 0 && ::read(loadsFd, &loads, sizeof(loads)) == sizeof(loads)
+			&& ::read(missesFd, &misses, sizeof(misses)) == sizeof(misses);
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * NUMA topology of the host, as Linux reports it in /sys/devices/system/node, restricted to the
+ * CPUs the process may run on. Hosts that report no node are taken as a single node.
+ */
+struct NumaTopology {
+	std::vector<std::vector<int>> nodeCpus;  // CPUs of every node, indexed by node, in increasing order
+
+	/**
+	 * Reads the topology of the host.
+	 */
+	static NumaTopology read();
+
+	/**
+	 * @return the node of a CPU, 0 if unknown
+	 */
+	int nodeOf(const int cpu) const;
+
+	/**
+	 * @return all the CPUs, node after node
+	 */
+	std::vector<int> cpus() const;
+
+	/**
+	 * @return the node the calling thread is running on, 0 if unknown; for a thread not
+	 * pinned to the CPUs of one node, it may change at any time
+	 */
+	static int currentNode();
+};
+
+/**
+ * Pages of memory bound to a NUMA node with mbind(), so that they are allocated there
+ * whichever thread touches them first, and never migrated by automatic balancing. Made
+ * with the system calls directly, rather than libnuma. If the host or the sandbox does not
+ * allow it, the memory is allocated with the default policy instead.
+ */
+class NodeMemory {
+	void * data;
+	std::size_t length;
+	int node;  // -1 if not bound
+
+public:
+	/**
+	 * Maps zeroed memory, bound to the given node.
+	 * @param lengthInit the length, rounded up to whole pages
+	 * @param nodeInit the node; -1 for the default policy, that is the node of the thread
+	 * that touches a page first
+	 */
+	NodeMemory(const std::size_t lengthInit, const int nodeInit);
+
+	~NodeMemory();
+
+	NodeMemory(const NodeMemory &) = delete;
+	NodeMemory & operator=(const NodeMemory &) = delete;
+
+	/**
+	 * @return the memory, nullptr if it couldn't be mapped
+	 */
+	void * get() const {
+		return data;
+	}
+
+	/**
+	 * @return the node the memory is bound to, -1 if not bound
+	 */
+	int getNode() const {
+		return node;
+	}
+
+	/**
+	 * Tells where the pages are, as the kernel reports it with move_pages().
+	 * @param pagesPerNode filled with the number of pages on every node, indexed by node
+	 * @return the number of pages
+	 */
+	std::size_t locate(std::vector<std::size_t> & pagesPerNode) const;
+};
+
+/**
+ * Counts the loads of the calling thread from memory of its own node and of other nodes, with
+ * the node-loads and node-load-misses hardware events, as perf stat does, made with
+ * perf_event_open() directly. User space only, so that it needs no privilege beyond the
+ * default perf_event_paranoid. Hosts without the events, such as most virtual machines,
+ * leave the counters unavailable.
+ */
+class NodeAccessCounter {
+	int loadsFd;  // -1 if unavailable
+	int missesFd;
+
+public:
+	/**
+	 * Starts counting for the calling thread.
+	 */
+	NodeAccessCounter();
+
+	~NodeAccessCounter();
+
+	NodeAccessCounter(const NodeAccessCounter &) = delete;
+	NodeAccessCounter & operator=(const NodeAccessCounter &) = delete;
+
+	/**
+	 * Reads the counters.
+	 * @param loads set to the number of loads served by a node, local or remote
+	 * @param misses set to the number of those served by a remote node
+	 * @return true if the counters are available
+	 */
+	bool read(uint64_t & loads, uint64_t & misses) const;
+};
@@ -0,0 +1,421 @@
+#include "Numbers.h"
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <locale.h>
+#ifdef __APPLE__
+#include <xlocale.h>
+#endif
+
+namespace {
+
+const double exactPowersOfTen[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14,
+		1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+bool isDigit(const char c) {
+	return c >= '0' && c <= '9';
+}
+
+/**
+ * The "C" locale, for strtod_l() to read a '.' as the decimal point whatever the locale of
+ * the process; created once.
+ */
+const locale_t cLocale = newlocale(LC_ALL_MASK, "C", static_cast<locale_t>(0));
+
+/**
+ * Unsigned 64-bit significand and binary exponent of a floating-point value (Grisu's "do-it-yourself
+ * floating point").
+ */
+struct DiyFp {
+	uint64_t f;
+	int e;
+};
+
+DiyFp subtract(const DiyFp & x, const DiyFp & y) {
+	return DiyFp { x.f - y.f, x.e };
+}
+
+/**
+ * @return the upper 64 bits of the product, rounded
+ */
+DiyFp multiply(const DiyFp & x, const DiyFp & y) {
+	const unsigned __int128 p = static_cast<unsigned __int128>(x.f) * y.f;
+	const uint64_t high = static_cast<uint64_t>(p >> 64);
+	const uint64_t low = static_cast<uint64_t>(p);
+	return DiyFp { high + (low >> 63), x.e + y.e + 64 };
+}
+
+DiyFp normalize(const DiyFp & x) {
+	const int shift = __builtin_clzll(x.f);
+	return DiyFp { x.f << shift, x.e - shift };
+}
+
+/**
+ * The value v to format, and the boundaries of the interval of reals rounding to v.
+ */
+struct Boundaries {
+	DiyFp w;
+	DiyFp minus;
+	DiyFp plus;
+};
+
+/**
+ * @param value a finite, positive double
+ */
+Boundaries computeBoundaries(const double value) {
+	const int bias = 1075;  // 1023 + 52
+	const uint64_t hiddenBit = uint64_t(1) << 52;
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	const uint64_t biasedExponent = bits >> 52;
+	const uint64_t fraction = bits & (hiddenBit - 1);
+
+	const DiyFp v = biasedExponent == 0 ? DiyFp { fraction, 1 - bias } :
+			DiyFp { fraction + hiddenBit, static_cast<int>(biasedExponent) - bias };
+	// Boundaries are half-way to the neighbours; the lower neighbour is closer at powers of two
+	const bool lowerBoundaryIsCloser = fraction == 0 && biasedExponent > 1;
+	const DiyFp plus = normalize(DiyFp { 2 * v.f + 1, v.e - 1 });
+	const DiyFp minus = lowerBoundaryIsCloser ? DiyFp { 4 * v.f - 1, v.e - 2 } : DiyFp { 2 * v.f - 1, v.e - 1 };
+	return Boundaries { normalize(v), DiyFp { minus.f << (minus.e - plus.e), plus.e }, plus };
+}
+
+/**
+ * Normalized 64-bit approximation of 10^k, every 8 powers.
+ */
+struct CachedPower {
+	uint64_t f;
+	int e;
+	int k;
+};
+
+const int cachedPowersMinDecimalExponent = -300;
+const int cachedPowersDecimalStep = 8;
+
+const CachedPower cachedPowers[] = {
+		{ 0xAB70FE17C79AC6CA, -1060, -300 },
+		{ 0xFF77B1FCBEBCDC4F, -1034, -292 },
+		{ 0xBE5691EF416BD60C, -1007, -284 },
+		{ 0x8DD01FAD907FFC3C, -980, -276 },
+		{ 0xD3515C2831559A83, -954, -268 },
+		{ 0x9D71AC8FADA6C9B5, -927, -260 },
+		{ 0xEA9C227723EE8BCB, -901, -252 },
+		{ 0xAECC49914078536D, -874, -244 },
+		{ 0x823C12795DB6CE57, -847, -236 },
+		{ 0xC21094364DFB5637, -821, -228 },
+		{ 0x9096EA6F3848984F, -794, -220 },
+		{ 0xD77485CB25823AC7, -768, -212 },
+		{ 0xA086CFCD97BF97F4, -741, -204 },
+		{ 0xEF340A98172AACE5, -715, -196 },
+		{ 0xB23867FB2A35B28E, -688, -188 },
+		{ 0x84C8D4DFD2C63F3B, -661, -180 },
+		{ 0xC5DD44271AD3CDBA, -635, -172 },
+		{ 0x936B9FCEBB25C996, -608, -164 },
+		{ 0xDBAC6C247D62A584, -582, -156 },
+		{ 0xA3AB66580D5FDAF6, -555, -148 },
+		{ 0xF3E2F893DEC3F126, -529, -140 },
+		{ 0xB5B5ADA8AAFF80B8, -502, -132 },
+		{ 0x87625F056C7C4A8B, -475, -124 },
+		{ 0xC9BCFF6034C13053, -449, -116 },
+		{ 0x964E858C91BA2655, -422, -108 },
+		{ 0xDFF9772470297EBD, -396, -100 },
+		{ 0xA6DFBD9FB8E5B88F, -369, -92 },
+		{ 0xF8A95FCF88747D94, -343, -84 },
+		{ 0xB94470938FA89BCF, -316, -76 },
+		{ 0x8A08F0F8BF0F156B, -289, -68 },
+		{ 0xCDB02555653131B6, -263, -60 },
+		{ 0x993FE2C6D07B7FAC, -236, -52 },
+		{ 0xE45C10C42A2B3B06, -210, -44 },
+		{ 0xAA242499697392D3, -183, -36 },
+		{ 0xFD87B5F28300CA0E, -157, -28 },
+		{ 0xBCE5086492111AEB, -130, -20 },
+		{ 0x8CBCCC096F5088CC, -103, -12 },
+		{ 0xD1B71758E219652C, -77, -4 },
+		{ 0x9C40000000000000, -50, 4 },
+		{ 0xE8D4A51000000000, -24, 12 },
+		{ 0xAD78EBC5AC620000, 3, 20 },
+		{ 0x813F3978F8940984, 30, 28 },
+		{ 0xC097CE7BC90715B3, 56, 36 },
+		{ 0x8F7E32CE7BEA5C70, 83, 44 },
+		{ 0xD5D238A4ABE98068, 109, 52 },
+		{ 0x9F4F2726179A2245, 136, 60 },
+		{ 0xED63A231D4C4FB27, 162, 68 },
+		{ 0xB0DE65388CC8ADA8, 189, 76 },
+		{ 0x83C7088E1AAB65DB, 216, 84 },
+		{ 0xC45D1DF942711D9A, 242, 92 },
+		{ 0x924D692CA61BE758, 269, 100 },
+		{ 0xDA01EE641A708DEA, 295, 108 },
+		{ 0xA26DA3999AEF774A, 322, 116 },
+		{ 0xF209787BB47D6B85, 348, 124 },
+		{ 0xB454E4A179DD1877, 375, 132 },
+		{ 0x865B86925B9BC5C2, 402, 140 },
+		{ 0xC83553C5C8965D3D, 428, 148 },
+		{ 0x952AB45CFA97A0B3, 455, 156 },
+		{ 0xDE469FBD99A05FE3, 481, 164 },
+		{ 0xA59BC234DB398C25, 508, 172 },
+		{ 0xF6C69A72A3989F5C, 534, 180 },
+		{ 0xB7DCBF5354E9BECE, 561, 188 },
+		{ 0x88FCF317F22241E2, 588, 196 },
+		{ 0xCC20CE9BD35C78A5, 614, 204 },
+		{ 0x98165AF37B2153DF, 641, 212 },
+		{ 0xE2A0B5DC971F303A, 667, 220 },
+		{ 0xA8D9D1535CE3B396, 694, 228 },
+		{ 0xFB9B7CD9A4A7443C, 720, 236 },
+		{ 0xBB764C4CA7A44410, 747, 244 },
+		{ 0x8BAB8EEFB6409C1A, 774, 252 },
+		{ 0xD01FEF10A657842C, 800, 260 },
+		{ 0x9B10A4E5E9913129, 827, 268 },
+		{ 0xE7109BFBA19C0C9D, 853, 276 },
+		{ 0xAC2820D9623BF429, 880, 284 },
+		{ 0x80444B5E7AA7CF85, 907, 292 },
+		{ 0xBF21E44003ACDD2D, 933, 300 },
+		{ 0x8E679C2F5E44FF8F, 960, 308 },
+		{ 0xD433179D9C8CB841, 986, 316 },
+		{ 0x9E19DB92B4E31BA9, 1013, 324 },
+};
+
+// The binary exponent of the scaled values is kept within [-60, -32], so that their integral part fits in 32 bits
+const int minScaledExponent = -60;
+
+/**
+ * Picks the cached power c = 10^k such that, for a value with binary exponent e, the
+ * binary exponent of the product lies within [-60, -32].
+ */
+const CachedPower & cachedPowerForBinaryExponent(const int e) {
+	// k = ceil((-61 - e) * log10(2)), with 78913 / 2^18 approximating log10(2)
+	const int f = minScaledExponent - e - 1;
+	const int k = (f * 78913) / (1 << 18) + (f > 0 ? 1 : 0);
+	const int index = (-cachedPowersMinDecimalExponent + k + (cachedPowersDecimalStep - 1)) / cachedPowersDecimalStep;
+	return cachedPowers[index];
+}
+
+/**
+ * @return the number of decimal digits of n, with pow10 set to 10^(digits - 1)
+ */
+int largestPowerOfTen(const uint32_t n, uint32_t & pow10) {
+	uint32_t p = 1000000000;
+	for (int digits = 10; digits > 1; --digits, p /= 10)
+		if (n >= p) {
+			pow10 = p;
+			return digits;
+		}
+	pow10 = 1;
+	return 1;
+}
+
+/**
+ * Moves the last digit down while the number gets closer to w and stays within the boundaries.
+ */
+void roundLastDigit(char * buffer, const int length, const uint64_t distance, const uint64_t delta, uint64_t rest,
+		const uint64_t tenK) {
+	while (rest < distance && delta - rest >= tenK && (rest + tenK < distance || distance - rest > rest + tenK - distance)) {
+		--buffer[length - 1];
+		rest += tenK;
+	}
+}
+
+/**
+ * Generates the digits of a number between mMinus and mPlus, as close to w as possible.
+ * @param decimalExponent set so that the value is digits * 10^decimalExponent
+ * @return the number of digits
+ */
+int generateDigits(char * buffer, int & decimalExponent, const DiyFp & mMinus, const DiyFp & w, const DiyFp & mPlus) {
+	uint64_t delta = subtract(mPlus, mMinus).f;
+	uint64_t distance = subtract(mPlus, w).f;
+
+	// Split mPlus into its integral part, below 2^32, and its fractional part
+	const DiyFp one { uint64_t(1) << -mPlus.e, mPlus.e };
+	uint32_t p1 = static_cast<uint32_t>(mPlus.f >> -one.e);
+	uint64_t p2 = mPlus.f & (one.f - 1);
+
+	int length = 0;
+	uint32_t pow10;
+	for (int n = largestPowerOfTen(p1, pow10); n > 0; pow10 /= 10) {
+		buffer[length++] = static_cast<char>('0' + p1 / pow10);
+		p1 %= pow10;
+		--n;
+		const uint64_t rest = (uint64_t(p1) << -one.e) + p2;
+		if (rest <= delta) {
+			decimalExponent += n;
+			roundLastDigit(buffer, length, distance, delta, rest, uint64_t(pow10) << -one.e);
+			return length;
+		}
+	}
+
+	int m = 0;
+	do {
+		p2 *= 10;
+		buffer[length++] = static_cast<char>('0' + (p2 >> -one.e));
+		p2 &= one.f - 1;
+		++m;
+		delta *= 10;
+		distance *= 10;
+	} while (p2 > delta);
+	decimalExponent -= m;
+	roundLastDigit(buffer, length, distance, delta, p2, one.f);
+	return length;
+}
+
+/**
+ * @param value a finite, positive double
+ * @return the number of digits
+ */
+int grisu2(char * buffer, int & decimalExponent, const double value) {
+	const Boundaries boundaries = computeBoundaries(value);
+	const CachedPower & cached = cachedPowerForBinaryExponent(boundaries.plus.e);
+	const DiyFp c { cached.f, cached.e };
+	const DiyFp w = multiply(boundaries.w, c);
+	const DiyFp wMinus = multiply(boundaries.minus, c);
+	const DiyFp wPlus = multiply(boundaries.plus, c);
+	// The products are off by up to one unit; narrow the interval to stay within the boundaries
+	decimalExponent = -cached.k;
+	return generateDigits(buffer, decimalExponent, DiyFp { wMinus.f + 1, wMinus.e }, w, DiyFp { wPlus.f - 1, wPlus.e });
+}
+
+char * writeExponent(char * p, int e) {
+	*p++ = 'e';
+	if (e < 0) {
+		e = -e;
+		*p++ = '-';
+	} else
+		*p++ = '+';
+	if (e >= 100) {
+		*p++ = static_cast<char>('0' + e / 100);
+		e %= 100;
+	}
+	*p++ = static_cast<char>('0' + e / 10);
+	*p++ = static_cast<char>('0' + e % 10);
+	return p;
+}
+
+/**
+ * Lays out digits * 10^decimalExponent, held at the start of the buffer.
+ */
+char * layOut(char * buffer, const int length, const int decimalExponent) {
+	const int minExponent = -4;
+	const int maxExponent = std::numeric_limits<double>::digits10;
+	// The value is 0.digits * 10^n
+	const int n = length + decimalExponent;
+
+	if (length <= n && n <= maxExponent) {
+		// digits000.0
+		memset(buffer + length, '0', n - length);
+		buffer[n] = '.';
+		buffer[n + 1] = '0';
+		return buffer + n + 2;
+	}
+	if (0 < n && n <= maxExponent) {
+		// dig.its
+		memmove(buffer + n + 1, buffer + n, length - n);
+		buffer[n] = '.';
+		return buffer + length + 1;
+	}
+	if (minExponent < n && n <= 0) {
+		// 0.000digits
+		memmove(buffer + 2 - n, buffer, length);
+		buffer[0] = '0';
+		buffer[1] = '.';
+		memset(buffer + 2, '0', -n);
+		return buffer + 2 - n + length;
+	}
+	// d.igitse+nn
+	if (length > 1) {
+		memmove(buffer + 2, buffer + 1, length - 1);
+		buffer[1] = '.';
+		return writeExponent(buffer + length + 1, n - 1);
+	}
+	return writeExponent(buffer + 1, n - 1);
+}
+
+}
+
+bool parseDouble(const char * begin, const char * end, double & value) {
+	const char * p = begin;
+	const bool negative = p < end && *p == '-';
+	if (negative)
+		++p;
+
+	// Integral part: 0, or digits not starting with 0
+	uint64_t significand { 0 };
+	int significantDigits { 0 };
+	int exponent { 0 };
+	if (p == end || !isDigit(*p))
+		return false;
+	if (*p == '0')
+		++p;
+	else
+		for (; p < end && isDigit(*p); ++p)
+			if (significantDigits < 19) {
+				significand = significand * 10 + (*p - '0');
+				++significantDigits;
+			} else
+				++exponent;
+
+	// Fraction
+	if (p < end && *p == '.') {
+		++p;
+		if (p == end || !isDigit(*p))
+			return false;
+		for (; p < end && isDigit(*p); ++p)
+			if (significantDigits < 19) {
+				significand = significand * 10 + (*p - '0');
+				if (significand != 0)
+					++significantDigits;
+				--exponent;
+			}
+	}
+
+	// Exponent
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		++p;
+		const bool negativeExponent = p < end && *p == '-';
+		if (p < end && (*p == '-' || *p == '+'))
+			++p;
+		if (p == end || !isDigit(*p))
+			return false;
+		int explicitExponent { 0 };
+		for (; p < end && isDigit(*p); ++p)
+			if (explicitExponent < 100000)
+				explicitExponent = explicitExponent * 10 + (*p - '0');
+		exponent += negativeExponent ? -explicitExponent : explicitExponent;
+	}
+	if (p != end)
+		return false;
+
+	// Clinger's fast path: both the significand and the power of ten are exact doubles, and
+	// the single operation between them is correctly rounded
+	const uint64_t maxExactInteger = uint64_t(1) << 53;
+	if (significantDigits < 19 && significand <= maxExactInteger && exponent >= -22 && exponent <= 22) {
+		double result = static_cast<double>(significand);
+		if (exponent < 0)
+			result /= exactPowersOfTen[-exponent];
+		else
+			result *= exactPowersOfTen[exponent];
+		value = negative ? -result : result;
+		return true;
+	}
+
+	char * parsed;
+	value = strtod_l(begin, &parsed, cLocale);
+	return parsed == end && std::isfinite(value);
+}
+
+char * formatDouble(char * buffer, double value) {
+	if (value != value || value == std::numeric_limits<double>::infinity()
+			|| value == -std::numeric_limits<double>::infinity()) {
+		memcpy(buffer, "null", 4);
+		return buffer + 4;
+	}
+	if (std::signbit(value)) {
+		*buffer++ = '-';
+		value = -value;
+	}
+	if (value == 0) {
+		memcpy(buffer, "0.0", 3);
+		return buffer + 3;
+	}
+	int decimalExponent;
+	const int length = grisu2(buffer, decimalExponent, value);
+	return layOut(buffer, length, decimalExponent);
+}
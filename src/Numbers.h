@@ -0,0 +1,37 @@
+#pragma once
+#include <cstddef>
+
+/**
+ * Conversions between doubles and their text in JSON messages, independent of the locale and
+ * without allocations; shared by the readers of the telemetry and the writer of the steering
+ * commands.
+ */
+
+/**
+ * Maximum number of characters written by formatDouble().
+ */
+const std::size_t maxFormattedDouble = 25;
+
+/**
+ * Parses a number in JSON syntax spanning exactly [begin, end). Numbers whose significant
+ * digits fit in 53 bits, with a decimal exponent within [-22, 22], such as all the values sent
+ * by the simulator, are converted exactly with a single multiplication or division by a power
+ * of ten (Clinger's fast path); others go through strtod_l() in the "C" locale, which
+ * requires the span to be followed by a character that can't be part of a number.
+ * @param value set to the number, if successful
+ * @return true if successful; false if the text isn't a number, or its magnitude is too large
+ * for a double
+ */
+bool parseDouble(const char * begin, const char * end, double & value);
+
+/**
+ * Writes a text that parses back to the same double, with the Grisu2 algorithm: digits are
+ * generated from a 64-bit approximation of the value scaled by a cached power of ten, and stop
+ * as soon as they fall within the rounding boundaries of the value. The text is the shortest
+ * possible for all but about 0.1% of doubles, which get one digit more. The text is
+ * laid out as nlohmann::json does, with an exponent for very large or small magnitudes and
+ * ".0" after whole numbers. NaN and infinities are written as null.
+ * @param buffer room for at least maxFormattedDouble characters; no terminating null is written
+ * @return past the last character written
+ */
+char * formatDouble(char * buffer, double value);
@@ -1,15 +1,21 @@
 #include "PID.h"
+#include "Logger.h"
 #include <chrono>
-#include <iostream>
 #include <vector>
 #include <numeric>
 #include <cassert>
 #include <limits>
+#include <cmath>
+#include <cstring>
 
 using namespace std;
 
 PID::PID(const double KpInit, const double KiInit, const double KdInit) :
-		Kp { KpInit }, Ki {KiInit }, Kd { KdInit }, errorPrev { 0. }, errorInt { .0 }, prevTimestamp { -1 } {
+		errorPrev { 0. }, errorPrev2 { 0. }, errorInt { .0 }, derivPrev { 0. }, correctionPrev { 0. }, prevTimestamp { -1 },
+		Kp { KpInit }, Ki {KiInit }, Kd { KdInit }, form { Form::positional }, nominalDeltaT { 0. },
+		jitterTolerance { 0. }, derivFilter { 0. }, nominal(), twiddleStep { TwiddleStep::initialising }, twiddleParams { {
+				.0, .0, .0 } }, twiddleDeltaParams { { .0, .0, .0 } }, twiddleBestError { 0. }, twiddleIndex { 0 },
+		bestReportedError { std::numeric_limits<double>::max() } {
 }
 
 long long PID::getCurrentTimestamp() {
@@ -19,123 +25,192 @@ long long PID::getCurrentTimestamp() {
 	return millisecondsSinceEpoch;
 }
 
-double PID::computeCorrection(const double error) {
+PID::Coefficients PID::makeCoefficients(const double deltaT) const {
+	Coefficients coeffs;
+	const double KdOverDeltaT = Kd / deltaT;
+	coeffs.deltaT = deltaT;
+	coeffs.KdOverDeltaT = KdOverDeltaT;
+	// Velocity form is the difference between two consecutive outputs of the positional form
+	coeffs.q0 = -(Kp + Ki * deltaT + KdOverDeltaT);
+	coeffs.q1 = Kp + 2 * KdOverDeltaT;
+	coeffs.q2 = -KdOverDeltaT;
+	// Tustin form, with the derivative low-pass filtered to keep it from ringing at the Nyquist frequency
+	const double filter = derivFilter > 0 ? derivFilter : deltaT;
+	coeffs.halfDeltaT = deltaT / 2;
+	coeffs.derivDecay = (2 * filter - deltaT) / (2 * filter + deltaT);
+	coeffs.derivGain = 2 * Kd / (2 * filter + deltaT);
+	return coeffs;
+}
 
-	auto currentTimestamp = getCurrentTimestamp();
+void PID::updateCoefficients() {
+	if (nominalDeltaT > 0)
+		nominal = makeCoefficients(nominalDeltaT);
+}
+
+double PID::step(const double error, const Coefficients & coeffs) {
+	double correction;
+	switch (form) {
+	case Form::velocity:
+		correction = correctionPrev + coeffs.q0 * error + coeffs.q1 * errorPrev + coeffs.q2 * errorPrev2;
+		errorInt += error * coeffs.deltaT;
+		derivPrev = coeffs.KdOverDeltaT * (error - errorPrev);
+		break;
+	case Form::tustin:
+		errorInt += coeffs.halfDeltaT * (error + errorPrev);
+		derivPrev = coeffs.derivDecay * derivPrev + coeffs.derivGain * (error - errorPrev);
+		correction = -Kp * error - derivPrev - Ki * errorInt;
+		break;
+	default:
+		errorInt += error * coeffs.deltaT;
+		derivPrev = coeffs.KdOverDeltaT * (error - errorPrev);
+		correction = -Kp * error - derivPrev - Ki * errorInt;
+	}
+	errorPrev2 = errorPrev;
+	errorPrev = error;
+	correctionPrev = correction;
+	return correction;
+}
+
+double PID::computeCorrection(const double error, const long long timestamp) {
 
 	// Handle the first call to the method
 	if (prevTimestamp < 0) {
-		prevTimestamp = currentTimestamp;
+		prevTimestamp = timestamp;
+		errorPrev = error;
+		errorPrev2 = error;
+		correctionPrev = -Kp * error - Ki * errorInt;
+		return correctionPrev;
+	}
+
+	// With the same time stamp as the previous iteration there is no interval to integrate or differentiate over
+	if (timestamp <= prevTimestamp) {
+		errorPrev2 = errorPrev;
 		errorPrev = error;
-		return -Kp * error;
+		correctionPrev = -Kp * error - derivPrev - Ki * errorInt;
+		return correctionPrev;
 	}
 
 	// Update the object state and compute and return the control value
-	const auto deltaT = (currentTimestamp - prevTimestamp) / 1000.0;  // deltaT is in seconds
-	const auto errorDiff = error - errorPrev;
-	errorInt += error*deltaT;
-	const double correction = -Kp * error - Kd * errorDiff / deltaT
-			- Ki * errorInt;
-	prevTimestamp = currentTimestamp;
-	errorPrev = error;
-	return correction;
+	const auto deltaT = (timestamp - prevTimestamp) / 1e6;  // deltaT is in seconds
+	prevTimestamp = timestamp;
+	/* At (nearly) fixed rate use the precomputed coefficients, otherwise derive them from
+	 * the measured interval. */
+	if (nominalDeltaT > 0 && std::abs(deltaT - nominalDeltaT) <= jitterTolerance)
+		return step(error, nominal);
+	return step(error, makeCoefficients(deltaT));
+}
+
+void PID::setForm(const Form newForm) {
+	form = newForm;
+}
+
+void PID::setSamplePeriod(const double deltaT, const double tolerance, const double filter) {
+	assert(deltaT >= 0 && tolerance >= 0 && filter >= 0);
+	nominalDeltaT = deltaT;
+	jitterTolerance = tolerance;
+	derivFilter = filter;
+	updateCoefficients();
 }
 
-void PID::setParams(const std::vector<double> params, const double error) {
-	static double bestError = std::numeric_limits<double>::max();
-	if (error < bestError) {
-		bestError=error;
-		cout << "Best run so far with error = " << error << " and params P =" << Kp << ", I =" << Ki << ", D =" << Kd << endl << flush;
+void PID::setParams(const std::array<double, 3> & params, const double error, const uint32_t session) {
+	if (error < bestReportedError) {
+		bestReportedError=error;
+		Logger::log(LogEvent::bestRun, session, error, Kp, Ki, Kd);
 	}
 	setParams(params);
 }
 
-void PID::setParams(const std::vector<double> params) {
-	assert(params.size() == 3);
+void PID::setParams(const std::array<double, 3> & params) {
 	Kp = params[0];  // Params are in this order because I want to tune P first, then D and finally I
 	Ki = params[2];
 	Kd = params[1];
+	updateCoefficients();
 }
 
-bool PID::twiddle(const double error) {
+void PID::setGains(const double KpNew, const double KiNew, const double KdNew) {
+	Kp = KpNew;
+	Ki = KiNew;
+	Kd = KdNew;
+	updateCoefficients();
+	if (twiddleStep != TwiddleStep::done)
+		twiddleStep = TwiddleStep::initialising;
+}
+
+bool PID::twiddle(const double error, const uint32_t session) {
 	/* Implemented as a state machine. A Boost coroutine would be more readable and
 	 * maintainable, but including Boost would make submission of the project
 	 * to Udacity more complicated. See http://www.boost.org/doc/libs/1_64_0/libs/coroutine2/doc/html/index.html
+	 * The state is kept in data members, so that it can be saved and restored.
 	 */
-	enum State {
-		initialising, initialised, looping, if1, if2, done
-	};
-	static State state { initialising };
 	// When the sum of coefficient changes goes under tolerance, the algorithm stops
 	static const double tollerance { 0.01 };
-	// Coefficient changes
-	static vector<double> deltaParams { .0, .0, .0 };
-	// Coefficients, in this order [P, D, I]
-	static vector<double> params {.0, .0, .0 };
-	// Keep track of the best (lowest) error so far
-	static auto bestError = error;
+	auto & params = twiddleParams;
+	auto & deltaParams = twiddleDeltaParams;
+	auto & bestError = twiddleBestError;
 	// Index of the coefficient currently under update in params[], incremented by 1 before first usage
-	static unsigned i = -1;
+	auto & i = twiddleIndex;
 
 	while (true) {
-		switch (state) {
-		case done:
+		switch (twiddleStep) {
+		case TwiddleStep::done:
 			return true;
-		case initialising: {
+		case TwiddleStep::initialising: {
 			params[0]=Kp;  // Note the order of params: P-D-I.
 			params[2]=Ki;
 			params[1]=Kd;
 			deltaParams[0] = Kp/5;
 			deltaParams[2] = Ki/5;
 			deltaParams[1] = Kd/5;
-			state = initialised;
+			bestError = error;
+			i = -1;
+			twiddleStep = TwiddleStep::initialised;
 			return false;
 		}
-		case initialised: {
+		case TwiddleStep::initialised: {
 			auto errorsSum = accumulate(begin(params), end(params), 0.);
 			if (errorsSum <= tollerance) {
-				state = done;
+				twiddleStep = TwiddleStep::done;
 				return true;
 			}
-			state = looping;
+			twiddleStep = TwiddleStep::looping;
 			break;
 		}
-		case looping: {
+		case TwiddleStep::looping: {
 			++i;
 			if (i > 2) {
 				i = -1;
-				state = initialised;
+				twiddleStep = TwiddleStep::initialised;
 				break;
 			}
 			params[i] += deltaParams[i];
-			setParams(params, error);
-			state = if1;
+			setParams(params, error, session);
+			twiddleStep = TwiddleStep::if1;
 			return false;
 		}
-		case if1: {
+		case TwiddleStep::if1: {
 			if (error < bestError) {
 				bestError = error;
 				deltaParams[i] *= 1.1;
-				state = looping;
+				twiddleStep = TwiddleStep::looping;
 				break;
 			} else {
 				params[i] -= 2 * deltaParams[i];
-				setParams(params, error);
-				state = if2;
+				setParams(params, error, session);
+				twiddleStep = TwiddleStep::if2;
 				return false;
 			}
 		}
-		case if2: {
+		case TwiddleStep::if2: {
 			if (error < bestError) {
 				bestError = error;
 				deltaParams[i] *= 1.1;
-				state = looping;
+				twiddleStep = TwiddleStep::looping;
 				break;
 			} else {
 				params[i] += deltaParams[i];
 				deltaParams[i] *= 0.9;
-				setParams(params, error);
-				state = looping;
+				setParams(params, error, session);
+				twiddleStep = TwiddleStep::looping;
 				break;
 			}
 		}
@@ -145,3 +220,50 @@ bool PID::twiddle(const double error) {
 
 }
 
+PID::Snapshot PID::save() const {
+	Snapshot snapshot;
+	// Padding bytes zeroed too, for snapshot files to depend on the state only
+	memset(&snapshot, 0, sizeof(snapshot));
+	snapshot.Kp = Kp;
+	snapshot.Ki = Ki;
+	snapshot.Kd = Kd;
+	snapshot.errorPrev = errorPrev;
+	snapshot.errorPrev2 = errorPrev2;
+	snapshot.errorInt = errorInt;
+	snapshot.derivPrev = derivPrev;
+	snapshot.correctionPrev = correctionPrev;
+	snapshot.form = form;
+	snapshot.nominalDeltaT = nominalDeltaT;
+	snapshot.jitterTolerance = jitterTolerance;
+	snapshot.derivFilter = derivFilter;
+	snapshot.twiddleStep = twiddleStep;
+	snapshot.twiddleParams = twiddleParams;
+	snapshot.twiddleDeltaParams = twiddleDeltaParams;
+	snapshot.twiddleBestError = twiddleBestError;
+	snapshot.twiddleIndex = twiddleIndex;
+	snapshot.bestReportedError = bestReportedError;
+	return snapshot;
+}
+
+void PID::restore(const Snapshot & snapshot) {
+	Kp = snapshot.Kp;
+	Ki = snapshot.Ki;
+	Kd = snapshot.Kd;
+	errorPrev = snapshot.errorPrev;
+	errorPrev2 = snapshot.errorPrev2;
+	errorInt = snapshot.errorInt;
+	derivPrev = snapshot.derivPrev;
+	correctionPrev = snapshot.correctionPrev;
+	form = snapshot.form;
+	nominalDeltaT = snapshot.nominalDeltaT;
+	jitterTolerance = snapshot.jitterTolerance;
+	derivFilter = snapshot.derivFilter;
+	twiddleStep = snapshot.twiddleStep;
+	twiddleParams = snapshot.twiddleParams;
+	twiddleDeltaParams = snapshot.twiddleDeltaParams;
+	twiddleBestError = snapshot.twiddleBestError;
+	twiddleIndex = snapshot.twiddleIndex;
+	bestReportedError = snapshot.bestReportedError;
+	prevTimestamp = -1;
+	updateCoefficients();
+}
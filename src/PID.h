@@ -1,31 +1,126 @@
 #pragma once
-#include <vector>
+#include <array>
+#include <cstdint>
 
 class PID {
+public:
+	/**
+	 * Discrete-time form used to compute the control value.
+	 * positional: textbook form, backward difference for the D term, rectangles for the I term
+	 * velocity: incremental form, the control value is updated by a weighted sum of the last three errors
+	 * tustin: trapezoidal integration for the I term and a filtered (bilinear) derivative for the D term
+	 */
+	enum class Form {
+		positional, velocity, tustin
+	};
+
+	/**
+	 * Steps of the twiddle state machine.
+	 */
+	enum class TwiddleStep {
+		initialising, initialised, looping, if1, if2, done
+	};
+
+	/**
+	 * Complete state of a PID object, including twiddle progress, as a trivially copyable
+	 * structure that can be saved to file and restored.
+	 */
+	struct Snapshot {
+		double Kp, Ki, Kd;
+		double errorPrev, errorPrev2, errorInt, derivPrev, correctionPrev;
+		Form form;
+		double nominalDeltaT, jitterTolerance, derivFilter;
+		TwiddleStep twiddleStep;
+		std::array<double, 3> twiddleParams, twiddleDeltaParams;
+		double twiddleBestError;
+		unsigned twiddleIndex;
+		double bestReportedError;
+	};
+
+private:
+	/**
+	 * Coefficients of the discrete-time forms, derived from the gains and a sample period.
+	 */
+	struct Coefficients {
+		double deltaT;  // Sample period in seconds
+		double KdOverDeltaT;  // Kd / deltaT (positional form)
+		double q0, q1, q2;  // Weights of the current, previous and second to previous error (velocity form)
+		double halfDeltaT;  // deltaT / 2 (Tustin form)
+		double derivDecay, derivGain;  // Derivative filter coefficients (Tustin form)
+	};
+
+	/*
+	 * Members are grouped by how often they are written, so that an iteration dirties the
+	 * first 48 bytes only, and reads the next two cache lines or so; twiddle state comes last.
+	 */
+
+	// Written on every iteration
+	double errorPrev;  // Error computed at the previous iteration (to update Kd)
+	double errorPrev2;  // Error computed two iterations ago (velocity form)
+	double errorInt;  // Integral of the error over time (to update Ki)
+	double derivPrev;  // Filtered derivative term at the previous iteration (Tustin form)
+	double correctionPrev;  // Control value returned at the previous iteration
+	long long prevTimestamp;  // Time stamp of the previous iteration, in microseconds from a monotonic clock
+
+	// Read on every iteration, written when the gains or the sample period change
 	double Kp;  // Proportional term
 	double Ki;  // Integral term
 	double Kd;  // Derivative term
-	double errorPrev;  // Error computed at the previous iteration (to update Kd)
-	double errorInt;  // Integral of the error over time (to update Ki)
-	long long prevTimestamp;  // Time stamp of the previous iteration
+	Form form;  // Discrete-time form in use
+	double nominalDeltaT;  // Nominal sample period in seconds; 0 if the sample period is variable
+	double jitterTolerance;  // Max deviation from nominalDeltaT, in seconds, to use the precomputed coefficients
+	double derivFilter;  // Time constant of the derivative filter in seconds (Tustin form)
+	Coefficients nominal;  // Coefficients for nominalDeltaT, refreshed when gains or sample period change
+
+	/*
+	 * Twiddle state, see twiddle(); written once per twiddle interval.
+	 */
+	TwiddleStep twiddleStep;  // Current step of the state machine
+	std::array<double, 3> twiddleParams;  // Coefficients, in this order [P, D, I]
+	std::array<double, 3> twiddleDeltaParams;  // Coefficient changes
+	double twiddleBestError;  // Best (lowest) error so far
+	unsigned twiddleIndex;  // Index in twiddleParams of the coefficient currently under update
+	double bestReportedError;  // Best error printed to console so far by setParams()
+
+	/**
+	 * Computes the coefficients for the current gains and the given sample period.
+	 * @param deltaT the sample period in seconds, must be positive
+	 */
+	Coefficients makeCoefficients(const double deltaT) const;
+
+	/**
+	 * Recomputes the coefficients for the nominal sample period, if one is set.
+	 */
+	void updateCoefficients();
+
+	/**
+	 * Computes the control value with the given coefficients, and updates the controller state
+	 * other than prevTimestamp accordingly.
+	 * @param error the error value
+	 * @param coeffs coefficients for the interval elapsed since the previous iteration
+	 * @return the PID control value
+	 */
+	double step(const double error, const Coefficients & coeffs);
 
 	/**
-	 * Set the controller parameter values. Outputs to console the new values and the given error
+	 * Set the controller parameter values. Logs the new values and the given error, if the error is the best so far
 	 * @param params an array of three components, the P, I and T term respectively
-	 * @param error will be printed to console; won't affect the object state
+	 * @param error will be logged; won't affect the object state
+	 * @param session the session the controller belongs to, for the log
 	 */
-	void setParams(const std::vector<double> params, const double error);
+	void setParams(const std::array<double, 3> & params, const double error, const uint32_t session);
 
 	/**
 	 * Set the controller parameter values.
 	 * @param params an array of three components, the P, I and T term respectively
 	 */
-	void setParams(const std::vector<double> params);
+	void setParams(const std::array<double, 3> & params);
 
 public:
 
 	/**
-	 * Returns the number of milliseconds elapsed since the epoch.
+	 * Returns the number of milliseconds elapsed since the epoch; for twiddle windows, which
+	 * are saved along with the session.
 	 */
 	static long long getCurrentTimestamp();
 
@@ -40,18 +135,62 @@ public:
 	/**
 	 * Determines the current control value, based on the given error. It also
 	 * updates errorPrev, errorInt and prevTimestamp. The first time it is called
-	 * for a PID object, the produced control value is based on the proportional term only.
+	 * for a PID object, or after restore(), the produced control value is based on the
+	 * proportional term and on the integral accumulated so far only.
+	 * An iteration with the same time stamp as the previous one gets no I or D update.
 	 * @param error the error value
+	 * @param timestamp when the error was measured, in microseconds from a monotonic clock
 	 * @return the PID control value
 	 */
-	double computeCorrection(const double error);
+	double computeCorrection(const double error, const long long timestamp);
+
+	/**
+	 * Selects the discrete-time form used by computeCorrection(). Controller state is carried
+	 * over, so switching form while running doesn't cause a bump in the control value.
+	 * @param newForm the form to be used from the next iteration
+	 */
+	void setForm(const Form newForm);
+
+	/**
+	 * Sets the nominal sample period. When the measured interval between two iterations is
+	 * within jitter tolerance from it, computeCorrection() uses coefficients precomputed here
+	 * and when the gains change; otherwise it falls back to coefficients computed from the
+	 * measured interval.
+	 * @param deltaT the nominal sample period in seconds; 0 means the sample period is variable
+	 * @param tolerance the max deviation from the nominal sample period, in seconds
+	 * @param filter time constant of the derivative filter used by the Tustin form, in seconds;
+	 * if 0, it defaults to deltaT
+	 */
+	void setSamplePeriod(const double deltaT, const double tolerance, const double filter = 0);
+
+	/**
+	 * Sets the controller coefficients. If twiddle is running, it restarts from the given
+	 * coefficients.
+	 * @param KpNew value for the proportional term
+	 * @param KiNew value for the integral term
+	 * @param KdNew value for the differential term
+	 */
+	void setGains(const double KpNew, const double KiNew, const double KdNew);
 
 	/**
 	 * Performs one steep of twiddle, updating the PID parameters based on the given error
 	 * @param error the cumulative, or average, error occurred between the previous invocation
 	 * of the member function and this invocation.
+	 * @param session the session the controller belongs to, for the log
 	 * @return true if parameters tuning is completed (twiddle has converged); further calls to
 	 * the member function will still return true, and will leave the PID parameters unchanged.
 	 */
-	bool twiddle(const double error);
+	bool twiddle(const double error, const uint32_t session);
+
+	/**
+	 * Returns the complete state of the object.
+	 */
+	Snapshot save() const;
+
+	/**
+	 * Restores the object to the given state. The next call to computeCorrection() will be
+	 * handled as the first one, as the time of the latest iteration isn't part of the state.
+	 * @param snapshot the state, as returned by save()
+	 */
+	void restore(const Snapshot & snapshot);
 };
@@ -0,0 +1,36 @@
+#include "PIDBank.h"
+
+PIDBank::PIDBank(const double KpInit, const double KiInit, const double KdInit) :
+		Kp { KpInit }, Ki { KiInit }, Kd { KdInit }, errorPrev(), errorInt(), started(), prevTimestamp { -1 } {
+}
+
+void PIDBank::setGains(const double KpNew, const double KiNew, const double KdNew) {
+	Kp = KpNew;
+	Ki = KiNew;
+	Kd = KdNew;
+}
+
+void PIDBank::computeCorrections(const double * errors, const std::size_t n, const long long timestamp,
+		double * corrections) {
+	if (errorPrev.size() < n) {
+		errorPrev.resize(n, 0.);
+		errorInt.resize(n, 0.);
+		started.resize(n, 0.);
+	}
+	// Before the first batch, and for batches with the same time stamp, there is no interval to integrate over
+	const double deltaT = prevTimestamp >= 0 && timestamp > prevTimestamp ? (timestamp - prevTimestamp) / 1e6 : 0.;
+	const double KdOverDeltaT = deltaT > 0 ? Kd / deltaT : 0.;
+	prevTimestamp = timestamp;
+
+	double * const prev = errorPrev.data();
+	double * const integral = errorInt.data();
+	double * const weight = started.data();
+	for (std::size_t i = 0; i < n; ++i) {
+		const double error = errors[i];
+		integral[i] += weight[i] * error * deltaT;
+		const double deriv = weight[i] * KdOverDeltaT * (error - prev[i]);
+		corrections[i] = -Kp * error - deriv - Ki * integral[i];
+		prev[i] = error;
+		weight[i] = 1.;
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+/**
+ * PID controllers for the vehicles of a fleet, sharing the same gains and sampled together.
+ * The state of the controllers is kept in one array per variable (structure of arrays), so
+ * that a whole batch of errors is processed by a single loop the compiler can vectorise. Uses
+ * the positional form of PID, with the sample period measured between batches; no twiddle.
+ */
+class PIDBank {
+	double Kp;  // Proportional term
+	double Ki;  // Integral term
+	double Kd;  // Derivative term
+	std::vector<double> errorPrev;  // Error of each controller at the previous batch
+	std::vector<double> errorInt;  // Integral of the error of each controller
+	std::vector<double> started;  // 1 for controllers that have been through a batch, 0 otherwise; a double to keep the loop branch-free
+	long long prevTimestamp;  // Time stamp of the previous batch in microseconds, -1 before the first one
+
+public:
+	/**
+	 * Constructs a bank with no controllers.
+	 * @param KpInit value for the proportional term
+	 * @param KiInit value for the integral term
+	 * @param KdInit value for the differential term
+	 */
+	PIDBank(const double KpInit, const double KiInit, const double KdInit);
+
+	/**
+	 * Sets the coefficients of all controllers.
+	 */
+	void setGains(const double KpNew, const double KiNew, const double KdNew);
+
+	/**
+	 * Determines the control values for a batch of errors, one per controller. Controllers are
+	 * added as needed; as for PID::computeCorrection(), the first control value of a controller
+	 * is based on the proportional term only.
+	 * @param errors the error values, the error for controller i at index i
+	 * @param n the number of errors
+	 * @param timestamp when the errors were measured, in microseconds from a monotonic clock
+	 * @param corrections filled with the n control values
+	 */
+	void computeCorrections(const double * errors, const std::size_t n, const long long timestamp, double * corrections);
+};
@@ -0,0 +1,80 @@
+#include "PlantModel.h"
+#include "PIDBank.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace {
+
+const unsigned nBends = 3;  // Sinusoids making up the curvature of a track
+
+/**
+ * Curvature of a track along its length: a sum of sinusoids.
+ */
+struct Track {
+	double amplitude[nBends];  // 1/m
+	double waveNumber[nBends];  // rad/m
+	double phase[nBends];
+
+	explicit Track(const uint32_t seed) {
+		std::mt19937 random(seed);
+		std::uniform_real_distribution<double> uniform(0, 1);
+		for (unsigned j = 0; j < nBends; ++j) {
+			// Radii down to about 60 m, bends 100 to 400 m long
+			amplitude[j] = .006 * uniform(random);
+			waveNumber[j] = 2 * M_PI / (100 + 300 * uniform(random));
+			phase[j] = 2 * M_PI * uniform(random);
+		}
+	}
+
+	double curvature(const double position) const {
+		double curvature = 0;
+		for (unsigned j = 0; j < nBends; ++j)
+			curvature += amplitude[j] * sin(waveNumber[j] * position + phase[j]);
+		return curvature;
+	}
+};
+
+}
+
+void PlantModel::rollout(const std::array<double, 3> & gains, const uint32_t firstSeed, const std::size_t n,
+		double * errors) const {
+	std::vector<Track> tracks;
+	for (std::size_t i = 0; i < n; ++i)
+		tracks.emplace_back(firstSeed + i);
+	std::vector<double> lateral(n), heading(n, 0.), controlErrors(n), corrections(n), sum(n, 0.);
+	std::vector<bool> off(n, false);
+	// Steering values on their way to the vehicles, the oldest first, deadTime + 1 per scenario
+	std::vector<double> pending((deadTime + 1) * n, 0.);
+	for (std::size_t i = 0; i < n; ++i)
+		lateral[i] = sin(firstSeed + 10. * i);  // Starting off the center-line by up to 1 m
+
+	PIDBank steering(gains[0], gains[1], gains[2]);
+	const auto nSteps = static_cast<std::size_t>(duration / period);
+	for (std::size_t step = 0; step < nSteps; ++step) {
+		const auto timestamp = static_cast<long long>(step * period * 1e6);
+		for (std::size_t i = 0; i < n; ++i)
+			controlErrors[i] = lateral[i] * std::fabs(lateral[i]);
+		steering.computeCorrections(controlErrors.data(), n, timestamp, corrections.data());
+
+		const auto slot = step % (deadTime + 1);
+		const auto appliedSlot = (step + 1) % (deadTime + 1);
+		const double position = speed * step * period;
+		for (std::size_t i = 0; i < n; ++i) {
+			pending[slot * n + i] = std::min(std::max(corrections[i], -1.), 1.);
+			if (off[i]) {
+				sum[i] += offTrack * offTrack;
+				continue;
+			}
+			sum[i] += lateral[i] * lateral[i];
+			// Kinematic bicycle, in the frame of the center-line
+			const double angle = pending[appliedSlot * n + i] * maxSteeringAngle;
+			lateral[i] += speed * sin(heading[i]) * period;
+			heading[i] += speed * (tan(angle) / wheelBase - tracks[i].curvature(position)) * period;
+			off[i] = std::fabs(lateral[i]) > offTrack;
+		}
+	}
+	for (std::size_t i = 0; i < n; ++i)
+		errors[i] = sum[i] / std::max<std::size_t>(nSteps, 1);
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Vehicle model standing in for the simulator in offline tuning: a kinematic bicycle driving
+ * at constant speed along a winding track, steered by the steering controller as the program
+ * steers the simulator, that is from the signed square of the cross-track error, clamped to
+ * [-1, 1], and with the reply arriving after a dead time. Every scenario is a track of its
+ * own, drawn from its seed.
+ */
+struct PlantModel {
+	double speed { 13.4 };  // m/s, about 30 mph
+	double wheelBase { 2.7 };  // m
+	double maxSteeringAngle { .436 };  // rad, the angle steering 1 stands for
+	double period { .02 };  // Time between two telemetry messages, in seconds
+	unsigned deadTime { 5 };  // Periods from telemetry to steering being applied
+	double duration { 60 };  // Seconds of driving per scenario
+	double offTrack { 3 };  // Cross-track error at which the vehicle leaves the track, in m
+
+	/**
+	 * Drives the given scenarios with the given steering gains, all at once, the controllers
+	 * of the scenarios being a PIDBank.
+	 * @param gains P, I and D
+	 * @param firstSeed the seed of the first scenario; scenario i has seed firstSeed + i
+	 * @param n the number of scenarios
+	 * @param errors filled with the mean squared cross-track error of each scenario, the
+	 * objective twiddle minimises; a vehicle leaving the track has offTrack as error for the
+	 * rest of the scenario
+	 */
+	void rollout(const std::array<double, 3> & gains, const uint32_t firstSeed, const std::size_t n,
+			double * errors) const;
+};
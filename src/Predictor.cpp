@@ -0,0 +1,127 @@
+#include "Predictor.h"
+#include "Messages.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+/*
+ * Steering values are compared normalised to [-1, 1], as control values are. The simulator
+ * reports the steering angle in degrees rounded to 4 decimals, hence off by half a quantum
+ * at most; the tolerance is a whole quantum, the other half being margin for the rounding
+ * of the normalised values themselves.
+ */
+const double steeringQuantum = 1e-4 / maxSteeringDegrees;
+const double steeringTolerance = steeringQuantum;
+
+// Probes are spaced by more than twice the tolerance, so that a reported value matches one probe at most
+const double probeSpacing = 10 * steeringTolerance;
+
+}
+
+CtePredictor::CtePredictor(const double processNoiseInit, const double measurementNoiseInit) :
+		cte { 0. }, cteRate { 0. }, P00 { 0. }, P01 { 0. }, P11 { 0. }, processNoise { processNoiseInit },
+		measurementNoise { measurementNoiseInit }, prevTimestamp { -1 } {
+}
+
+void CtePredictor::update(const double measuredCte, const long long timestamp) {
+	// Handle the first measurement: position is known, rate is not
+	if (prevTimestamp < 0) {
+		cte = measuredCte;
+		cteRate = 0.;
+		P00 = measurementNoise;
+		P01 = 0.;
+		P11 = 1.;
+		prevTimestamp = timestamp;
+		return;
+	}
+
+	const double deltaT = (timestamp - prevTimestamp) / 1e6;  // deltaT is in seconds
+	prevTimestamp = timestamp;
+
+	// Prediction, F = [1 deltaT; 0 1]
+	cte += cteRate * deltaT;
+	const double deltaT2 = deltaT * deltaT;
+	const double p00 = P00 + 2 * deltaT * P01 + deltaT2 * P11 + processNoise * deltaT2 * deltaT / 3;
+	const double p01 = P01 + deltaT * P11 + processNoise * deltaT2 / 2;
+	const double p11 = P11 + processNoise * deltaT;
+
+	// Update, H = [1 0]
+	const double innovation = measuredCte - cte;
+	const double s = p00 + measurementNoise;
+	const double k0 = p00 / s;
+	const double k1 = p01 / s;
+	cte += k0 * innovation;
+	cteRate += k1 * innovation;
+	P00 = (1 - k0) * p00;
+	P01 = (1 - k0) * p01;
+	P11 = p11 - k1 * p01;
+}
+
+double CtePredictor::predict(const double lookahead) const {
+	return cte + cteRate * lookahead;
+}
+
+LatencyEstimator::LatencyEstimator(const double smoothingInit) :
+		probes(), nProbes { 0 }, measuredDeadTime { -1. }, framePeriod { 0. }, processing { 0. }, smoothing {
+				smoothingInit }, receivedTimestamp { -1 }, latestSteering { std::numeric_limits<double>::quiet_NaN() } {
+}
+
+long long LatencyEstimator::getCurrentTimestamp() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void LatencyEstimator::onReceive(const long long timestamp, const double reportedSteering) {
+	if (receivedTimestamp >= 0) {
+		const double interval = (timestamp - receivedTimestamp) / 1e6;
+		framePeriod = framePeriod == 0. ? interval : framePeriod + smoothing * (interval - framePeriod);
+	}
+	receivedTimestamp = timestamp;
+
+	// Probes that never showed up, e.g. as the simulator was restarted, are given up after a second
+	unsigned first = 0;
+	while (first < nProbes && timestamp - probes[first].receivedTimestamp > 1000000)
+		++first;
+	// Steering is applied in the order it is sent: the match is the oldest probe, and the ones before it are superseded
+	if (std::isfinite(reportedSteering))
+		for (unsigned i = first; i < nProbes; ++i)
+			if (std::fabs(probes[i].steering - reportedSteering) <= steeringTolerance) {
+				const double sample = std::max((timestamp - probes[i].receivedTimestamp) / 1e6 - framePeriod / 2, 0.);
+				measuredDeadTime =
+						measuredDeadTime < 0 ? sample : measuredDeadTime + smoothing * (sample - measuredDeadTime);
+				first = i + 1;
+				break;
+			}
+	std::copy(probes + first, probes + nProbes, probes);
+	nProbes -= first;
+}
+
+void LatencyEstimator::onControl(const double steering) {
+	// Only a change of steering can be told apart from the previous one when it comes back
+	if (!(std::fabs(steering - latestSteering) > probeSpacing)) {
+		latestSteering = steering;
+		return;
+	}
+	latestSteering = steering;
+	if (nProbes == maxProbes) {
+		std::copy(probes + 1, probes + nProbes, probes);
+		--nProbes;
+	}
+	probes[nProbes++] = Probe { receivedTimestamp, steering };
+}
+
+void LatencyEstimator::onSend(const long long timestamp) {
+	if (receivedTimestamp >= 0)
+		processing += smoothing * ((timestamp - receivedTimestamp) / 1e6 - processing);
+}
+
+double LatencyEstimator::getDeadTime() const {
+	return measuredDeadTime >= 0 ? std::max(measuredDeadTime, processing) : framePeriod;
+}
+
+double LatencyEstimator::getFramePeriod() const {
+	return framePeriod;
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+/**
+ * Kalman filter on the cross-track error and its rate of change, based on a constant velocity
+ * model. Used to extrapolate the cross-track error over the time it takes a control value to
+ * reach the simulator.
+ */
+class CtePredictor {
+	double cte;  // Estimated cross-track error
+	double cteRate;  // Estimated rate of change of the cross-track error, per second
+	double P00, P01, P11;  // Estimate covariance (symmetric 2x2 matrix)
+	double processNoise;  // Spectral density of the unmodelled acceleration of the cross-track error
+	double measurementNoise;  // Variance of the cross-track error measurement
+	long long prevTimestamp;  // Time stamp of the previous measurement in microseconds, -1 before the first one
+
+public:
+	/**
+	 * Constructs a predictor with the given noise parameters
+	 * @param processNoiseInit spectral density of the unmodelled acceleration of the cross-track error
+	 * @param measurementNoiseInit variance of the cross-track error measurement
+	 */
+	CtePredictor(const double processNoiseInit = 4., const double measurementNoiseInit = .01);
+
+	/**
+	 * Updates the estimate with a new measurement of the cross-track error.
+	 * @param measuredCte the measured cross-track error
+	 * @param timestamp time of the measurement in microseconds, from a monotonic clock
+	 */
+	void update(const double measuredCte, const long long timestamp);
+
+	/**
+	 * Returns the cross-track error extrapolated at the given time after the latest measurement.
+	 * Before the first measurement it returns 0.
+	 * @param lookahead the extrapolation interval in seconds
+	 */
+	double predict(const double lookahead) const;
+};
+
+/**
+ * Estimates the dead time of the steering: the delay from a measurement being taken by the
+ * simulator to the steering computed from it being applied.
+ *
+ * Neither the one-way latencies nor the time the simulator takes to apply a command can be
+ * read from the reception of telemetry and the sending of replies alone; instead, the delay is
+ * measured from effect to cause. The simulator reports in every telemetry message the steering
+ * angle in force when it took the measurement. When the steering sent for a message shows up in
+ * a later message, the interval between receiving the two messages equals the interval between
+ * the two measurements, as both come through the same one-way latency; the steering was applied
+ * somewhere during the frame before the later message, on average half a frame period earlier.
+ * Hence the dead time is taken as that interval less half a frame period, the frame period being
+ * measured from the time stamps of telemetry. Until a steering angle has been seen coming back,
+ * e.g. with the binary protocol, whose telemetry doesn't report it, the dead time is taken as one
+ * frame period, that is replies are assumed to reach the simulator before its next measurement.
+ */
+class LatencyEstimator {
+	/**
+	 * Steering sent in reply to telemetry, waiting to show up in the steering angle reported by
+	 * later telemetry.
+	 */
+	struct Probe {
+		long long receivedTimestamp;  // When the telemetry replied to was received, in microseconds
+		double steering;  // Steering sent, in [-1, 1]
+	};
+
+	static const unsigned maxProbes = 8;  // Beyond that, the oldest probe is dropped
+
+	Probe probes[maxProbes];  // The oldest first
+	unsigned nProbes;
+	double measuredDeadTime;  // Smoothed measured dead time in seconds, -1 before the first measurement
+	double framePeriod;  // Smoothed interval between telemetry messages, in seconds
+	double processing;  // Smoothed time between receiving telemetry and sending the reply, in seconds
+	double smoothing;  // Weight of a new sample in the exponential moving averages
+	long long receivedTimestamp;  // When the latest telemetry was received, in microseconds, -1 if none yet
+	double latestSteering;  // Steering sent in reply to the latest telemetry, NaN if none yet
+
+public:
+	/**
+	 * Constructs an estimator with the given smoothing factor
+	 * @param smoothingInit weight of a new sample in the exponential moving averages, in (0, 1]
+	 */
+	LatencyEstimator(const double smoothingInit = .05);
+
+	/**
+	 * Returns the number of microseconds elapsed since an arbitrary point, from a monotonic clock.
+	 */
+	static long long getCurrentTimestamp();
+
+	/**
+	 * To be called when telemetry is received.
+	 * @param timestamp time of reception in microseconds
+	 * @param reportedSteering the steering the simulator reports as applied, in [-1, 1]; NaN if
+	 * not reported
+	 */
+	void onReceive(const long long timestamp, const double reportedSteering);
+
+	/**
+	 * To be called when the steering for the latest telemetry has been computed.
+	 * @param steering the steering, in [-1, 1]
+	 */
+	void onControl(const double steering);
+
+	/**
+	 * To be called after the reply to the latest telemetry has been sent.
+	 * @param timestamp time of sending in microseconds
+	 */
+	void onSend(const long long timestamp);
+
+	/**
+	 * Returns the estimated time, in seconds, from a measurement being taken to the steering
+	 * computed from it being applied, see above.
+	 */
+	double getDeadTime() const;
+
+	/**
+	 * Returns the smoothed interval between telemetry messages, in seconds.
+	 */
+	double getFramePeriod() const;
+};
@@ -0,0 +1,133 @@
+#include "ReplyBatcher.h"
+#include <cstdio>
+
+ReplyBatcher::ReplyBatcher(uv_loop_t * loop, const std::size_t maxSessions, const long long capInit,
+		MessageHandler & handlerInit) :
+		cap { capInit * 1000 }, handler(handlerInit), queues(maxSessions), pending(), oldest { 0 }, check(), nFrames {
+				0 }, nWrites { 0 } {
+	// Check handles run right after the callbacks of the events polled in a loop iteration
+	uv_check_init(loop, &check);
+	check.data = this;
+	uv_check_start(&check, [](uv_check_t * handle) {
+		static_cast<ReplyBatcher *>(handle->data)->flush();
+	});
+}
+
+void ReplyBatcher::reply(uWS::WebSocket<uWS::SERVER> ws, Session & session, const Reply & reply, const long long start) {
+	++nFrames;
+	const auto opCode = reply.binary ? uWS::OpCode::BINARY : uWS::OpCode::TEXT;
+	if (cap == 0) {
+		ws.send(reply.data, reply.length, opCode, onSent, addBacklog(queues[session.id], reply.length));
+		++nWrites;
+		if (reply.control)
+			session.latency.onSend(LatencyEstimator::getCurrentTimestamp());
+		handler.replyLatency().record(LatencyHistogram::now() - start);
+		return;
+	}
+	auto & queue = queues[session.id];
+	if (!queue.pending) {
+		queue.pending = true;
+		if (pending.empty())
+			oldest = start;
+		pending.emplace_back(&session, ws);
+	} else if (queue.opCode != opCode)
+		// Frames of a batch share their type; the gathered ones go first, to keep the order
+		send(session, ws);
+	queue.opCode = opCode;
+	queue.messages.emplace_back(reply.data, reply.length);
+	queue.starts.push_back(start);
+	queue.control = queue.control || reply.control;
+	if (start - oldest >= cap)
+		flush();
+}
+
+void ReplyBatcher::push(uWS::WebSocket<uWS::SERVER> ws, Session & session, const Reply & message) {
+	// After the replies gathered, to keep the order
+	send(session, ws);
+	ws.send(message.data, message.length, message.binary ? uWS::OpCode::BINARY : uWS::OpCode::TEXT, onSent,
+			addBacklog(queues[session.id], message.length));
+	++nWrites;
+}
+
+void ReplyBatcher::send(Session & session, uWS::WebSocket<uWS::SERVER> ws) {
+	auto & queue = queues[session.id];
+	if (queue.messages.empty())
+		return;
+	if (queue.messages.size() == 1)
+		ws.send(queue.messages.front().data(), queue.messages.front().length(), queue.opCode, onSent,
+				addBacklog(queue, queue.messages.front().length()));
+	else {
+		// All frames in one buffer, written at once
+		std::size_t length = 0;
+		for (const auto & message : queue.messages)
+			length += message.length();
+		std::vector<int> excludedMessages;
+		auto prepared = uWS::WebSocket<uWS::SERVER>::prepareMessageBatch(queue.messages, excludedMessages, queue.opCode,
+				false, onSent);
+		ws.sendPrepared(prepared, addBacklog(queue, length));
+		uWS::WebSocket<uWS::SERVER>::finalizeMessage(prepared);
+	}
+	++nWrites;
+	if (queue.control)
+		session.latency.onSend(LatencyEstimator::getCurrentTimestamp());
+	const auto now = LatencyHistogram::now();
+	for (const auto start : queue.starts)
+		handler.replyLatency().record(now - start);
+	queue.messages.clear();
+	queue.starts.clear();
+	queue.control = false;
+}
+
+ReplyBatcher::Backlog * ReplyBatcher::addBacklog(Queue & queue, const std::size_t length) {
+	if (queue.backlog == nullptr)
+		queue.backlog = new Backlog();
+	queue.backlog->lengths.push_back(length);
+	queue.backlog->bytes += length;
+	return queue.backlog;
+}
+
+void ReplyBatcher::onSent(uWS::WebSocket<uWS::SERVER>, void * data, bool, void *) {
+	auto backlog = static_cast<Backlog *>(data);
+	backlog->bytes -= backlog->lengths.front();
+	backlog->lengths.pop_front();
+	if (!backlog->attached && backlog->lengths.empty())
+		delete backlog;
+}
+
+void ReplyBatcher::flush() {
+	for (auto & connection : pending) {
+		send(*connection.first, connection.second);
+		queues[connection.first->id].pending = false;
+	}
+	pending.clear();
+}
+
+void ReplyBatcher::drop(const Session & session) {
+	auto & queue = queues[session.id];
+	if (queue.backlog != nullptr) {
+		// Writes still queued in uWS are called back as cancelled
+		if (queue.backlog->lengths.empty())
+			delete queue.backlog;
+		else
+			queue.backlog->attached = false;
+		queue.backlog = nullptr;
+	}
+	if (!queue.pending)
+		return;
+	for (auto it = pending.begin(); it != pending.end(); ++it)
+		if (it->first == &session) {
+			pending.erase(it);
+			break;
+		}
+	queue.messages.clear();
+	queue.starts.clear();
+	queue.control = queue.pending = false;
+}
+
+std::string ReplyBatcher::stats() const {
+	char text[160];
+	snprintf(text, sizeof(text), "{\"frames\":%llu,\"writes\":%llu,\"writes_per_frame\":%.4f}",
+			static_cast<unsigned long long>(nFrames), static_cast<unsigned long long>(nWrites),
+			nFrames > 0 ? static_cast<double>(nWrites) / nFrames : 0.);
+	return text;
+}
@@ -0,0 +1,127 @@
+#pragma once
+#include "LatencyHistogram.h"
+#include "MessageHandler.h"
+#include "Session.h"
+#include <uWS/uWS.h>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Sends the replies to WebSocket messages with uWS, gathering them per connection: every
+ * ws.send() is a write system call, and a connection, such as a fleet client or a simulator
+ * that sends ahead, may get several replies per event loop iteration. Gathered replies are
+ * written together, in one system call per connection, at the end of the loop iteration,
+ * or as soon as the oldest has waited for the configured cap. With a cap of 0, every reply
+ * is sent right away.
+ *
+ * Also records the time from the reception of messages to the sending of their replies, and
+ * keeps track of the bytes uWS has not yet managed to send to each connection. Must be used by
+ * the event loop thread only.
+ */
+class ReplyBatcher {
+	/**
+	 * Bytes written to uWS for a connection, and not yet sent to its socket. Outlives the
+	 * connection until uWS has called back for every write, sent or cancelled.
+	 */
+	struct Backlog {
+		std::deque<std::size_t> lengths;  // Of the writes not yet sent, in order
+		std::size_t bytes { 0 };
+		bool attached { true };  // Whether the connection is still open
+	};
+
+	/**
+	 * Replies gathered for a connection.
+	 */
+	struct Queue {
+		std::vector<std::string> messages;
+		uWS::OpCode opCode { uWS::OpCode::TEXT };  // Shared by all the messages
+		std::vector<long long> starts;  // Times at which the messages replied to were received, in nanoseconds
+		bool control { false };  // Whether any of the messages carries control values
+		bool pending { false };  // Whether the connection is in `pending`
+		Backlog * backlog { nullptr };  // nullptr until the first write
+	};
+
+	const long long cap;  // In nanoseconds
+	MessageHandler & handler;
+	std::vector<Queue> queues;  // Indexed by session id
+	std::vector<std::pair<Session *, uWS::WebSocket<uWS::SERVER>>> pending;  // Connections with replies gathered
+	long long oldest;  // Time at which the oldest message replied to was received
+	uv_check_t check;  // Flushes at the end of every loop iteration
+	uint64_t nFrames;  // WebSocket messages replied to
+	uint64_t nWrites;  // Sends to uWS, each a write system call
+
+	/**
+	 * Sends the replies gathered for a connection.
+	 */
+	void send(Session & session, uWS::WebSocket<uWS::SERVER> ws);
+
+	/**
+	 * Counts the bytes of a write to uWS as not yet sent; to be called before the write, as
+	 * uWS calls back right away if the bytes are sent at once.
+	 * @return the backlog, as data for the callback
+	 */
+	static Backlog * addBacklog(Queue & queue, const std::size_t length);
+
+	/**
+	 * Called back by uWS when a write has been sent, or cancelled.
+	 */
+	static void onSent(uWS::WebSocket<uWS::SERVER> ws, void * data, bool cancelled, void * reserved);
+
+public:
+	/**
+	 * Constructs the batcher, and hooks it to the end of every event loop iteration.
+	 * @param loop the event loop
+	 * @param maxSessions the number of sessions
+	 * @param capInit how long a reply may be held back, in microseconds
+	 * @param handlerInit the message handler, whose reply latency is recorded
+	 */
+	ReplyBatcher(uv_loop_t * loop, const std::size_t maxSessions, const long long capInit, MessageHandler & handlerInit);
+
+	ReplyBatcher(const ReplyBatcher &) = delete;
+	ReplyBatcher & operator=(const ReplyBatcher &) = delete;
+
+	/**
+	 * Sends a reply, or gathers it with the other replies to the same connection.
+	 * @param ws the connection
+	 * @param session its session
+	 * @param reply the reply
+	 * @param start the time at which the message replied to was received, in nanoseconds
+	 */
+	void reply(uWS::WebSocket<uWS::SERVER> ws, Session & session, const Reply & reply, const long long start);
+
+	/**
+	 * Sends a message that is not a reply, such as control values sent at a fixed rate, right
+	 * away.
+	 * @param ws the connection
+	 * @param session its session
+	 * @param message the message
+	 */
+	void push(uWS::WebSocket<uWS::SERVER> ws, Session & session, const Reply & message);
+
+	/**
+	 * Sends the replies gathered for all connections.
+	 */
+	void flush();
+
+	/**
+	 * Drops the replies gathered for a connection being closed.
+	 */
+	void drop(const Session & session);
+
+	/**
+	 * @return the bytes of replies to a connection not yet sent
+	 */
+	std::size_t backlog(const Session & session) const {
+		const auto backlog = queues[session.id].backlog;
+		return backlog != nullptr ? backlog->bytes : 0;
+	}
+
+	/**
+	 * @return the statistics, in JSON format
+	 */
+	std::string stats() const;
+};
@@ -0,0 +1,260 @@
+#include "Session.h"
+#include "Logger.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <new>
+
+namespace {
+
+/**
+ * Determines the sign of the argument comparing it with 0.
+ * @param val the argument
+ * @return 1 if 0 is less than val, -1 if val is less than 0, 0 if neither is true
+ */
+template<typename T> int sign(T val) {
+	return (T(0) < val) - (val < T(0));
+}
+
+}
+
+Session::Session(const ControlConfig & config, const bool tune) :
+		id { 0 }, pidSteering(config.steeringP, config.steeringI, config.steeringD), pidThrottle(config.throttleP,
+				config.throttleI, config.throttleD), ctePredictor(), latency(), latestTwiddleTime { -1 }, totalError { 0 },
+		nSamples { 0 }, tuneParams { tune }, configVersion { config.version }, arena(), extractor(), binaryProtocol { false }, shedding { false },
+		latestTelemetry(), latestTelemetryTime { -1 }, latestSequence { 0 }, latestActivity { 0 },
+		fleetSteering(config.steeringP, config.steeringI, config.steeringD), fleetThrottle(config.throttleP,
+				config.throttleI, config.throttleD), fleetErrors(), fleetCorrections() {
+}
+
+void Session::applyConfig(const ControlConfig & config) {
+	if (config.version == configVersion)
+		return;
+	pidSteering.setGains(config.steeringP, config.steeringI, config.steeringD);
+	pidThrottle.setGains(config.throttleP, config.throttleI, config.throttleD);
+	fleetSteering.setGains(config.steeringP, config.steeringI, config.steeringD);
+	fleetThrottle.setGains(config.throttleP, config.throttleI, config.throttleD);
+	configVersion = config.version;
+}
+
+SteerCommand Session::control(const Telemetry & telemetry, const double steeringAngle, const ControlConfig & config,
+		const long long receivedTime, const bool predictCte) {
+	latency.onReceive(receivedTime, steeringAngle / maxSteeringDegrees);
+	ctePredictor.update(telemetry.cte, receivedTime);
+	/*
+	 * If requested, steer based on where the car will be when the steering
+	 * is applied, instead of where it was when the measure was taken.
+	 */
+	const auto command = steer(telemetry, config,
+			predictCte ? ctePredictor.predict(latency.getDeadTime()) : telemetry.cte, receivedTime);
+	latency.onControl(command.steering);
+	return command;
+}
+
+void Session::observe(const Telemetry & telemetry, const double steeringAngle, const long long receivedTime) {
+	latency.onReceive(receivedTime, steeringAngle / maxSteeringDegrees);
+	ctePredictor.update(telemetry.cte, receivedTime);
+	latestTelemetry = telemetry;
+	latestTelemetryTime = receivedTime;
+}
+
+SteerCommand Session::controlLatest(const ControlConfig & config, const long long currentTime, const bool predictCte) {
+	const double lookahead = (currentTime - latestTelemetryTime) / 1e6;
+	return steer(latestTelemetry, config, predictCte ? ctePredictor.predict(lookahead) : latestTelemetry.cte,
+			currentTime);
+}
+
+void Session::setSamplePeriod(const double period) {
+	const double tolerance = period / 4;
+	pidSteering.setSamplePeriod(period, tolerance);
+	pidThrottle.setSamplePeriod(period, tolerance);
+}
+
+SteerCommand Session::steer(const Telemetry & telemetry, const ControlConfig & config, double cte,
+		const long long timestamp) {
+	cte=sign(cte)*pow(cte,2);
+	const double speedError = telemetry.speed-config.targetSpeed;
+
+	totalError+=pow(telemetry.cte,2);
+	++nSamples;
+
+	SteerCommand command;
+	command.steering = pidSteering.computeCorrection(cte, timestamp);
+	if (command.steering<-1)
+		command.steering=-1;
+	else if (command.steering > 1)
+		command.steering =1;
+	command.throttle=pidThrottle.computeCorrection(speedError, timestamp);
+	return command;
+}
+
+bool Session::twiddle() {
+	if (!tuneParams || nSamples == 0)
+		return tuneParams;
+	double averageError = totalError/nSamples;
+	bool paramsTuned = pidSteering.twiddle(averageError, id);
+	if (paramsTuned) {
+		Logger::log(LogEvent::tuningComplete, id);
+		tuneParams=false;
+	}
+	totalError=0;
+	nSamples=0;
+	latestTwiddleTime=PID::getCurrentTimestamp();
+	return tuneParams;
+}
+
+void Session::controlBatch(const Telemetry * telemetry, const std::size_t n, const ControlConfig & config,
+		const long long receivedTime, SteerCommand * commands) {
+	fleetErrors.resize(n);
+	fleetCorrections.resize(n);
+
+	for (std::size_t i = 0; i < n; ++i)
+		fleetErrors[i] = sign(telemetry[i].cte) * telemetry[i].cte * telemetry[i].cte;
+	fleetSteering.computeCorrections(fleetErrors.data(), n, receivedTime, fleetCorrections.data());
+	for (std::size_t i = 0; i < n; ++i)
+		commands[i].steering = std::min(std::max(fleetCorrections[i], -1.), 1.);
+
+	for (std::size_t i = 0; i < n; ++i)
+		fleetErrors[i] = telemetry[i].speed - config.targetSpeed;
+	fleetThrottle.computeCorrections(fleetErrors.data(), n, receivedTime, fleetCorrections.data());
+	for (std::size_t i = 0; i < n; ++i)
+		commands[i].throttle = fleetCorrections[i];
+}
+
+Session::Snapshot Session::save() const {
+	Snapshot snapshot;
+	// Padding bytes zeroed too, for snapshot files to depend on the state only
+	memset(&snapshot, 0, sizeof(snapshot));
+	snapshot.steering = pidSteering.save();
+	snapshot.throttle = pidThrottle.save();
+	snapshot.latestTwiddleTime = latestTwiddleTime;
+	snapshot.totalError = totalError;
+	snapshot.nSamples = nSamples;
+	snapshot.tuneParams = tuneParams;
+	return snapshot;
+}
+
+void Session::restore(const Snapshot & snapshot) {
+	pidSteering.restore(snapshot.steering);
+	pidThrottle.restore(snapshot.throttle);
+	latestTwiddleTime = snapshot.latestTwiddleTime;
+	totalError = snapshot.totalError;
+	nSamples = snapshot.nSamples;
+	tuneParams = snapshot.tuneParams;
+}
+
+SessionTable::SessionTable(const size_t capacityInit, const Session & prototype, const std::vector<int> & nodes,
+		const bool bind) :
+		slabs(), slabSize { 0 }, stride { (sizeof(Session) + cacheLine - 1) / cacheLine * cacheLine }, capacity {
+				capacityInit }, inUse(capacityInit, false), started(capacityInit, false), nLocal { 0 }, nRemote { 0 },
+		nodeAccesses() {
+	const size_t nSlabs = std::max<size_t>(nodes.size(), 1);
+	slabSize = std::max<size_t>((capacity + nSlabs - 1) / nSlabs, 1);
+	for (size_t first = 0; first < capacity; first += slabSize) {
+		Slab slab;
+		slab.node = nodes.empty() ? -1 : nodes[slabs.size()];
+		slab.count = std::min(slabSize, capacity - first);
+		// Page aligned, hence cache line aligned
+		slab.memory.reset(new NodeMemory(slab.count * stride, bind ? slab.node : -1));
+		slab.sessions = static_cast<char *>(slab.memory->get());
+		if (slab.sessions == nullptr)
+			throw std::bad_alloc();
+		// Constructed by this thread, on pages of the node the slab is bound to, or else of the node of this thread
+		for (size_t i = 0; i < slab.count; ++i)
+			new (slab.sessions + i * stride) Session(prototype);
+		slabs.push_back(std::move(slab));
+		for (size_t i = 0; i < slabs.back().count; ++i)
+			at(first + i).id = first + i;
+	}
+}
+
+SessionTable::~SessionTable() {
+	for (size_t id = 0; id < capacity; ++id)
+		at(id).~Session();
+}
+
+Session * SessionTable::acquire() {
+	const int node = NumaTopology::currentNode();
+	// Local slabs first
+	for (const bool local : { true, false })
+		for (size_t s = 0; s < slabs.size(); ++s) {
+			if ((slabs[s].node == node) != local)
+				continue;
+			for (size_t j = 0; j < slabs[s].count; ++j) {
+				auto & session = at(s * slabSize + j);
+				if (inUse[session.id])
+					continue;
+				inUse[session.id] = true;
+				started[session.id] = true;
+				session.binaryProtocol = false;
+				session.shedding = false;
+				session.latestTelemetryTime = -1;
+				if (local)
+					++nLocal;
+				else
+					++nRemote;
+				return &session;
+			}
+		}
+	return nullptr;
+}
+
+void SessionTable::release(Session * session) {
+	assert(session->id < capacity && session == &at(session->id));
+	inUse[session->id] = false;
+}
+
+void SessionTable::save(std::vector<Record> & records) const {
+	records.clear();
+	for (size_t i = 0; i < capacity; ++i)
+		if (started[i]) {
+			// Padding bytes included, as records are written to file as they are in memory
+			records.emplace_back();
+			auto & record = records.back();
+			memset(&record, 0, sizeof(record));
+			record.slot = i;
+			const auto session = at(i).save();
+			memcpy(&record.session, &session, sizeof(session));
+		}
+}
+
+size_t SessionTable::restore(const std::vector<Record> & records) {
+	size_t nRestored = 0;
+	for (const auto & record : records)
+		if (record.slot < capacity) {
+			at(record.slot).restore(record.session);
+			started[record.slot] = true;
+			++nRestored;
+		}
+	return nRestored;
+}
+
+std::string SessionTable::stats() const {
+	char text[200];
+	snprintf(text, sizeof(text),
+			"{\"thread_node\":%d,\"acquired_local\":%llu,\"acquired_remote\":%llu,\"session_size\":%zu,\"stride\":%zu,",
+			NumaTopology::currentNode(), static_cast<unsigned long long>(nLocal), static_cast<unsigned long long>(nRemote),
+			sizeof(Session), stride);
+	std::string json = text;
+	uint64_t loads, misses;
+	if (nodeAccesses.read(loads, misses)) {
+		snprintf(text, sizeof(text), "\"node_loads\":%llu,\"node_load_misses\":%llu,",
+				static_cast<unsigned long long>(loads), static_cast<unsigned long long>(misses));
+		json += text;
+	} else
+		json += "\"node_loads\":null,\"node_load_misses\":null,";
+	json += "\"slabs\":[";
+	for (size_t i = 0; i < slabs.size(); ++i) {
+		std::vector<size_t> pagesPerNode;
+		const auto nPages = slabs[i].memory->locate(pagesPerNode);
+		snprintf(text, sizeof(text), "%s{\"node\":%d,\"bound\":%s,\"sessions\":%zu,\"pages\":%zu,\"pages_per_node\":[",
+				i > 0 ? "," : "", slabs[i].node, slabs[i].memory->getNode() >= 0 ? "true" : "false", slabs[i].count, nPages);
+		json += text;
+		for (size_t node = 0; node < pagesPerNode.size(); ++node)
+			json += (node > 0 ? "," : "") + std::to_string(pagesPerNode[node]);
+		json += "]}";
+	}
+	return json + "]}";
+}
@@ -0,0 +1,277 @@
+#pragma once
+#include "Arena.h"
+#include "Config.h"
+#include "Messages.h"
+#include "Numa.h"
+#include "PID.h"
+#include "PIDBank.h"
+#include "Predictor.h"
+#include "TelemetryExtractor.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Controller state for one vehicle, that is for one connection from the simulator.
+ */
+struct Session {
+	uint32_t id;  // Position of the session in its table
+	PID pidSteering;  // Steering controller
+	PID pidThrottle;  // Throttle controller
+	CtePredictor ctePredictor;  // Extrapolates the cross-track error to compensate for latency
+	LatencyEstimator latency;  // Estimates latency from the time stamps of telemetry and replies
+	long long latestTwiddleTime;  // Time stamp of the start of the current twiddle window in milliseconds, -1 if none yet
+	double totalError;  // Sum of the steering errors since the latest twiddle run
+	unsigned long nSamples;  // Number of errors summed in totalError
+	bool tuneParams;  // Whether steering coefficients are being tuned with twiddle
+	uint64_t configVersion;  // Version of the latest configuration applied to the controllers
+	MonotonicArena arena;  // Memory for the messages being handled; a copied session gets an empty arena
+	TelemetryExtractor extractor;  // Fast path to the values in telemetry messages
+	bool binaryProtocol;  // Whether the connection has switched to the binary protocol, see BinaryProtocol.h
+	bool shedding;  // Whether messages are being dropped, as the client does not read replies fast enough
+	Telemetry latestTelemetry;  // For control at a fixed rate
+	long long latestTelemetryTime;  // When latestTelemetry was received, in microseconds from a monotonic clock; -1 if none yet
+	uint32_t latestSequence;  // Sequence number of the latest telemetry message of the binary protocol
+	uint64_t latestActivity;  // Tick of the MessageHandler timers at the latest message handled, for idle timeouts
+	PIDBank fleetSteering;  // Steering controllers for the vehicles of batch messages
+	PIDBank fleetThrottle;  // Throttle controllers for the vehicles of batch messages
+	std::vector<double> fleetErrors;  // Scratch space for batches
+	std::vector<double> fleetCorrections;  // Scratch space for batches
+
+	/**
+	 * Part of the session state that is saved to file and survives a restart of the program.
+	 * Time stamps from a monotonic clock are meaningless across restarts, therefore the
+	 * latency predictor and estimator are not part of it.
+	 */
+	struct Snapshot {
+		PID::Snapshot steering;
+		PID::Snapshot throttle;
+		long long latestTwiddleTime;
+		double totalError;
+		unsigned long nSamples;
+		bool tuneParams;
+	};
+
+	/**
+	 * Constructs a session with the given configuration
+	 * @param config the controllers coefficients
+	 * @param tune whether the steering coefficients have to be tuned with twiddle
+	 */
+	Session(const ControlConfig & config, const bool tune);
+
+	/**
+	 * Sets the controllers coefficients from the given configuration, unless already done.
+	 * @param config the configuration
+	 */
+	void applyConfig(const ControlConfig & config);
+
+	/**
+	 * Determines the control values for the given telemetry. The error is summed up for
+	 * twiddle, if tuning is in progress.
+	 * @param telemetry the measures from the simulator
+	 * @param steeringAngle the steering angle the simulator reports as applied, in degrees; NaN
+	 * if not reported
+	 * @param config the current configuration
+	 * @param receivedTime when the telemetry was received, in microseconds from a monotonic clock
+	 * @param predictCte whether the cross-track error has to be extrapolated to compensate for latency
+	 * @return the control values
+	 */
+	SteerCommand control(const Telemetry & telemetry, const double steeringAngle, const ControlConfig & config,
+			const long long receivedTime, const bool predictCte);
+
+	/**
+	 * Takes in telemetry, to be used by the next call to controlLatest(), for control at a
+	 * fixed rate rather than in reply to telemetry.
+	 * @param telemetry the measures from the simulator
+	 * @param steeringAngle the steering angle the simulator reports as applied, in degrees; NaN
+	 * if not reported
+	 * @param receivedTime when the telemetry was received, in microseconds from a monotonic clock
+	 */
+	void observe(const Telemetry & telemetry, const double steeringAngle, const long long receivedTime);
+
+	/**
+	 * Determines the control values from the latest telemetry taken in with observe(), as
+	 * control() does. As control values are not sent in reply to telemetry, the round trip
+	 * can't be measured: latency compensation extrapolates the cross-track error to the
+	 * current time only.
+	 * @param config the current configuration
+	 * @param currentTime the current time, in microseconds from a monotonic clock
+	 * @param predictCte whether the cross-track error has to be extrapolated
+	 * @return the control values; to be called only after telemetry has been taken in
+	 */
+	SteerCommand controlLatest(const ControlConfig & config, const long long currentTime, const bool predictCte);
+
+	/**
+	 * Sets the nominal sample period of the controllers, for control at a fixed rate.
+	 * @param period in seconds; 0 means the sample period is variable
+	 */
+	void setSamplePeriod(const double period);
+
+	/**
+	 * Runs one iteration of twiddle on the errors summed up since the previous one, and starts
+	 * a new twiddle window; to be called every twiddle interval while tuning is in progress.
+	 * Nothing happens if no error has been summed up.
+	 * @return whether tuning is still in progress
+	 */
+	bool twiddle();
+
+	/**
+	 * Determines the control values for a batch of vehicles, the telemetry for vehicle i at
+	 * index i. The same computation as control(), but with the controllers of fleetSteering
+	 * and fleetThrottle, and without twiddle nor latency compensation.
+	 * @param telemetry the measures from the simulator
+	 * @param n the number of vehicles
+	 * @param config the current configuration
+	 * @param receivedTime when the telemetry was received, in microseconds from a monotonic clock
+	 * @param commands filled with the n control values
+	 */
+	void controlBatch(const Telemetry * telemetry, const std::size_t n, const ControlConfig & config,
+			const long long receivedTime, SteerCommand * commands);
+
+	/**
+	 * Returns the part of the session state that survives a restart. Controllers for batches
+	 * are not part of it.
+	 */
+	Snapshot save() const;
+
+	/**
+	 * Restores the session state from a snapshot. The version of the applied configuration
+	 * is left unchanged.
+	 * @param snapshot the state, as returned by save()
+	 */
+	void restore(const Snapshot & snapshot);
+
+private:
+	/**
+	 * Determines the control values, and sums up the error for twiddle: the part of control()
+	 * that follows taking in telemetry.
+	 * @param cte the cross-track error to steer by, possibly extrapolated
+	 * @param timestamp the time of the control values, in microseconds from a monotonic clock
+	 */
+	SteerCommand steer(const Telemetry & telemetry, const ControlConfig & config, const double cte,
+			const long long timestamp);
+};
+
+/**
+ * Fixed size set of sessions. A new connection takes the first session not in use, and
+ * gives it back when it disconnects; the session state is kept, and handed over to the next
+ * connection, as it happens when the simulator is restarted.
+ *
+ * Sessions are kept in slabs, one per NUMA node of the threads serving connections, with
+ * their memory on the node, bound to it if the threads are pinned; a connection takes a session from the slab of the node of
+ * the thread serving it, if there is one left, so that the controllers state touched on every
+ * message is local memory. Heap memory of the sessions, such as the arena, is allocated on
+ * the node of the thread that touches it first, as usual.
+ *
+ * Within a slab, every session starts on a cache line of its own, so that sessions served by
+ * different threads never share one, and a session is not invalidated in the cache of a thread
+ * by the updates another thread makes to its neighbour. Sessions are spaced by hand rather than
+ * declared alignas(cacheLine), as operator new ignores over-alignment before C++17.
+ */
+class SessionTable {
+	/**
+	 * Sessions whose memory is on one node.
+	 */
+	struct Slab {
+		std::unique_ptr<NodeMemory> memory;
+		int node;  // Node of the threads the sessions are meant for
+		char * sessions;  // First session; the next ones follow every `stride` bytes
+		size_t count;
+	};
+
+	std::vector<Slab> slabs;
+	size_t slabSize;  // Sessions per slab; the last slab may have fewer
+	size_t stride;  // Distance between sessions in a slab, sizeof(Session) rounded up to whole cache lines
+	size_t capacity;
+	std::vector<bool> inUse;  // Whether the session is currently taken by a connection
+	std::vector<bool> started;  // Whether the session has ever been taken, or restored from file
+	uint64_t nLocal;  // Sessions taken from the slab of the node of the thread taking them
+	uint64_t nRemote;  // Sessions taken from the slab of another node, as the local one was full
+	NodeAccessCounter nodeAccesses;  // Loads of the thread that built the table, which serves the connections
+
+public:
+	/**
+	 * Session state, with its position in the table, as saved to file.
+	 */
+	struct Record {
+		uint32_t slot;
+		Session::Snapshot session;
+	};
+
+	/**
+	 * Constructs a table with the given number of sessions, all copies of a prototype, split
+	 * evenly over slabs on the given nodes.
+	 * @param capacityInit the number of sessions
+	 * @param prototype the initial state for all sessions
+	 * @param nodes the nodes of the threads serving connections; if empty, sessions are in a
+	 * single slab, allocated with the default policy
+	 * @param bind whether the memory of every slab is bound to its node; if not, it is allocated
+	 * with the default policy, on the node of the thread that touches it first, and automatic
+	 * balancing may move it after the threads serving connections
+	 */
+	SessionTable(const size_t capacityInit, const Session & prototype, const std::vector<int> & nodes,
+			const bool bind);
+
+	~SessionTable();
+
+	SessionTable(const SessionTable &) = delete;
+	SessionTable & operator=(const SessionTable &) = delete;
+
+	/**
+	 * Takes the first session not in use, from the slab of the node of the calling thread if
+	 * possible. The session starts with the text protocol.
+	 * @return the session, or nullptr if all sessions are in use
+	 */
+	Session * acquire();
+
+	/**
+	 * Gives back a session previously taken with acquire().
+	 * @param session the session
+	 */
+	void release(Session * session);
+
+	/**
+	 * @return the session with the given id, in use or not
+	 */
+	Session & at(const size_t id) {
+		return *reinterpret_cast<Session *>(slabs[id / slabSize].sessions + id % slabSize * stride);
+	}
+
+	const Session & at(const size_t id) const {
+		return *reinterpret_cast<const Session *>(slabs[id / slabSize].sessions + id % slabSize * stride);
+	}
+
+	/**
+	 * Size of a cache line, assumed to be the same on all the hosts the program runs on.
+	 */
+	static const size_t cacheLine = 64;
+
+	/**
+	 * @return the number of sessions, one past the highest session id
+	 */
+	size_t size() const {
+		return capacity;
+	}
+
+	/**
+	 * Fills `records` with the state of every session that has been started.
+	 * @param records the vector to be filled; its previous content is overwritten
+	 */
+	void save(std::vector<Record> & records) const;
+
+	/**
+	 * Restores sessions from the given records. Records for positions out of the table are ignored.
+	 * @param records the sessions state, as produced by save()
+	 * @return the number of sessions restored
+	 */
+	size_t restore(const std::vector<Record> & records);
+
+	/**
+	 * @return the node of the calling thread, the sessions taken from local and remote slabs, the
+	 * size of a session and the distance between sessions, and, for every slab, its node and the
+	 * pages of its memory on every node, as the kernel reports them, in JSON format
+	 */
+	std::string stats() const;
+};
@@ -0,0 +1,82 @@
+#include "SharedRing.h"
+#include <cstring>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "Futex words must be plain 32-bit integers");
+
+void futexWait(std::atomic<uint32_t> & word, const uint32_t expected, const long timeout) {
+	timespec relative;
+	relative.tv_sec = timeout / 1000000;
+	relative.tv_nsec = timeout % 1000000 * 1000;
+	// Not FUTEX_PRIVATE_FLAG, as the word is shared with other processes
+	syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAIT, expected, &relative, nullptr, 0);
+}
+
+void futexWake(std::atomic<uint32_t> & word) {
+	syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+}
+
+SharedChannel::SharedChannel() :
+		rings { nullptr }, name(), owner { false } {
+}
+
+SharedChannel::~SharedChannel() {
+	if (rings != nullptr)
+		munmap(rings, sizeof(SharedRings));
+	if (owner)
+		shm_unlink(name.c_str());
+}
+
+bool SharedChannel::create(const std::string & nameInit) {
+	return map(nameInit, true);
+}
+
+bool SharedChannel::attach(const std::string & nameInit) {
+	return map(nameInit, false);
+}
+
+bool SharedChannel::map(const std::string & nameInit, const bool create) {
+	if (rings != nullptr)
+		return false;
+	if (create)
+		shm_unlink(nameInit.c_str());
+	const int fd = shm_open(nameInit.c_str(), create ? O_RDWR | O_CREAT | O_EXCL : O_RDWR, 0600);
+	if (fd < 0)
+		return false;
+	struct stat status;
+	if ((create && ftruncate(fd, sizeof(SharedRings)) != 0) || fstat(fd, &status) != 0
+			|| static_cast<size_t>(status.st_size) < sizeof(SharedRings)) {
+		close(fd);
+		if (create)
+			shm_unlink(nameInit.c_str());
+		return false;
+	}
+	void * address = mmap(nullptr, sizeof(SharedRings), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (address == MAP_FAILED) {
+		if (create)
+			shm_unlink(nameInit.c_str());
+		return false;
+	}
+	auto mapped = static_cast<SharedRings *>(address);
+	if (create) {
+		// A new object is zero-filled, which leaves both rings empty
+		mapped->magic = binaryMagic;
+		mapped->version = shmVersion;
+	} else {
+		if (mapped->magic != binaryMagic || mapped->version != shmVersion) {
+			munmap(address, sizeof(SharedRings));
+			return false;
+		}
+	}
+	rings = mapped;
+	name = nameInit;
+	owner = create;
+	return true;
+}
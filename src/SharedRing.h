@@ -0,0 +1,146 @@
+#pragma once
+#include "BinaryProtocol.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/**
+ * Shared-memory transport for clients running on the same host, such as a simulator or a
+ * plant model, which skips TCP, WebSocket framing and JSON altogether. A POSIX shared memory
+ * object holds a pair of rings, one per direction, of the same messages as the binary protocol,
+ * see BinaryProtocol.h: the client pushes BinaryTelemetry messages, the server answers each of
+ * them with a BinarySteer message, in the same order, with the same sequence number.
+ *
+ * Each ring has a single producer and a single consumer, in different processes. A consumer
+ * with nothing to read spins for a while, then sleeps on a futex on the ring head, which the
+ * producer only wakes if the consumer has declared itself asleep.
+ */
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "Atomics in shared memory must be lock-free to work across processes");
+
+const uint32_t shmVersion = 1;
+
+/**
+ * Waits until the given word no longer holds the expected value, the timeout expires, or a
+ * wake-up arrives; the word may be in memory shared with other processes.
+ * @param timeout in microseconds
+ */
+void futexWait(std::atomic<uint32_t> & word, const uint32_t expected, const long timeout);
+
+/**
+ * Wakes up all the threads waiting on the given word, in any process.
+ */
+void futexWake(std::atomic<uint32_t> & word);
+
+/**
+ * Single-producer, single-consumer ring of fixed size messages, laid out in shared memory.
+ * Head and tail are counters of messages pushed and popped, on cache lines of their own;
+ * they wrap around at 2^32, a multiple of the capacity.
+ */
+template<typename Message> struct SharedRing {
+	static const uint32_t capacity = 256;  // A power of 2
+	static const unsigned spinCount = 2000;  // Checks of the head before sleeping in wait()
+
+	alignas(64) std::atomic<uint32_t> head;  // Written by the producer; also the futex word
+	alignas(64) std::atomic<uint32_t> tail;  // Written by the consumer
+	std::atomic<uint32_t> sleeping;  // 1 while the consumer is, or is about to be, asleep in wait()
+	alignas(64) Message slots[capacity];
+
+	/**
+	 * Appends a message; called by the producer only.
+	 * @return false if the ring is full
+	 */
+	bool push(const Message & message) {
+		const auto h = head.load(std::memory_order_relaxed);
+		if (h - tail.load(std::memory_order_acquire) == capacity)
+			return false;
+		slots[h % capacity] = message;
+		// Sequentially consistent, against the consumer storing `sleeping` then loading `head`
+		head.store(h + 1, std::memory_order_seq_cst);
+		if (sleeping.load(std::memory_order_seq_cst) != 0)
+			futexWake(head);
+		return true;
+	}
+
+	/**
+	 * Takes out the oldest message; called by the consumer only.
+	 * @return false if the ring is empty
+	 */
+	bool pop(Message & message) {
+		const auto t = tail.load(std::memory_order_relaxed);
+		if (head.load(std::memory_order_acquire) == t)
+			return false;
+		message = slots[t % capacity];
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * Waits until the ring holds a message, or the timeout expires; called by the consumer only.
+	 * @param timeout in microseconds
+	 * @return true if the ring holds a message
+	 */
+	bool wait(const long timeout) {
+		const auto t = tail.load(std::memory_order_relaxed);
+		for (unsigned i = 0; i < spinCount; ++i)
+			if (head.load(std::memory_order_acquire) != t)
+				return true;
+		sleeping.store(1, std::memory_order_seq_cst);
+		const auto h = head.load(std::memory_order_seq_cst);
+		if (h == t)
+			futexWait(head, h, timeout);
+		sleeping.store(0, std::memory_order_relaxed);
+		return head.load(std::memory_order_acquire) != t;
+	}
+};
+
+/**
+ * Content of the shared memory object.
+ */
+struct SharedRings {
+	uint32_t magic;  // binaryMagic, once the object is initialised
+	uint32_t version;  // shmVersion
+	SharedRing<BinaryTelemetry> toServer;
+	SharedRing<BinarySteer> toClient;
+};
+
+/**
+ * Mapping of the shared memory object. The server creates the object, which is removed when
+ * the server's mapping is destroyed; clients attach to an existing one.
+ */
+class SharedChannel {
+	SharedRings * rings;  // nullptr if not mapped
+	std::string name;
+	bool owner;  // Whether the object has been created by this mapping, and is to be removed with it
+
+	bool map(const std::string & nameInit, const bool create);
+
+public:
+	SharedChannel();
+	~SharedChannel();
+
+	SharedChannel(const SharedChannel &) = delete;
+	SharedChannel & operator=(const SharedChannel &) = delete;
+
+	/**
+	 * Creates the shared memory object, replacing any previous one with the same name, and maps it.
+	 * @param nameInit the object name, as for shm_open(), e.g. "/pid"
+	 * @return true if successful
+	 */
+	bool create(const std::string & nameInit);
+
+	/**
+	 * Maps an existing shared memory object, created by the server.
+	 * @param nameInit the object name
+	 * @return true if successful
+	 */
+	bool attach(const std::string & nameInit);
+
+	SharedRing<BinaryTelemetry> & toServer() {
+		return rings->toServer;
+	}
+
+	SharedRing<BinarySteer> & toClient() {
+		return rings->toClient;
+	}
+};
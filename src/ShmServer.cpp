@@ -0,0 +1,109 @@
+#include "ShmServer.h"
+#include "Logger.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+const long idleTimeout = 100000;  // microseconds; how often an idle thread checks whether to stop
+
+}
+
+ShmServer::ShmServer(ConfigStore & configStoreInit, const Session & prototype, const bool predictCteInit,
+		const bool logFramesInit, const long long controlPeriod) :
+		channel(), configStore(configStoreInit), session(prototype), predictCte { predictCteInit }, logFrames {
+				logFramesInit }, scheduler(), stopping { false } {
+	if (controlPeriod > 0)
+		scheduler.reset(new ControlScheduler(controlPeriod, session.id + 1));
+}
+
+ShmServer::~ShmServer() {
+	stopping.store(true, std::memory_order_relaxed);
+	if (thread.joinable())
+		thread.join();
+}
+
+bool ShmServer::start(const std::string & name) {
+	if (!channel.create(name))
+		return false;
+	thread = std::thread(&ShmServer::run, this);
+	return true;
+}
+
+void ShmServer::run() {
+	const auto reader = configStore.registerReader();
+	auto & requests = channel.toServer();
+	auto & replies = channel.toClient();
+	BinaryTelemetry message;
+	// The session is not on the timers of the MessageHandler: twiddle windows are timed with the time stamps of telemetry
+	long long twiddleTime = -1;
+	if (scheduler) {
+		scheduler->setTask([this, reader](Session &) {
+			onTick(reader);
+		});
+		scheduler->add(session);
+	}
+	while (!stopping.load(std::memory_order_relaxed)) {
+		if (scheduler)
+			scheduler->runDue();
+		if (!requests.pop(message)) {
+			configStore.quiescent(reader);
+			// Sleeps until the next tick at most
+			requests.wait(scheduler ? std::min(idleTimeout, static_cast<long>(scheduler->untilNextTick() / 1000 + 1)) :
+					idleTimeout);
+			continue;
+		}
+		const auto receivedTime = LatencyEstimator::getCurrentTimestamp();
+		if (message.header.magic != binaryMagic || message.header.version != binaryVersion
+				|| message.header.type != BinaryType::telemetry || !std::isfinite(message.cte)
+				|| !std::isfinite(message.speed))
+			continue;
+		// Pick up the latest configuration; `config` must not be used after quiescent()
+		const auto config = configStore.read();
+		session.applyConfig(*config);
+		const Telemetry telemetry { message.cte, message.speed };
+		SteerCommand command {};
+		if (scheduler) {
+			// The controllers run when the scheduler says so, see onTick()
+			session.observe(telemetry, std::numeric_limits<double>::quiet_NaN(), receivedTime);
+			session.latestSequence = message.sequence;
+		} else
+			command = session.control(telemetry, std::numeric_limits<double>::quiet_NaN(), *config, receivedTime,
+					predictCte);
+		if (session.tuneParams) {
+			if (twiddleTime < 0)
+				twiddleTime = receivedTime;
+			else if (receivedTime - twiddleTime > config->twiddleInterval * 1e6) {
+				session.twiddle();
+				twiddleTime = receivedTime;
+			}
+		}
+		configStore.quiescent(reader);
+		if (scheduler)
+			continue;
+		const BinarySteer reply { makeBinaryHeader(BinaryType::steer), message.sequence, 0, command.steering,
+				command.throttle };
+		// A client that doesn't take its replies loses them, rather than stalling the thread
+		replies.push(reply);
+		session.latency.onSend(LatencyEstimator::getCurrentTimestamp());
+		if (logFrames)
+			Logger::log(LogEvent::frame, session.id, telemetry.cte, telemetry.speed, command.steering, command.throttle);
+	}
+}
+
+void ShmServer::onTick(const std::size_t reader) {
+	if (session.latestTelemetryTime < 0)
+		return;
+	const auto config = configStore.read();
+	session.applyConfig(*config);
+	const auto command = session.controlLatest(*config, LatencyEstimator::getCurrentTimestamp(), predictCte);
+	configStore.quiescent(reader);
+	const BinarySteer reply { makeBinaryHeader(BinaryType::steer), session.latestSequence, 0, command.steering,
+			command.throttle };
+	channel.toClient().push(reply);
+	session.latency.onSend(LatencyEstimator::getCurrentTimestamp());
+	if (logFrames)
+		Logger::log(LogEvent::frame, session.id, session.latestTelemetry.cte, session.latestTelemetry.speed,
+				command.steering, command.throttle);
+}
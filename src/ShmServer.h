@@ -0,0 +1,68 @@
+#pragma once
+#include "Config.h"
+#include "ControlScheduler.h"
+#include "Session.h"
+#include "SharedRing.h"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+/**
+ * Serves a client over the shared-memory transport, see SharedRing.h, from a thread of its
+ * own. The client gets a session of its own, outside of the session table: it is not saved
+ * to the snapshot file. The thread reads the configuration as the event loop does, as a
+ * registered reader of the ConfigStore.
+ *
+ * At a fixed control rate, telemetry is taken in only, and the thread sends the control values
+ * on a ControlScheduler of its own, which it runs from the clock between two messages.
+ */
+class ShmServer {
+	SharedChannel channel;
+	ConfigStore & configStore;
+	Session session;
+	bool predictCte;  // Whether the cross-track error has to be extrapolated to compensate for latency
+	bool logFrames;  // Whether every telemetry message is logged, with the resulting commands
+	std::unique_ptr<ControlScheduler> scheduler;  // nullptr unless control values are sent at a fixed rate
+	std::atomic<bool> stopping;
+	std::thread thread;
+
+	/**
+	 * Body of the thread.
+	 */
+	void run();
+
+	/**
+	 * Sends the control values computed from the latest telemetry, as scheduled.
+	 * @param reader the reader identifier of the thread
+	 */
+	void onTick(const std::size_t reader);
+
+public:
+	/**
+	 * Constructs the server, without starting it.
+	 * @param configStoreInit the configuration
+	 * @param prototype the initial state for the session
+	 * @param predictCteInit whether the cross-track error has to be extrapolated to compensate for latency
+	 * @param logFramesInit whether every telemetry message is logged
+	 * @param controlPeriod the period at which control values are sent, in microseconds; 0 to
+	 * send them in reply to telemetry
+	 */
+	ShmServer(ConfigStore & configStoreInit, const Session & prototype, const bool predictCteInit,
+			const bool logFramesInit, const long long controlPeriod);
+
+	/**
+	 * Stops the thread, if started, and removes the shared memory object.
+	 */
+	~ShmServer();
+
+	ShmServer(const ShmServer &) = delete;
+	ShmServer & operator=(const ShmServer &) = delete;
+
+	/**
+	 * Creates the shared memory object and starts the thread. To be called at most once.
+	 * @param name the object name, as for shm_open()
+	 * @return true if successful
+	 */
+	bool start(const std::string & name);
+};
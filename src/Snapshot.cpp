@@ -0,0 +1,157 @@
+#include "Snapshot.h"
+#include "Logger.h"
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+static_assert(std::is_trivially_copyable<SessionTable::Record>::value, "Records are written to file as they are in memory");
+
+namespace {
+
+const char magic[8] = { 'P', 'I', 'D', 'S', 'N', 'A', 'P', '\0' };
+const uint32_t version = 1;
+
+/**
+ * Snapshot file header, followed by `count` records of `recordSize` bytes each.
+ */
+struct Header {
+	char magic[8];
+	uint32_t version;
+	uint32_t recordSize;  // Must match the size of the records for the running program
+	uint64_t count;  // Number of records
+	uint64_t checksum;  // FNV-1a hash of the records
+};
+
+uint64_t checksum(const void * data, const size_t size) {
+	auto bytes = static_cast<const unsigned char *>(data);
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+/**
+ * Writes the whole buffer to the given file descriptor, retrying on partial writes and on
+ * interruptions by signals.
+ * @return true if successful
+ */
+bool writeAll(const int fd, const void * data, size_t size) {
+	auto bytes = static_cast<const char *>(data);
+	while (size > 0) {
+		const auto written = ::write(fd, bytes, size);
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written < 0)
+			return false;
+		bytes += written;
+		size -= written;
+	}
+	return true;
+}
+
+}
+
+SnapshotWriter::SnapshotWriter(const std::string & fileNameInit) :
+		fileName { fileNameInit }, hasPending { false }, stopping { false } {
+	thread = std::thread(&SnapshotWriter::run, this);
+}
+
+SnapshotWriter::~SnapshotWriter() {
+	{
+		lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wakeUp.notify_one();
+	thread.join();
+}
+
+bool SnapshotWriter::post(std::vector<SessionTable::Record> & records) {
+	unique_lock<std::mutex> lock(mutex, try_to_lock);
+	if (!lock.owns_lock())
+		return false;
+	pending.swap(records);
+	hasPending = true;
+	lock.unlock();
+	wakeUp.notify_one();
+	return true;
+}
+
+void SnapshotWriter::run() {
+	vector<SessionTable::Record> records;
+	while (true) {
+		{
+			unique_lock<std::mutex> lock(mutex);
+			wakeUp.wait(lock, [this] {return hasPending || stopping;});
+			if (!hasPending)
+				return;
+			records.swap(pending);
+			hasPending = false;
+		}
+		if (!write(records))
+			Logger::log(LogEvent::snapshotFailed);
+	}
+}
+
+bool SnapshotWriter::write(const std::vector<SessionTable::Record> & records) const {
+	Header header;
+	memcpy(header.magic, magic, sizeof(magic));
+	header.version = version;
+	header.recordSize = sizeof(SessionTable::Record);
+	header.count = records.size();
+	header.checksum = checksum(records.data(), records.size() * sizeof(SessionTable::Record));
+
+	const auto tempFileName = fileName + ".tmp";
+	const int fd = open(tempFileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return false;
+	bool success = writeAll(fd, &header, sizeof(header))
+			&& writeAll(fd, records.data(), records.size() * sizeof(SessionTable::Record)) && fsync(fd) == 0;
+	success = close(fd) == 0 && success;
+	// Renaming is atomic, the file always holds either the previous or the new snapshot
+	if (success)
+		success = rename(tempFileName.c_str(), fileName.c_str()) == 0;
+	if (!success)
+		unlink(tempFileName.c_str());
+	return success;
+}
+
+bool loadSnapshot(const std::string & fileName, std::vector<SessionTable::Record> & records) {
+	records.clear();
+	const int fd = open(fileName.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat fileStat;
+	if (fstat(fd, &fileStat) != 0 || static_cast<size_t>(fileStat.st_size) < sizeof(Header)) {
+		close(fd);
+		return false;
+	}
+	const size_t size = fileStat.st_size;
+	void * mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapped == MAP_FAILED)
+		return false;
+
+	Header header;
+	memcpy(&header, mapped, sizeof(header));
+	const auto payload = static_cast<const char *>(mapped) + sizeof(Header);
+	const bool valid = memcmp(header.magic, magic, sizeof(magic)) == 0 && header.version == version
+			&& header.recordSize == sizeof(SessionTable::Record)
+			&& header.count == (size - sizeof(Header)) / sizeof(SessionTable::Record)
+			&& (size - sizeof(Header)) % sizeof(SessionTable::Record) == 0
+			&& header.checksum == checksum(payload, size - sizeof(Header));
+	if (valid) {
+		records.resize(header.count);
+		memcpy(records.data(), payload, size - sizeof(Header));
+	}
+	munmap(mapped, size);
+	return valid;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include "Session.h"
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Writes snapshots of the sessions state to a binary file from a background thread, so that
+ * the thread running the controllers never waits on disk I/O. Every snapshot is written to a
+ * temporary file, which is then renamed over the given file: the file always holds a complete
+ * snapshot, even if the program is killed while writing.
+ */
+class SnapshotWriter {
+	std::string fileName;
+	std::vector<SessionTable::Record> pending;  // Snapshot waiting to be written
+	bool hasPending;  // Whether `pending` holds a snapshot not yet written
+	bool stopping;  // Set to have the background thread terminate
+	std::mutex mutex;  // Guards pending, hasPending and stopping
+	std::condition_variable wakeUp;
+	std::thread thread;
+
+	/**
+	 * Body of the background thread.
+	 */
+	void run();
+
+	/**
+	 * Writes the given records to file.
+	 * @return true if successful
+	 */
+	bool write(const std::vector<SessionTable::Record> & records) const;
+
+public:
+	/**
+	 * Constructs the writer and starts its background thread.
+	 * @param fileNameInit the file to be written
+	 */
+	SnapshotWriter(const std::string & fileNameInit);
+
+	/**
+	 * Writes the latest posted snapshot, if not written yet, and stops the background thread.
+	 */
+	~SnapshotWriter();
+
+	SnapshotWriter(const SnapshotWriter &) = delete;
+	SnapshotWriter & operator=(const SnapshotWriter &) = delete;
+
+	/**
+	 * Hands over a snapshot to the background thread, to be written as soon as possible. A
+	 * snapshot posted before and not yet written is discarded. Never blocks: if the background
+	 * thread is busy handing over a snapshot, the new one is discarded.
+	 * @param records the snapshot; it is swapped with a buffer no longer in use, so that the
+	 * caller can reuse its memory
+	 * @return true if the snapshot has been handed over
+	 */
+	bool post(std::vector<SessionTable::Record> & records);
+};
+
+/**
+ * Maps into memory a snapshot file written by SnapshotWriter and copies out its records.
+ * @param fileName the file
+ * @param records filled with the records read from file
+ * @return true if the file exists and holds a valid snapshot
+ */
+bool loadSnapshot(const std::string & fileName, std::vector<SessionTable::Record> & records);
@@ -0,0 +1,160 @@
+#include "TaskPool.h"
+#include <pthread.h>
+#include <sched.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+namespace {
+
+// Worker the current thread is, if any, to submit tasks to its own deque
+thread_local const TaskPool * currentPool = nullptr;
+thread_local std::size_t currentWorker = 0;
+
+}
+
+TaskPool::TaskPool(std::size_t nWorkers, const std::vector<int> & excludedCpus) :
+		workers(), sleepMutex(), wakeUp(), finished(), nQueued { 0 }, nUnfinished { 0 }, nextWorker { 0 }, stopping {
+				false } {
+	const auto topology = NumaTopology::read();
+	std::vector<int> cpus;
+	for (const auto cpu : topology.cpus())
+		if (std::find(excludedCpus.begin(), excludedCpus.end(), cpu) == excludedCpus.end())
+			cpus.push_back(cpu);
+	if (nWorkers == 0)
+		nWorkers = std::max<std::size_t>(cpus.size(), 1);
+	for (std::size_t i = 0; i < nWorkers; ++i) {
+		workers.emplace_back(new Worker());
+		if (!cpus.empty()) {
+			workers[i]->cpu = cpus[i % cpus.size()];
+			workers[i]->node = topology.nodeOf(workers[i]->cpu);
+		}
+	}
+	// Nearest workers first, by node then by position, which follows the CPU numbers within a node
+	for (std::size_t i = 0; i < nWorkers; ++i) {
+		auto & victims = workers[i]->victims;
+		for (std::size_t j = 0; j < nWorkers; ++j)
+			if (j != i)
+				victims.push_back(j);
+		std::stable_sort(victims.begin(), victims.end(), [this, i](const std::size_t a, const std::size_t b) {
+			const bool aRemote = workers[a]->node != workers[i]->node;
+			const bool bRemote = workers[b]->node != workers[i]->node;
+			if (aRemote != bRemote)
+				return bRemote;
+			return std::labs(static_cast<long>(a) - static_cast<long>(i)) < std::labs(static_cast<long>(b) - static_cast<long>(i));
+		});
+	}
+	for (std::size_t i = 0; i < nWorkers; ++i)
+		workers[i]->thread = std::thread(&TaskPool::run, this, i);
+}
+
+TaskPool::~TaskPool() {
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stopping = true;
+	}
+	wakeUp.notify_all();
+	for (auto & worker : workers)
+		worker->thread.join();
+}
+
+void TaskPool::submit(const Task & task) {
+	++nUnfinished;
+	const auto index = currentPool == this ? currentWorker : nextWorker++ % workers.size();
+	auto & worker = *workers[index];
+	{
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		worker.tasks.push_back(task);
+	}
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		++nQueued;
+	}
+	wakeUp.notify_one();
+}
+
+void TaskPool::wait() {
+	std::unique_lock<std::mutex> lock(sleepMutex);
+	finished.wait(lock, [this] {
+		return nUnfinished.load() == 0;
+	});
+}
+
+bool TaskPool::take(const std::size_t index, Task & task) {
+	auto & worker = *workers[index];
+	{
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		if (!worker.tasks.empty()) {
+			task = std::move(worker.tasks.back());
+			worker.tasks.pop_back();
+			--nQueued;
+			return true;
+		}
+	}
+	for (const auto victimIndex : worker.victims) {
+		auto & victim = *workers[victimIndex];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (victim.tasks.empty())
+			continue;
+		// The oldest task, the one the victim would run last
+		task = std::move(victim.tasks.front());
+		victim.tasks.pop_front();
+		--nQueued;
+		worker.nStolen.fetch_add(1, std::memory_order_relaxed);
+		if (victim.node != worker.node)
+			worker.nRemoteSteals.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+	return false;
+}
+
+void TaskPool::run(const std::size_t index) {
+	auto & worker = *workers[index];
+	currentPool = this;
+	currentWorker = index;
+	if (worker.cpu >= 0) {
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(worker.cpu, &cpus);
+		if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0)
+			std::cerr << "Failed to pin worker " << index << " to CPU " << worker.cpu << std::endl;
+	}
+	// Batch jobs yield to interactive threads, and get longer time slices
+	sched_param param {};
+	pthread_setschedparam(pthread_self(), SCHED_BATCH, &param);
+
+	Task task;
+	while (true) {
+		if (take(index, task)) {
+			task();
+			task = nullptr;
+			worker.nRun.fetch_add(1, std::memory_order_relaxed);
+			if (--nUnfinished == 0) {
+				std::lock_guard<std::mutex> lock(sleepMutex);
+				finished.notify_all();
+			}
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		wakeUp.wait(lock, [this] {
+			return stopping || nQueued.load() > 0;
+		});
+		if (stopping && nQueued.load() <= 0)
+			return;
+	}
+}
+
+std::string TaskPool::stats() const {
+	std::string text = "{\"workers\":[";
+	for (std::size_t i = 0; i < workers.size(); ++i) {
+		const auto & worker = *workers[i];
+		char entry[160];
+		snprintf(entry, sizeof(entry), "%s{\"cpu\":%d,\"node\":%d,\"run\":%llu,\"stolen\":%llu,\"remote_steals\":%llu}",
+				i > 0 ? "," : "", worker.cpu, worker.node, static_cast<unsigned long long>(worker.nRun.load()),
+				static_cast<unsigned long long>(worker.nStolen.load()),
+				static_cast<unsigned long long>(worker.nRemoteSteals.load()));
+		text += entry;
+	}
+	return text + "]}";
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include "Numa.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Work-stealing thread pool, for CPU-heavy jobs off the control path: offline tuning and
+ * batch evaluations, see pidtune and poolbench. Never used by the threads serving vehicles.
+ *
+ * Every worker has a deque of its own. Tasks submitted by a worker go to the back of its
+ * deque, and it takes tasks from the back, while they are hot in its cache; tasks submitted
+ * from outside the pool are spread over the workers. A worker with nothing left steals from
+ * the front of the other deques, those of workers on the same NUMA node first. Workers with
+ * nothing to steal sleep until tasks are submitted.
+ *
+ * Workers are pinned to CPUs node after node, so that a small pool stays on one node, and
+ * run with the SCHED_BATCH policy; CPUs serving vehicles, such as the one given to the event
+ * loop with `--cpu`, can be left out. Deques are locked, which is cheap for tasks of tens of
+ * microseconds or more, as rollouts are.
+ */
+class TaskPool {
+public:
+	using Task = std::function<void()>;
+
+private:
+	struct Worker {
+		std::mutex mutex;  // Guards tasks
+		std::deque<Task> tasks;
+		int cpu { -1 };  // -1 if not pinned
+		int node { 0 };
+		std::vector<std::size_t> victims;  // Other workers, in the order they are stolen from
+		std::atomic<uint64_t> nRun { 0 };
+		std::atomic<uint64_t> nStolen { 0 };  // Tasks of nRun stolen from other workers
+		std::atomic<uint64_t> nRemoteSteals { 0 };  // Tasks of nStolen stolen from other nodes
+		std::thread thread;
+	};
+
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::mutex sleepMutex;
+	std::condition_variable wakeUp;  // Notified when tasks are submitted, or the pool is stopping
+	std::condition_variable finished;  // Notified when no task is left
+	std::atomic<long long> nQueued;  // Tasks in the deques; briefly negative when taken before being counted
+	std::atomic<std::size_t> nUnfinished;  // Tasks submitted and not yet run to completion
+	std::atomic<std::size_t> nextWorker;  // For tasks submitted from outside the pool
+	bool stopping;  // Guarded by sleepMutex
+
+	/**
+	 * Body of the thread of a worker.
+	 */
+	void run(const std::size_t index);
+
+	/**
+	 * Takes a task from the back of the deque of a worker, or steals one from the others.
+	 * @return false if there was none
+	 */
+	bool take(const std::size_t index, Task & task);
+
+public:
+	/**
+	 * Starts the workers.
+	 * @param nWorkers the number of workers; 0 for one per CPU not excluded
+	 * @param excludedCpus CPUs the workers must not run on
+	 */
+	TaskPool(std::size_t nWorkers, const std::vector<int> & excludedCpus);
+
+	/**
+	 * Runs the tasks left, and stops the workers.
+	 */
+	~TaskPool();
+
+	TaskPool(const TaskPool &) = delete;
+	TaskPool & operator=(const TaskPool &) = delete;
+
+	/**
+	 * Submits a task; may be called from any thread, from tasks too.
+	 */
+	void submit(const Task & task);
+
+	/**
+	 * Waits until every task submitted has been run; not to be called from tasks.
+	 */
+	void wait();
+
+	/**
+	 * @return the number of workers
+	 */
+	std::size_t size() const {
+		return workers.size();
+	}
+
+	/**
+	 * @return the CPUs the workers are pinned to, and the tasks they ran and stole, in JSON
+	 * format
+	 */
+	std::string stats() const;
+};
@@ -0,0 +1,233 @@
+#include "TelemetryExtractor.h"
+#include "Numbers.h"
+#include <cstring>
+#include <limits>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+/**
+ * Compares two spans of bytes of the same length, 16 bytes at a time where SSE2 is available.
+ * @return true if the spans are equal
+ */
+bool spanEquals(const char * a, const char * b, std::size_t n) {
+#ifdef __SSE2__
+	while (n >= 16) {
+		const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a));
+		const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) != 0xFFFF)
+			return false;
+		a += 16;
+		b += 16;
+		n -= 16;
+	}
+#endif
+	return memcmp(a, b, n) == 0;
+}
+
+const char * skipWhitespace(const char * p, const char * end) {
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+		++p;
+	return p;
+}
+
+/**
+ * Expects a string without escape sequences starting at p.
+ * @return pointer to the closing quote, nullptr if there is no such string
+ */
+const char * stringEnd(const char * p, const char * end) {
+	if (p == end || *p != '"')
+		return nullptr;
+	for (++p; p < end; ++p)
+		if (*p == '"')
+			return p;
+		else if (*p == '\\')
+			return nullptr;
+	return nullptr;
+}
+
+/**
+ * Checks that the rest of a telemetry frame, from within the data object, closes the object
+ * and then the event array, with nothing else at top level: no further element, such as the
+ * `null` of manual driving, and nothing after the array. Strings, e.g. the camera image, are
+ * skipped with memchr().
+ * @param p position within the data object, outside of strings
+ * @return true if the frame ends as a telemetry frame does
+ */
+bool closesFrame(const char * p, const char * end) {
+	unsigned depth = 0;  // Nesting within the data object
+	for (; p < end; ++p)
+		switch (*p) {
+		case '"': {
+			// Skip to the closing quote, the first one not escaped by an odd number of backslashes
+			bool escaped;
+			do {
+				const auto quote = static_cast<const char *>(memchr(p + 1, '"', end - p - 1));
+				if (quote == nullptr)
+					return false;
+				auto backslashes = quote;
+				while (backslashes[-1] == '\\')
+					--backslashes;
+				escaped = (quote - backslashes) % 2 == 1;
+				p = quote;
+			} while (escaped);
+			break;
+		}
+		case '{':
+		case '[':
+			++depth;
+			break;
+		case ']':
+			if (depth == 0)
+				return false;
+			--depth;
+			break;
+		case '}':
+			if (depth > 0) {
+				--depth;
+				break;
+			}
+			p = skipWhitespace(p + 1, end);
+			if (p == end || *p != ']')
+				return false;
+			return skipWhitespace(p + 1, end) == end;
+		default:
+			break;
+		}
+	return false;
+}
+
+}
+
+bool TelemetryExtractor::extract(const char * data, const std::size_t length, Telemetry & telemetry,
+		double & steeringAngle) const {
+	if (layout.empty())
+		return false;
+	steeringAngle = std::numeric_limits<double>::quiet_NaN();
+	std::size_t pos = 0;
+	for (const auto & segment : layout) {
+		const auto n = segment.literal.size();
+		if (pos + n > length || !spanEquals(data + pos, segment.literal.data(), n))
+			return false;
+		pos += n;
+		auto valueEnd = static_cast<const char *>(memchr(data + pos, segment.terminator, length - pos));
+		if (valueEnd == nullptr)
+			return false;
+		double * value;
+		switch (segment.field) {
+		case Field::cte:
+			value = &telemetry.cte;
+			break;
+		case Field::speed:
+			value = &telemetry.speed;
+			break;
+		case Field::steeringAngle:
+			value = &steeringAngle;
+			break;
+		default:
+			value = nullptr;
+		}
+		if (value != nullptr && !parseDouble(data + pos, valueEnd, *value))
+			return false;
+		pos = valueEnd - data;
+	}
+	// A value in quotes ends at its closing quote
+	if (layout.back().terminator == '"')
+		++pos;
+	return closesFrame(data + pos, data + length);
+}
+
+bool TelemetryExtractor::learn(const char * data, const std::size_t length) {
+	layout.clear();
+	const char * const end = data + length;
+	const char * p = data;
+
+	// Expect 42["telemetry",{
+	if (length < 2 || p[0] != '4' || p[1] != '2')
+		return false;
+	p = skipWhitespace(p + 2, end);
+	if (p == end || *p != '[')
+		return false;
+	p = skipWhitespace(p + 1, end);
+	auto eventEnd = stringEnd(p, end);
+	if (eventEnd == nullptr || eventEnd - p != 10 || memcmp(p, "\"telemetry", 10) != 0)
+		return false;
+	p = skipWhitespace(eventEnd + 1, end);
+	if (p == end || *p != ',')
+		return false;
+	p = skipWhitespace(p + 1, end);
+	if (p == end || *p != '{')
+		return false;
+	++p;
+
+	// Go through the object members until both needed values have been found
+	std::vector<Segment> newLayout;
+	const char * literalBegin = data;
+	bool foundCte { false }, foundSpeed { false };
+	while (!(foundCte && foundSpeed)) {
+		p = skipWhitespace(p, end);
+		auto keyEnd = stringEnd(p, end);
+		if (keyEnd == nullptr)
+			return false;
+		const std::string key(p + 1, keyEnd);
+		p = skipWhitespace(keyEnd + 1, end);
+		if (p == end || *p != ':')
+			return false;
+		p = skipWhitespace(p + 1, end);
+		if (p == end)
+			return false;
+
+		// Values are either strings without escapes, or unquoted numbers or literals
+		const char * valueBegin;
+		const char * valueEnd;
+		if (*p == '"') {
+			valueBegin = p + 1;
+			valueEnd = stringEnd(p, end);
+			if (valueEnd == nullptr)
+				return false;
+			p = valueEnd + 1;
+		} else {
+			valueBegin = p;
+			while (p < end && *p != ',' && *p != '}' && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r') {
+				if (*p == '{' || *p == '[' || *p == '"')
+					return false;
+				++p;
+			}
+			valueEnd = p;
+			if (valueEnd == end || valueBegin == valueEnd)
+				return false;
+		}
+
+		Segment segment;
+		segment.literal.assign(literalBegin, valueBegin);
+		segment.terminator = *valueEnd;
+		segment.field = Field::none;
+		if (key == "cte") {
+			segment.field = Field::cte;
+			foundCte = true;
+		} else if (key == "speed") {
+			segment.field = Field::speed;
+			foundSpeed = true;
+		} else if (key == "steering_angle")
+			segment.field = Field::steeringAngle;
+		// The value must be terminated by a character that can't appear in it
+		if (segment.terminator != '"' && segment.terminator != ',' && segment.terminator != '}')
+			return false;
+		newLayout.push_back(segment);
+		literalBegin = valueEnd;
+
+		p = skipWhitespace(p, end);
+		if (p == end)
+			return false;
+		if (*p == ',')
+			++p;
+		else if (!(foundCte && foundSpeed))
+			return false;
+	}
+
+	// Values after the last needed one, e.g. the camera image, are only skimmed by extract() for the end of the frame
+	layout.swap(newLayout);
+	return true;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include "Messages.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * Fast path to the values of telemetry messages. The simulator sends every telemetry message
+ * with the same keys in the same order; only the values change. After a message has been
+ * handled by the JSON parser, learn() records the text between the values up to the last value
+ * needed; for the following messages, extract() checks that text is still there, comparing it
+ * in blocks of 16 bytes, and reads the values in between, without parsing the message nor
+ * looking up keys. Whatever comes after the last value needed, e.g. the camera image, is only
+ * skimmed for the end of the data object and of the event array, skipping strings with
+ * memchr(), so that frames cut short, or with another element in the array, such as the
+ * `null` of manual driving, go to the scanner. The steering angle is read if it comes before the cross-track error or the speed, as
+ * the simulator sends it.
+ */
+class TelemetryExtractor {
+public:
+	/**
+	 * Values read from telemetry messages.
+	 */
+	enum class Field {
+		none,  // Skipped
+		cte,
+		speed,
+		steeringAngle
+	};
+
+	/**
+	 * Text expected before a value, and where the value goes.
+	 */
+	struct Segment {
+		std::string literal;  // Text preceding the value, up to the value's first character
+		Field field;  // Where the value is stored
+		char terminator;  // Character right after the value
+	};
+
+private:
+	std::vector<Segment> layout;  // Empty until a layout has been learned
+
+public:
+	/**
+	 * Extracts the values from a message laid out as the one learned.
+	 * @param data the message, starting with the Socket.IO event code "42"
+	 * @param length the message length in bytes
+	 * @param telemetry filled with the values in the message, if successful
+	 * @param steeringAngle set to the steering angle in the message, in degrees, if successful;
+	 * NaN if the layout doesn't have it
+	 * @return true if successful; false if no layout has been learned yet, or the message is
+	 * laid out differently, or doesn't end with the data object as the last element of the array
+	 */
+	bool extract(const char * data, const std::size_t length, Telemetry & telemetry, double & steeringAngle) const;
+
+	/**
+	 * Learns the layout of a telemetry message. If the message can't be understood, the
+	 * previous layout is forgotten.
+	 * @param data the message, starting with the Socket.IO event code "42"
+	 * @param length the message length in bytes
+	 * @return true if the layout has been learned
+	 */
+	bool learn(const char * data, const std::size_t length);
+};
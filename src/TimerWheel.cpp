@@ -0,0 +1,137 @@
+#include "TimerWheel.h"
+#include <algorithm>
+#include <cstdio>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+namespace {
+
+const unsigned levelBits = 6;
+const unsigned nSlots = 1 << levelBits;  // Per level
+const unsigned nLevels = 4;
+const uint64_t span = 1ULL << (levelBits * nLevels);  // Ticks covered by the wheel
+
+}
+
+TimerWheel::TimerWheel(const long long tickInit, const uint32_t capacity) :
+		tick { tickInit * 1000 }, nTimers { capacity }, callback(), timerFd { -1 }, timerArmed { false }, nodes(
+				capacity + nLevels * nSlots), current { 0 }, nScheduled { 0 }, nFired { 0 }, nCascaded { 0 } {
+	for (uint32_t i = 0; i < nodes.size(); ++i)
+		nodes[i] = i < nTimers ? Node { none, none, 0 } : Node { i, i, 0 };
+}
+
+TimerWheel::~TimerWheel() {
+	if (timerFd >= 0)
+		close(timerFd);
+}
+
+bool TimerWheel::start(const bool nonBlocking) {
+	timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | (nonBlocking ? TFD_NONBLOCK : 0));
+	if (timerFd < 0)
+		return false;
+	if (nScheduled > 0)
+		setTimer(true);
+	return true;
+}
+
+void TimerWheel::setTimer(const bool armed) {
+	timerArmed = armed;
+	if (timerFd < 0)
+		return;
+	itimerspec spec {};
+	if (armed) {
+		spec.it_value.tv_sec = spec.it_interval.tv_sec = tick / 1000000000;
+		spec.it_value.tv_nsec = spec.it_interval.tv_nsec = tick % 1000000000;
+	}
+	timerfd_settime(timerFd, 0, &spec, nullptr);
+}
+
+void TimerWheel::insert(const uint32_t timer) {
+	auto & node = nodes[timer];
+	// Beyond the wheel, the timer waits in the slot of the top level furthest away
+	const auto delta = std::min(node.expiry - current, span - 1);
+	unsigned level = 0;
+	while (delta >> (levelBits * (level + 1)) != 0)
+		++level;
+	const auto slot = ((current + delta) >> (levelBits * level)) & (nSlots - 1);
+	const uint32_t head = nTimers + level * nSlots + slot;
+	node.prev = nodes[head].prev;
+	node.next = head;
+	nodes[node.prev].next = timer;
+	nodes[head].prev = timer;
+}
+
+void TimerWheel::unlink(const uint32_t timer) {
+	auto & node = nodes[timer];
+	nodes[node.prev].next = node.next;
+	nodes[node.next].prev = node.prev;
+	node.next = none;
+}
+
+void TimerWheel::schedule(const uint32_t timer, const uint64_t delay) {
+	if (scheduled(timer))
+		unlink(timer);
+	else
+		++nScheduled;
+	nodes[timer].expiry = current + std::max<uint64_t>(delay, 1);
+	insert(timer);
+	if (!timerArmed)
+		setTimer(true);
+}
+
+void TimerWheel::cancel(const uint32_t timer) {
+	if (!scheduled(timer))
+		return;
+	unlink(timer);
+	--nScheduled;
+}
+
+void TimerWheel::cascade(const unsigned level) {
+	const uint32_t head = nTimers + level * nSlots + ((current >> (levelBits * level)) & (nSlots - 1));
+	// Timers of the slot are due within the span of a slot of the level below, which is never this slot
+	while (nodes[head].next != head) {
+		const auto timer = nodes[head].next;
+		unlink(timer);
+		insert(timer);
+		++nCascaded;
+	}
+}
+
+void TimerWheel::advance() {
+	++current;
+	// Upper levels first, so that timers move down as far as they have to
+	unsigned nWrapped = 1;
+	while (nWrapped < nLevels && (current & ((1ULL << (levelBits * nWrapped)) - 1)) == 0)
+		++nWrapped;
+	for (auto level = nWrapped - 1; level > 0; --level)
+		cascade(level);
+	const uint32_t head = nTimers + (current & (nSlots - 1));
+	while (nodes[head].next != head) {
+		const auto timer = nodes[head].next;
+		unlink(timer);
+		--nScheduled;
+		++nFired;
+		callback(timer);
+	}
+}
+
+void TimerWheel::onTimer() {
+	uint64_t expirations = 0;
+	if (read(timerFd, &expirations, sizeof(expirations)) == sizeof(expirations))
+		onTicks(expirations);
+}
+
+void TimerWheel::onTicks(const uint64_t expirations) {
+	for (uint64_t i = 0; i < expirations; ++i)
+		advance();
+	if (nScheduled == 0 && timerArmed)
+		setTimer(false);
+}
+
+std::string TimerWheel::stats() const {
+	char text[200];
+	snprintf(text, sizeof(text), "{\"tick_us\":%.3f,\"ticks\":%llu,\"scheduled\":%zu,\"fired\":%llu,\"cascaded\":%llu}",
+			tick / 1e3, static_cast<unsigned long long>(current), nScheduled, static_cast<unsigned long long>(nFired),
+			static_cast<unsigned long long>(nCascaded));
+	return text;
+}
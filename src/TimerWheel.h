@@ -0,0 +1,160 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * Hierarchical timing wheel, for timers of a fixed set, identified by numbers: twiddle
+ * windows and idle timeouts of the sessions, and snapshots. Time advances in ticks, driven by
+ * a timerfd: nothing reads the clock to find out whether a timer is due, and scheduling,
+ * cancelling and firing a timer take constant time, whatever the number of timers.
+ *
+ * The wheel has four levels of 64 slots. Level 0 holds the timers due in the next 64 ticks,
+ * one slot per tick; a slot of level n spans 64^n ticks, and its timers are moved down,
+ * to the levels below, when the ticks of level 0 get to its span. Timers due further than
+ * 64^4 ticks away wait in the top level until they get close enough. Timers of a slot are in
+ * a doubly-linked list, of indices rather than pointers.
+ *
+ * The timer is disarmed at the first tick with no timers left. Must be used by one thread
+ * only, which polls fd() for reading and calls onTimer().
+ */
+class TimerWheel {
+public:
+	/**
+	 * Called when a timer fires, with its number. May schedule and cancel timers, the fired
+	 * one included.
+	 */
+	using Callback = std::function<void(uint32_t timer)>;
+
+private:
+	/**
+	 * A timer, or the head of the list of a slot.
+	 */
+	struct Node {
+		uint32_t prev;
+		uint32_t next;  // `none` if not scheduled
+		uint64_t expiry;  // In ticks
+	};
+
+	static const uint32_t none = UINT32_MAX;
+
+	const long long tick;  // In nanoseconds
+	const uint32_t nTimers;
+	Callback callback;
+	int timerFd;
+	bool timerArmed;
+	std::vector<Node> nodes;  // The timers, then the heads of the slots
+	uint64_t current;  // Ticks elapsed
+	std::size_t nScheduled;
+	uint64_t nFired;
+	uint64_t nCascaded;  // Timers moved down a level
+
+	/**
+	 * Arms or disarms the timer.
+	 */
+	void setTimer(const bool armed);
+
+	/**
+	 * Links a timer to the slot of its expiry.
+	 */
+	void insert(const uint32_t timer);
+
+	void unlink(const uint32_t timer);
+
+	/**
+	 * Moves the timers of a slot of an upper level to the levels below.
+	 */
+	void cascade(const unsigned level);
+
+	/**
+	 * Moves on by one tick, and fires the timers due.
+	 */
+	void advance();
+
+public:
+	/**
+	 * Constructs the wheel, with no timer scheduled.
+	 * @param tickInit the length of a tick, in microseconds
+	 * @param capacity the number of timers; timers are numbered from 0
+	 */
+	TimerWheel(const long long tickInit, const uint32_t capacity);
+
+	~TimerWheel();
+
+	TimerWheel(const TimerWheel &) = delete;
+	TimerWheel & operator=(const TimerWheel &) = delete;
+
+	/**
+	 * Creates the timer; timers may be scheduled before, to be counted from then on.
+	 * @param nonBlocking whether the timer is read without blocking, as for
+	 * ControlScheduler::start()
+	 * @return false on failure
+	 */
+	bool start(const bool nonBlocking);
+
+	/**
+	 * Sets what is called when timers fire.
+	 */
+	void setCallback(const Callback & callbackInit) {
+		callback = callbackInit;
+	}
+
+	/**
+	 * @return the descriptor of the timer, readable when ticks have elapsed; -1 if not started
+	 */
+	int fd() const {
+		return timerFd;
+	}
+
+	/**
+	 * @return the ticks elapsed so far, as a time stamp that costs no clock read
+	 */
+	uint64_t now() const {
+		return current;
+	}
+
+	/**
+	 * @param time in microseconds
+	 * @return the number of ticks in the given time, rounded up
+	 */
+	uint64_t ticks(const long long time) const {
+		return time <= 0 ? 0 : static_cast<uint64_t>((time * 1000 + tick - 1) / tick);
+	}
+
+	/**
+	 * Schedules a timer, or reschedules it if already scheduled.
+	 * @param timer the timer number
+	 * @param delay in ticks from now; at least 1
+	 */
+	void schedule(const uint32_t timer, const uint64_t delay);
+
+	/**
+	 * Cancels a timer; nothing happens if it is not scheduled.
+	 */
+	void cancel(const uint32_t timer);
+
+	/**
+	 * @return whether a timer is scheduled
+	 */
+	bool scheduled(const uint32_t timer) const {
+		return nodes[timer].next != none;
+	}
+
+	/**
+	 * Reads the number of ticks elapsed from the timer, and fires the timers due.
+	 */
+	void onTimer();
+
+	/**
+	 * Moves on by the given number of ticks, and fires the timers due.
+	 */
+	void onTicks(const uint64_t expirations);
+
+	/**
+	 * @return the tick length in microseconds, the number of timers scheduled, fired and
+	 * moved down a level, in JSON format
+	 */
+	std::string stats() const;
+};
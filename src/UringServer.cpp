@@ -0,0 +1,821 @@
+#include "UringServer.h"
+#include "Logger.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <linux/io_uring.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <openssl/evp.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+const unsigned ringEntries = 1024;
+const unsigned nBuffers = 512;  // A power of 2
+const std::size_t bufferSize = 16384;
+const uint16_t bufferGroup = 0;
+const std::size_t maxRequestHeader = 16384;
+const std::size_t maxMessage = 16 * 1024 * 1024;  // Larger WebSocket messages close the connection
+const std::size_t controlSize = CMSG_SPACE(sizeof(timespec));  // Room for the receive timestamp
+
+// Listeners, in the slot of the user data of accept submissions
+const uint32_t webSocketListener = 0;
+const uint32_t adminListener = 1;
+
+const char websocketGuid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+// WebSocket opcodes
+const uint8_t continuationFrame = 0x0;
+const uint8_t textFrame = 0x1;
+const uint8_t binaryFrame = 0x2;
+const uint8_t closeFrame = 0x8;
+const uint8_t pingFrame = 0x9;
+const uint8_t pongFrame = 0xA;
+
+unsigned loadAcquire(const unsigned * p) {
+	return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+void storeRelease(unsigned * p, const unsigned value) {
+	__atomic_store_n(p, value, __ATOMIC_RELEASE);
+}
+
+/**
+ * @return user data for a submission, packing the operation and the connection slot
+ */
+uint64_t userData(const uint64_t operation, const uint32_t slot) {
+	return static_cast<uint64_t>(slot) << 8 | operation;
+}
+
+/**
+ * @return the value of a request header, looked up case-insensitively; empty if none
+ */
+std::string headerValue(const std::string & request, const char * name) {
+	const auto nameLength = strlen(name);
+	for (std::size_t line = request.find("\r\n"); line != std::string::npos; line = request.find("\r\n", line + 2)) {
+		const auto begin = line + 2;
+		if (request.size() - begin > nameLength && request[begin + nameLength] == ':'
+				&& strncasecmp(request.c_str() + begin, name, nameLength) == 0) {
+			auto valueBegin = begin + nameLength + 1;
+			auto valueEnd = request.find("\r\n", valueBegin);
+			while (valueBegin < valueEnd && request[valueBegin] == ' ')
+				++valueBegin;
+			while (valueEnd > valueBegin && request[valueEnd - 1] == ' ')
+				--valueEnd;
+			return request.substr(valueBegin, valueEnd - valueBegin);
+		}
+	}
+	return std::string();
+}
+
+/**
+ * @return the Sec-WebSocket-Accept value for the given Sec-WebSocket-Key
+ */
+std::string acceptKey(const std::string & key) {
+	const auto text = key + websocketGuid;
+	unsigned char digest[EVP_MAX_MD_SIZE];
+	unsigned digestLength = 0;
+	EVP_Digest(text.data(), text.size(), digest, &digestLength, EVP_sha1(), nullptr);
+	unsigned char encoded[4 * ((EVP_MAX_MD_SIZE + 2) / 3) + 1];
+	const int length = EVP_EncodeBlock(encoded, digest, digestLength);
+	return std::string(reinterpret_cast<const char *>(encoded), length);
+}
+
+/**
+ * XORs a WebSocket payload with its masking key, eight bytes at a time.
+ */
+void unmask(char * data, const std::size_t length, const char * key) {
+	uint32_t key32;
+	memcpy(&key32, key, 4);
+	const uint64_t key64 = static_cast<uint64_t>(key32) << 32 | key32;
+	std::size_t i = 0;
+	for (; i + 8 <= length; i += 8) {
+		uint64_t word;
+		memcpy(&word, data + i, 8);
+		word ^= key64;
+		memcpy(data + i, &word, 8);
+	}
+	for (; i < length; ++i)
+		data[i] ^= key[i % 4];
+}
+
+}
+
+struct UringServer::Connection {
+	int fd;
+	Session * session { nullptr };  // nullptr until upgraded to WebSocket
+	bool receiving { false };  // Whether a multishot receive is armed
+	bool sending { false };  // Whether a send is in flight
+	bool closing { false };  // Whether the connection is being closed; further input is ignored
+	bool closeAfterSend { false };  // Whether the connection is to be closed once the queued bytes are sent
+	bool admin { false };  // Whether the connection came to the admin port
+	bool outputPending { false };  // Whether the slot is in pendingOutput
+	std::vector<char> input;  // Received bytes not yet handled
+	std::vector<char> message;  // Payload of a fragmented WebSocket message so far
+	bool messageBinary { false };
+	bool messageCompressed { false };
+	std::unique_ptr<Inflater> inflater;  // nullptr unless permessage-deflate was negotiated
+	std::vector<char> output;  // Bytes queued, not yet submitted
+	std::vector<char> inFlight;  // Bytes being sent
+	std::size_t inFlightSent { 0 };  // Bytes of inFlight already sent
+	std::vector<long long> replyStarts;  // Times at which the messages whose replies are in output were received, in nanoseconds
+	long long receivedAt { 0 };  // Time the kernel received the latest input, on the monotonic clock, in nanoseconds
+	msghdr receiveHeader;  // Layout of the multishot receive: no address, a timestamp, then the payload
+
+	Connection(const int fdInit) :
+			fd { fdInit } {
+		memset(&receiveHeader, 0, sizeof(receiveHeader));
+		receiveHeader.msg_controllen = controlSize;
+	}
+};
+
+UringServer::UringServer(SessionTable & sessionsInit, MessageHandler & handlerInit,
+		const HttpHandler & httpHandlerInit) :
+		sessions(sessionsInit), handler(handlerInit), httpHandler(httpHandlerInit), listenFd { -1 }, adminFd { -1 }, ringFd { -1 },
+		sqHead { nullptr }, sqTail { nullptr }, sqMask { 0 }, sqArray { nullptr }, sqes { nullptr }, sqLocalTail {
+				0 }, sqSubmitted { 0 }, cqHead { nullptr }, cqTail { nullptr }, cqMask { 0 }, cqes { nullptr }, sqRing {
+				MAP_FAILED }, sqRingSize { 0 }, cqRing { MAP_FAILED }, cqRingSize { 0 }, sqesSize { 0 }, bufferRing {
+				nullptr }, bufferRingSize { 0 }, buffers(), bufferTail { 0 }, clockOffset { 0 }, deflate { false }, inflaters(), scheduler { nullptr }, sessionSlots(), timerExpirations(), nFrames { 0 }, nSyscalls { 0 }, nPolls {
+				0 }, nCompressedBytes { 0 }, nInflatedBytes { 0 } {
+	handler.setIdleHandler([this](Session & session) {
+		close(sessionSlots[session.id]);
+	});
+}
+
+UringServer::~UringServer() {
+	for (auto & connection : connections)
+		if (connection)
+			::close(connection->fd);
+	if (listenFd >= 0)
+		::close(listenFd);
+	if (adminFd >= 0)
+		::close(adminFd);
+	if (ringFd >= 0)
+		::close(ringFd);
+	if (sqes != nullptr)
+		munmap(sqes, sqesSize);
+	if (cqRing != MAP_FAILED && cqRing != sqRing)
+		munmap(cqRing, cqRingSize);
+	if (sqRing != MAP_FAILED)
+		munmap(sqRing, sqRingSize);
+	if (bufferRing != nullptr)
+		munmap(bufferRing, bufferRingSize);
+}
+
+bool UringServer::setUpRing() {
+	io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	// Room for the completions of many multishot operations between two calls
+	params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_COOP_TASKRUN;
+	params.cq_entries = 8 * ringEntries;
+	ringFd = syscall(__NR_io_uring_setup, ringEntries, &params);
+	if (ringFd < 0 && errno == EINVAL) {
+		// Kernels before 6.0 don't know the last two flags
+		params.flags = IORING_SETUP_CQSIZE;
+		ringFd = syscall(__NR_io_uring_setup, ringEntries, &params);
+	}
+	if (ringFd < 0)
+		return false;
+
+	sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	const bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (singleMmap)
+		sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+	sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+	if (sqRing == MAP_FAILED)
+		return false;
+	cqRing = singleMmap ? sqRing : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			ringFd, IORING_OFF_CQ_RING);
+	if (cqRing == MAP_FAILED)
+		return false;
+	sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+	void * sqesMapping = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd,
+			IORING_OFF_SQES);
+	if (sqesMapping == MAP_FAILED)
+		return false;
+	sqes = static_cast<io_uring_sqe *>(sqesMapping);
+
+	auto sq = static_cast<char *>(sqRing);
+	sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+	sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+	sqMask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+	sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+	sqLocalTail = sqSubmitted = *sqTail;
+	auto cq = static_cast<char *>(cqRing);
+	cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+	cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+	cqMask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+	cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+	return true;
+}
+
+bool UringServer::setUpBuffers() {
+	bufferRingSize = nBuffers * sizeof(io_uring_buf);
+	void * ring = mmap(nullptr, bufferRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ring == MAP_FAILED)
+		return false;
+	bufferRing = static_cast<io_uring_buf_ring *>(ring);
+	buffers.reset(new char[nBuffers * bufferSize]);
+
+	io_uring_buf_reg registration;
+	memset(&registration, 0, sizeof(registration));
+	registration.ring_addr = reinterpret_cast<uint64_t>(bufferRing);
+	registration.ring_entries = nBuffers;
+	registration.bgid = bufferGroup;
+	if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PBUF_RING, &registration, 1) != 0)
+		return false;
+
+	for (uint16_t i = 0; i < nBuffers; ++i)
+		provideBuffer(i);
+	return true;
+}
+
+void UringServer::provideBuffer(const uint16_t id) {
+	/*
+	 * Entries are addressed from the start of the ring: in C++, the kernel header declares
+	 * `bufs` after an empty struct that takes room, unlike in C.
+	 */
+	auto & buffer = reinterpret_cast<io_uring_buf *>(bufferRing)[bufferTail & (nBuffers - 1)];
+	buffer.addr = reinterpret_cast<uint64_t>(buffers.get() + id * bufferSize);
+	buffer.len = bufferSize;
+	buffer.bid = id;
+	++bufferTail;
+	__atomic_store_n(&bufferRing->tail, bufferTail, __ATOMIC_RELEASE);
+}
+
+bool UringServer::listen(const int port) {
+	if (!setUpRing() || !setUpBuffers())
+		return false;
+	listenFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (listenFd < 0)
+		return false;
+	const int enable = 1;
+	setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(port);
+	return bind(listenFd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0 && ::listen(listenFd, 512) == 0;
+}
+
+bool UringServer::listenAdmin(const int port) {
+	adminFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (adminFd < 0)
+		return false;
+	const int enable = 1;
+	setsockopt(adminFd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = htons(port);
+	return bind(adminFd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0 && ::listen(adminFd, 16) == 0;
+}
+
+io_uring_sqe * UringServer::getSqe() {
+	if (sqLocalTail - loadAcquire(sqHead) > sqMask)
+		submit(0);
+	const auto index = sqLocalTail & sqMask;
+	auto sqe = &sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	sqArray[index] = index;
+	++sqLocalTail;
+	return sqe;
+}
+
+bool UringServer::submit(const unsigned minComplete) {
+	storeRelease(sqTail, sqLocalTail);
+	const unsigned toSubmit = sqLocalTail - sqSubmitted;
+	sqSubmitted = sqLocalTail;
+	++nSyscalls;
+	const auto result = syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete,
+			minComplete > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+	return result >= 0 || errno == EINTR || errno == EAGAIN || errno == EBUSY;
+}
+
+bool UringServer::wait(const unsigned minComplete) {
+	const auto busyPoll = handler.busyPoll();
+	bool success { true };
+	if (busyPoll > 0) {
+		if (sqLocalTail != sqSubmitted && !submit(0))
+			return false;
+		// Completions may need the kernel to run deferred work before they show up, hence the system calls
+		const auto deadline = LatencyHistogram::now() + busyPoll * 1000;
+		bool completed { false };
+		do {
+			if (loadAcquire(cqTail) - *cqHead >= minComplete) {
+				completed = true;
+				break;
+			}
+			++nPolls;
+			const auto result = syscall(__NR_io_uring_enter, ringFd, 0, 0, IORING_ENTER_GETEVENTS, nullptr, 0);
+			if (result < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+				return false;
+		} while (LatencyHistogram::now() < deadline);
+		if (!completed)
+			success = submit(minComplete);
+	} else
+		success = submit(minComplete);
+	// Receive timestamps are on the real-time clock; latency is measured on the monotonic one
+	timespec realTime;
+	clock_gettime(CLOCK_REALTIME, &realTime);
+	clockOffset = realTime.tv_sec * 1000000000LL + realTime.tv_nsec - LatencyHistogram::now();
+	return success;
+}
+
+void UringServer::armAccept(const uint32_t listener) {
+	auto sqe = getSqe();
+	sqe->opcode = IORING_OP_ACCEPT;
+	sqe->fd = listener == adminListener ? adminFd : listenFd;
+	sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+	sqe->accept_flags = SOCK_CLOEXEC;
+	sqe->user_data = userData(static_cast<uint64_t>(Operation::accept), listener);
+}
+
+void UringServer::armTimer(const uint32_t timer) {
+	auto sqe = getSqe();
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = timer == 0 ? scheduler->fd() : handler.timers().fd();
+	sqe->addr = reinterpret_cast<uint64_t>(&timerExpirations[timer]);
+	sqe->len = sizeof(timerExpirations[timer]);
+	sqe->user_data = userData(static_cast<uint64_t>(Operation::timer), timer);
+}
+
+void UringServer::armReceive(const uint32_t slot) {
+	auto & connection = *connections[slot];
+	auto sqe = getSqe();
+	sqe->opcode = IORING_OP_RECVMSG;
+	sqe->fd = connection.fd;
+	sqe->addr = reinterpret_cast<uint64_t>(&connection.receiveHeader);
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = bufferGroup;
+	sqe->user_data = userData(static_cast<uint64_t>(Operation::receive), slot);
+	connection.receiving = true;
+}
+
+void UringServer::armSend(const uint32_t slot) {
+	auto & connection = *connections[slot];
+	auto sqe = getSqe();
+	sqe->opcode = IORING_OP_SEND;
+	sqe->fd = connection.fd;
+	sqe->addr = reinterpret_cast<uint64_t>(connection.inFlight.data() + connection.inFlightSent);
+	sqe->len = connection.inFlight.size() - connection.inFlightSent;
+	// With MSG_WAITALL, short sends are retried by the kernel
+	sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+	sqe->user_data = userData(static_cast<uint64_t>(Operation::send), slot);
+	connection.sending = true;
+}
+
+void UringServer::setScheduler(ControlScheduler & schedulerInit) {
+	scheduler = &schedulerInit;
+	scheduler->setTask([this](Session & session) {
+		onTick(session);
+	});
+}
+
+void UringServer::run() {
+	armAccept(webSocketListener);
+	if (adminFd >= 0)
+		armAccept(adminListener);
+	if (scheduler != nullptr)
+		armTimer(0);
+	if (handler.timers().fd() >= 0)
+		armTimer(1);
+	unsigned nQuietSends = 0;
+	/*
+	 * Sends usually complete right when submitted; waiting for their completions on top of one
+	 * more event spares a system call just to collect them.
+	 */
+	while (wait(1 + nQuietSends)) {
+		unsigned head = *cqHead;
+		const unsigned tail = loadAcquire(cqTail);
+		for (; head != tail; ++head) {
+			const auto & cqe = cqes[head & cqMask];
+			const auto operation = static_cast<Operation>(cqe.user_data & 0xFF);
+			const auto slot = static_cast<uint32_t>(cqe.user_data >> 8);
+			switch (operation) {
+			case Operation::accept:
+				onAccept(slot, cqe.res, cqe.flags);
+				break;
+			case Operation::receive:
+				onReceive(slot, cqe.res, cqe.flags);
+				break;
+			case Operation::send:
+				onSend(slot, cqe.res);
+				break;
+			case Operation::timer:
+				onTimer(slot, cqe.res);
+				break;
+			}
+		}
+		storeRelease(cqHead, head);
+		nQuietSends = flush();
+	}
+}
+
+void UringServer::onAccept(const uint32_t listener, const int result, const uint32_t flags) {
+	if ((flags & IORING_CQE_F_MORE) == 0)
+		armAccept(listener);
+	if (result < 0)
+		return;
+	const int enable = 1;
+	setsockopt(result, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+	setsockopt(result, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable));
+	nSyscalls += 2;
+	uint32_t slot;
+	if (freeSlots.empty()) {
+		slot = connections.size();
+		connections.emplace_back();
+	} else {
+		slot = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	connections[slot].reset(new Connection(result));
+	connections[slot]->admin = listener == adminListener;
+	armReceive(slot);
+}
+
+void UringServer::onReceive(const uint32_t slot, const int result, const uint32_t flags) {
+	auto & connection = *connections[slot];
+	if ((flags & IORING_CQE_F_MORE) == 0)
+		connection.receiving = false;
+	// Bytes of payload received; 0 when the peer has closed the connection
+	long long length = result;
+	if ((flags & IORING_CQE_F_BUFFER) != 0) {
+		const uint16_t bufferId = flags >> IORING_CQE_BUFFER_SHIFT;
+		char * buffer = buffers.get() + bufferId * bufferSize;
+		if (result > 0) {
+			// The buffer holds a header, room for the control messages, then the payload
+			const auto header = reinterpret_cast<io_uring_recvmsg_out *>(buffer);
+			length = header->payloadlen;
+			const char * data = buffer + sizeof(*header) + controlSize;
+			if (length > 0 && !connection.closing)
+				connection.input.insert(connection.input.end(), data, data + length);
+			connection.receivedAt = LatencyHistogram::now();
+			msghdr received;
+			memset(&received, 0, sizeof(received));
+			received.msg_control = buffer + sizeof(*header);
+			received.msg_controllen = header->controllen;
+			for (auto cmsg = CMSG_FIRSTHDR(&received); cmsg != nullptr; cmsg = CMSG_NXTHDR(&received, cmsg))
+				if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+					timespec stamp;
+					memcpy(&stamp, CMSG_DATA(cmsg), sizeof(stamp));
+					connection.receivedAt = std::min(connection.receivedAt,
+							stamp.tv_sec * 1000000000LL + stamp.tv_nsec - clockOffset);
+				}
+		}
+		provideBuffer(bufferId);
+	}
+	if (length > 0) {
+		if (!connection.closing)
+			onData(slot);
+		if (!connection.receiving && !connection.closing)
+			armReceive(slot);
+	} else if (result == -ENOBUFS && !connection.closing)
+		// Ran out of buffers, the connection will be read once some are given back
+		armReceive(slot);
+	else
+		close(slot);
+	if (connection.closing)
+		release(slot);
+}
+
+void UringServer::onSend(const uint32_t slot, const int result) {
+	auto & connection = *connections[slot];
+	connection.sending = false;
+	if (result < 0) {
+		close(slot);
+		release(slot);
+		return;
+	}
+	connection.inFlightSent += result;
+	if (connection.inFlightSent < connection.inFlight.size()) {
+		armSend(slot);
+		return;
+	}
+	connection.inFlight.clear();
+	connection.inFlightSent = 0;
+	if (!connection.output.empty() && !connection.outputPending) {
+		// Queued while the send was in flight
+		connection.outputPending = true;
+		pendingOutput.push_back(slot);
+	} else if (connection.output.empty() && connection.closeAfterSend)
+		close(slot);
+	if (connection.closing)
+		release(slot);
+}
+
+void UringServer::onTimer(const uint32_t timer, const int result) {
+	if (result == sizeof(timerExpirations[timer])) {
+		if (timer == 0)
+			scheduler->onTicks(timerExpirations[timer]);
+		else
+			handler.timers().onTicks(timerExpirations[timer]);
+	}
+	armTimer(timer);
+}
+
+void UringServer::onTick(Session & session) {
+	const auto slot = sessionSlots[session.id];
+	auto & connection = *connections[slot];
+	const auto backlog = connection.output.size() + connection.inFlight.size() - connection.inFlightSent;
+	if (connection.closing || handler.admission().shed(session, backlog))
+		return;
+	const auto reply = handler.tick(session);
+	if (reply.data != nullptr)
+		// Sent with the next batch of submissions
+		queueFrame(slot, reply.binary ? binaryFrame : textFrame, reply.data, reply.length);
+}
+
+void UringServer::onData(const uint32_t slot) {
+	auto & connection = *connections[slot];
+	if (connection.session == nullptr) {
+		while (!connection.closing && connection.session == nullptr && onHttpRequest(slot))
+			;
+		if (connection.session == nullptr || connection.closing)
+			return;
+	}
+
+	auto & input = connection.input;
+	std::size_t position = 0;
+	while (!connection.closing && !connection.closeAfterSend) {
+		const std::size_t available = input.size() - position;
+		if (available < 2)
+			break;
+		const auto frame = reinterpret_cast<uint8_t *>(input.data() + position);
+		const bool fin = (frame[0] & 0x80) != 0;
+		const bool compressed = (frame[0] & 0x40) != 0;
+		const uint8_t opCode = frame[0] & 0x0F;
+		// Only the first frame of a data message may be flagged as compressed, and only if negotiated
+		if ((frame[0] & 0x30) != 0
+				|| (compressed && (!connection.inflater || (opCode != textFrame && opCode != binaryFrame)))) {
+			close(slot);
+			return;
+		}
+		const bool masked = (frame[1] & 0x80) != 0;
+		uint64_t length = frame[1] & 0x7F;
+		std::size_t headerLength = 2;
+		if (length == 126) {
+			if (available < 4)
+				break;
+			length = static_cast<uint64_t>(frame[2]) << 8 | frame[3];
+			headerLength = 4;
+		} else if (length == 127) {
+			if (available < 10)
+				break;
+			length = 0;
+			for (int i = 2; i < 10; ++i)
+				length = length << 8 | frame[i];
+			headerLength = 10;
+		}
+		// Frames from clients must be masked
+		if (!masked || length > maxMessage) {
+			close(slot);
+			return;
+		}
+		headerLength += 4;
+		if (available < headerLength + length)
+			break;
+		char * payload = input.data() + position + headerLength;
+		unmask(payload, length, payload - 4);
+		position += headerLength + length;
+		++nFrames;
+
+		switch (opCode) {
+		case textFrame:
+		case binaryFrame:
+			if (fin && connection.message.empty()) {
+				if (!compressed)
+					onMessage(slot, payload, length, opCode == binaryFrame);
+				else if (!onCompressedMessage(slot, payload, length, opCode == binaryFrame))
+					return;
+			} else {
+				connection.message.assign(payload, payload + length);
+				connection.messageBinary = opCode == binaryFrame;
+				connection.messageCompressed = compressed;
+			}
+			break;
+		case continuationFrame:
+			if (connection.message.size() + length > maxMessage) {
+				close(slot);
+				return;
+			}
+			connection.message.insert(connection.message.end(), payload, payload + length);
+			if (fin) {
+				if (!connection.messageCompressed)
+					onMessage(slot, connection.message.data(), connection.message.size(), connection.messageBinary);
+				else if (!onCompressedMessage(slot, connection.message.data(), connection.message.size(),
+						connection.messageBinary))
+					return;
+				connection.message.clear();
+			}
+			break;
+		case closeFrame:
+			// Echo the status code, then close
+			queueFrame(slot, closeFrame, payload, std::min<uint64_t>(length, 2));
+			connection.closeAfterSend = true;
+			break;
+		case pingFrame:
+			queueFrame(slot, pongFrame, payload, length);
+			break;
+		case pongFrame:
+			break;
+		default:
+			close(slot);
+			return;
+		}
+	}
+	input.erase(input.begin(), input.begin() + position);
+}
+
+bool UringServer::onHttpRequest(const uint32_t slot) {
+	auto & connection = *connections[slot];
+	auto & input = connection.input;
+	static const char terminator[] = "\r\n\r\n";
+	const auto end = std::search(input.begin(), input.end(), terminator, terminator + 4);
+	if (end == input.end()) {
+		if (input.size() > maxRequestHeader)
+			close(slot);
+		return false;
+	}
+	const std::string request(input.begin(), end + 2);
+	input.erase(input.begin(), end + 4);
+
+	const auto urlBegin = request.find(' ');
+	const auto urlEnd = urlBegin == std::string::npos ? urlBegin : request.find(' ', urlBegin + 1);
+	if (urlEnd == std::string::npos) {
+		close(slot);
+		return false;
+	}
+	const auto url = request.substr(urlBegin + 1, urlEnd - urlBegin - 1);
+
+	const auto key = headerValue(request, "Sec-WebSocket-Key");
+	if (!connection.admin && strcasecmp(headerValue(request, "Upgrade").c_str(), "websocket") == 0 && !key.empty()) {
+		connection.session = handler.admission().admit(sessions);
+		if (connection.session == nullptr) {
+			static const char refusal[] = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\n\r\n";
+			queue(slot, refusal, sizeof(refusal) - 1);
+			connection.closeAfterSend = true;
+			return false;
+		}
+		auto reply = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+				"Sec-WebSocket-Accept: " + acceptKey(key) + "\r\n";
+		int windowBits;
+		const auto extensions = deflate ? negotiateDeflate(headerValue(request, "Sec-WebSocket-Extensions"), windowBits) : "";
+		if (!extensions.empty()) {
+			reply += "Sec-WebSocket-Extensions: " + extensions + "\r\n";
+			connection.inflater = inflaters.acquire(windowBits);
+		}
+		reply += "\r\n";
+		queue(slot, reply.data(), reply.size());
+		Logger::log(LogEvent::connected, connection.session->id);
+		if (connection.session->id >= sessionSlots.size())
+			sessionSlots.resize(connection.session->id + 1);
+		sessionSlots[connection.session->id] = slot;
+		handler.onOpen(*connection.session);
+		if (scheduler != nullptr)
+			scheduler->add(*connection.session);
+		return true;
+	}
+
+	const auto body = connection.admin && url.compare(0, 12, "/admin/stats") == 0 ?
+			stats() : httpHandler(request.substr(0, urlBegin), url, connection.admin);
+	const auto reply = "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+	queue(slot, reply.data(), reply.size());
+	return true;
+}
+
+bool UringServer::onCompressedMessage(const uint32_t slot, const char * data, const std::size_t length,
+		const bool binary) {
+	auto & inflater = *connections[slot]->inflater;
+	if (!inflater.inflate(data, length, maxMessage)) {
+		close(slot);
+		return false;
+	}
+	nCompressedBytes += length;
+	nInflatedBytes += inflater.length();
+	onMessage(slot, inflater.data(), inflater.length(), binary);
+	return true;
+}
+
+void UringServer::onMessage(const uint32_t slot, const char * data, const std::size_t length, const bool binary) {
+	auto & connection = *connections[slot];
+	const auto start = connection.receivedAt;
+	const auto backlog = connection.output.size() + connection.inFlight.size() - connection.inFlightSent;
+	if (handler.admission().shed(*connection.session, backlog, data, length, binary))
+		return;
+	// LatencyHistogram::now() and LatencyEstimator::getCurrentTimestamp() read the same clock
+	const auto reply = handler.handle(*connection.session, data, length, binary, start / 1000);
+	if (reply.data == nullptr)
+		return;
+	queueFrame(slot, reply.binary ? binaryFrame : textFrame, reply.data, reply.length);
+	connection.replyStarts.push_back(start);
+	// Sent with the next batch of submissions
+	if (reply.control)
+		connection.session->latency.onSend(LatencyEstimator::getCurrentTimestamp());
+}
+
+void UringServer::queue(const uint32_t slot, const char * data, const std::size_t length) {
+	auto & connection = *connections[slot];
+	connection.output.insert(connection.output.end(), data, data + length);
+	if (!connection.outputPending) {
+		connection.outputPending = true;
+		pendingOutput.push_back(slot);
+	}
+}
+
+void UringServer::queueFrame(const uint32_t slot, const uint8_t opCode, const char * data, const std::size_t length) {
+	char header[10];
+	std::size_t headerLength;
+	header[0] = static_cast<char>(0x80 | opCode);
+	if (length < 126) {
+		header[1] = static_cast<char>(length);
+		headerLength = 2;
+	} else if (length <= 0xFFFF) {
+		header[1] = 126;
+		header[2] = static_cast<char>(length >> 8);
+		header[3] = static_cast<char>(length);
+		headerLength = 4;
+	} else {
+		header[1] = 127;
+		for (int i = 0; i < 8; ++i)
+			header[2 + i] = static_cast<char>(static_cast<uint64_t>(length) >> (56 - 8 * i));
+		headerLength = 10;
+	}
+	queue(slot, header, headerLength);
+	queue(slot, data, length);
+}
+
+unsigned UringServer::flush() {
+	unsigned nQuietSends = 0;
+	const auto now = LatencyHistogram::now();
+	for (const auto slot : pendingOutput) {
+		auto & connection = *connections[slot];
+		connection.outputPending = false;
+		if (connection.sending || connection.closing || connection.output.empty())
+			continue;
+		connection.inFlight.swap(connection.output);
+		connection.inFlightSent = 0;
+		armSend(slot);
+		// The sends are submitted right after
+		for (const auto start : connection.replyStarts)
+			handler.replyLatency().record(now - start);
+		connection.replyStarts.clear();
+		nQuietSends += !connection.closeAfterSend;
+	}
+	pendingOutput.clear();
+	return nQuietSends;
+}
+
+void UringServer::close(const uint32_t slot) {
+	auto & connection = *connections[slot];
+	if (connection.closing)
+		return;
+	connection.closing = true;
+	if (connection.session != nullptr) {
+		Logger::log(LogEvent::disconnected, connection.session->id);
+		if (scheduler != nullptr)
+			scheduler->remove(*connection.session);
+		handler.onClose(*connection.session);
+		sessions.release(connection.session);
+		connection.session = nullptr;
+	}
+	// Ends the multishot receive; the descriptor is closed once no operation is in flight
+	shutdown(connection.fd, SHUT_RDWR);
+	++nSyscalls;
+}
+
+void UringServer::release(const uint32_t slot) {
+	auto & connection = *connections[slot];
+	if (!connection.closing || connection.receiving || connection.sending)
+		return;
+	::close(connection.fd);
+	++nSyscalls;
+	if (connection.outputPending)
+		pendingOutput.erase(std::find(pendingOutput.begin(), pendingOutput.end(), slot));
+	inflaters.release(std::move(connection.inflater));
+	connections[slot].reset();
+	freeSlots.push_back(slot);
+}
+
+std::string UringServer::stats() const {
+	std::size_t nConnections = 0;
+	for (const auto & connection : connections)
+		nConnections += connection != nullptr;
+	char text[300];
+	snprintf(text, sizeof(text),
+			"{\"connections\":%zu,\"frames\":%llu,\"syscalls\":%llu,\"syscalls_per_frame\":%.4f,\"polls\":%llu,"
+					"\"compressed_bytes\":%llu,\"inflated_bytes\":%llu}", nConnections,
+			static_cast<unsigned long long>(nFrames), static_cast<unsigned long long>(nSyscalls),
+			nFrames > 0 ? static_cast<double>(nSyscalls) / nFrames : 0., static_cast<unsigned long long>(nPolls),
+			static_cast<unsigned long long>(nCompressedBytes), static_cast<unsigned long long>(nInflatedBytes));
+	return text;
+}
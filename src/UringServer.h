@@ -0,0 +1,252 @@
+#pragma once
+#include "ControlScheduler.h"
+#include "Inflater.h"
+#include "MessageHandler.h"
+#include "Session.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Network backend built on io_uring, an alternative to uWS and libuv selected at build time
+ * (CMake option IO_URING). It serves the same protocols on the same port: WebSocket
+ * connections, whose messages go to a MessageHandler, and plain HTTP requests, such as those
+ * to the admin endpoint.
+ *
+ * One thread runs the event loop. Connections are accepted by a multishot accept, and read
+ * by a multishot receive per connection, into buffers the kernel picks from a ring of
+ * buffers registered with it. Every receive comes with the time the kernel received the
+ * data (SO_TIMESTAMPNS), from which reply latency is measured, so that it includes the time
+ * the event loop took to wake up. Replies produced while going through a batch of completions
+ * are queued, and their sends submitted together with the wait for the next batch: under
+ * load, a single io_uring_enter() call serves many frames.
+ *
+ * The io_uring interface is used through its system calls directly; it requires Linux 6.0
+ * or later.
+ */
+class UringServer {
+public:
+	/**
+	 * Handles a plain HTTP request, given its method, its URL, and whether it came to the admin
+	 * port, and returns the body of the reply.
+	 */
+	using HttpHandler = std::function<std::string(const std::string & method, const std::string & url, const bool admin)>;
+
+private:
+	struct Connection;
+
+	/**
+	 * User data of submissions, telling what a completion is for.
+	 */
+	enum class Operation : uint64_t {
+		accept, receive, send, timer
+	};
+
+	SessionTable & sessions;
+	MessageHandler & handler;
+	HttpHandler httpHandler;
+	int listenFd;
+	int adminFd;  // Admin port, on the loopback interface; -1 if none
+	int ringFd;
+
+	// Submission queue, mapped from the kernel
+	unsigned * sqHead;
+	unsigned * sqTail;
+	unsigned sqMask;
+	unsigned * sqArray;
+	struct io_uring_sqe * sqes;
+	unsigned sqLocalTail;  // Tail including the entries not yet published to the kernel
+	unsigned sqSubmitted;  // Tail as of the latest io_uring_enter() call
+
+	// Completion queue, mapped from the kernel
+	unsigned * cqHead;
+	unsigned * cqTail;
+	unsigned cqMask;
+	struct io_uring_cqe * cqes;
+
+	void * sqRing;
+	std::size_t sqRingSize;
+	void * cqRing;
+	std::size_t cqRingSize;
+	std::size_t sqesSize;
+
+	// Receive buffers, registered with the kernel as a buffer ring
+	struct io_uring_buf_ring * bufferRing;
+	std::size_t bufferRingSize;
+	std::unique_ptr<char[]> buffers;
+	uint16_t bufferTail;
+
+	long long clockOffset;  // Real-time clock minus monotonic clock, in nanoseconds, as of the latest wait
+	bool deflate;  // Whether permessage-deflate is accepted
+	InflaterPool inflaters;
+	ControlScheduler * scheduler;  // nullptr unless control values are sent at a fixed rate
+	std::vector<uint32_t> sessionSlots;  // Connection slot of every session, indexed by session id
+	uint64_t timerExpirations[2];  // Read from the timers, see armTimer()
+
+	std::vector<std::unique_ptr<Connection>> connections;  // Indexed by slot; nullptr for free slots
+	std::vector<uint32_t> freeSlots;
+	std::vector<uint32_t> pendingOutput;  // Slots of connections with replies queued but not yet submitted
+
+	uint64_t nFrames;  // WebSocket frames received
+	uint64_t nSyscalls;  // System calls made by the event loop, except busy polling
+	uint64_t nPolls;  // System calls made while busy polling
+	uint64_t nCompressedBytes;  // Payload bytes of compressed messages received
+	uint64_t nInflatedBytes;  // Payload bytes of compressed messages received, once decompressed
+
+	bool setUpRing();
+	bool setUpBuffers();
+
+	/**
+	 * Gives a receive buffer to the kernel, to be picked by a multishot receive.
+	 */
+	void provideBuffer(const uint16_t id);
+
+	/**
+	 * @return a submission queue entry, cleared; the queue is submitted first if full
+	 */
+	struct io_uring_sqe * getSqe();
+
+	/**
+	 * Submits the queued entries, and waits for at least `minComplete` completions.
+	 * @return false on unexpected errors
+	 */
+	bool submit(const unsigned minComplete);
+
+	/**
+	 * Submits the queued entries, and waits for at least `minComplete` completions; if the
+	 * configuration has a busy polling time, polls for them first, without sleeping, trading
+	 * CPU for latency: waking up from sleep takes the scheduler several microseconds, more
+	 * under load.
+	 * @return false on unexpected errors
+	 */
+	bool wait(const unsigned minComplete);
+
+	void armAccept(const uint32_t listener);
+	/**
+	 * Reads a timer: 0 for the scheduler, 1 for the timers of the message handler.
+	 */
+	void armTimer(const uint32_t timer);
+	void armReceive(const uint32_t slot);
+	void onAccept(const uint32_t listener, const int result, const uint32_t flags);
+	void onReceive(const uint32_t slot, const int result, const uint32_t flags);
+	void onSend(const uint32_t slot, const int result);
+	void onTimer(const uint32_t timer, const int result);
+
+	/**
+	 * Sends the control values of a vehicle, when due.
+	 */
+	void onTick(Session & session);
+
+	/**
+	 * Handles the HTTP requests, and once upgraded the WebSocket frames, in the connection
+	 * input.
+	 */
+	void onData(const uint32_t slot);
+
+	/**
+	 * Handles one HTTP request at the beginning of the connection input.
+	 * @return false if the request is incomplete, or the connection is closing
+	 */
+	bool onHttpRequest(const uint32_t slot);
+
+	/**
+	 * Decompresses a complete WebSocket message, and handles it.
+	 * @return false if the message is corrupt, and the connection was closed
+	 */
+	bool onCompressedMessage(const uint32_t slot, const char * data, const std::size_t length, const bool binary);
+
+	/**
+	 * Handles a complete WebSocket message.
+	 */
+	void onMessage(const uint32_t slot, const char * data, const std::size_t length, const bool binary);
+
+	/**
+	 * Queues bytes to be sent; they are submitted by flush().
+	 */
+	void queue(const uint32_t slot, const char * data, const std::size_t length);
+
+	/**
+	 * Queues a WebSocket frame.
+	 */
+	void queueFrame(const uint32_t slot, const uint8_t opCode, const char * data, const std::size_t length);
+
+	/**
+	 * Submits a send for the queued bytes of every connection that has no send in flight.
+	 * @return the number of sends submitted whose completion calls for no further action,
+	 * unless other events happen in the meantime
+	 */
+	unsigned flush();
+
+	/**
+	 * Starts a send of the bytes of the connection output not yet sent.
+	 */
+	void armSend(const uint32_t slot);
+
+	/**
+	 * Closes a connection, dropping the bytes not yet sent, and gives back its session.
+	 */
+	void close(const uint32_t slot);
+
+	/**
+	 * Releases the connection slot once it has no operation in flight.
+	 */
+	void release(const uint32_t slot);
+
+	/**
+	 * @return the statistics, in JSON format
+	 */
+	std::string stats() const;
+
+public:
+	/**
+	 * Constructs the server.
+	 * @param sessionsInit sessions for the WebSocket connections
+	 * @param handlerInit handles the WebSocket messages
+	 * @param httpHandlerInit handles plain HTTP requests, except `/admin/stats` to the admin
+	 * port, which returns the server statistics
+	 */
+	UringServer(SessionTable & sessionsInit, MessageHandler & handlerInit, const HttpHandler & httpHandlerInit);
+
+	~UringServer();
+
+	UringServer(const UringServer &) = delete;
+	UringServer & operator=(const UringServer &) = delete;
+
+	/**
+	 * Sets up the io_uring instance, and starts listening on the given port.
+	 * @return true if successful
+	 */
+	bool listen(const int port);
+
+	/**
+	 * Starts listening for plain HTTP requests to the admin endpoint on the given port of the
+	 * loopback interface, so that only processes on the host can reach it; requests to
+	 * `/admin/` on the WebSocket port are refused.
+	 * @return true if successful
+	 */
+	bool listenAdmin(const int port);
+
+	/**
+	 * Accepts permessage-deflate from clients that offer it: their messages may then come
+	 * compressed, while replies are always sent uncompressed, as they are too small to gain
+	 * from it. Decompression state is pooled, and reused from closed connections.
+	 */
+	void setDeflate(const bool enable) {
+		deflate = enable;
+	}
+
+	/**
+	 * Makes the control values of every connection be sent when the scheduler says so, rather
+	 * than in reply to telemetry; the message handler has to be set to fixed rate as well.
+	 * @param schedulerInit the scheduler, started; its timer is read by the event loop
+	 */
+	void setScheduler(ControlScheduler & schedulerInit);
+
+	/**
+	 * Runs the event loop; returns only on unexpected errors.
+	 */
+	void run();
+};
@@ -0,0 +1,171 @@
+#include "Inflater.h"
+#include "Messages.h"
+#include <zlib.h>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+namespace {
+
+const std::size_t imageSize = 12000;  // Bytes of JPEG data in a camera image of the simulator, about
+const unsigned syntheticFrames = 2000;
+
+/**
+ * @return the length of the header of a WebSocket frame, masked if sent by a client
+ */
+std::size_t frameHeaderLength(const std::size_t payloadLength, const bool fromClient) {
+	return (payloadLength < 126 ? 2 : payloadLength <= 0xFFFF ? 4 : 10) + (fromClient ? 4 : 0);
+}
+
+/**
+ * @return telemetry messages as the simulator sends them, driving along a smooth path, with a
+ * camera image of incompressible data in base64, as JPEG data is
+ */
+std::vector<std::string> syntheticTelemetry() {
+	static const char base64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	std::mt19937 random(42);
+	std::vector<std::string> messages;
+	for (unsigned i = 0; i < syntheticFrames; ++i) {
+		char values[200];
+		snprintf(values, sizeof(values),
+				"42[\"telemetry\",{\"steering_angle\":\"%.4f\",\"throttle\":\"%.4f\",\"speed\":\"%.4f\",\"cte\":\"%.4f\",\"image\":\"",
+				5 * sin(i * .01), .3 + .05 * sin(i * .003), 30 + 2 * sin(i * .002), .8 * sin(i * .011 + 1));
+		std::string message(values);
+		for (std::size_t j = 0; j < 4 * imageSize / 3; ++j)
+			message += base64[random() % 64];
+		message += "\"}]";
+		messages.push_back(message);
+	}
+	return messages;
+}
+
+/**
+ * @return steering command messages, as sent in reply to telemetry
+ */
+std::vector<std::string> steerMessages(const std::size_t n) {
+	std::vector<std::string> messages;
+	char buffer[maxSteerMessage];
+	for (std::size_t i = 0; i < n; ++i) {
+		const SteerCommand command { .2 * sin(i * .01), .3 + .01 * cos(i * .003) };
+		messages.emplace_back(buffer, writeSteerMessage(buffer, command));
+	}
+	return messages;
+}
+
+/**
+ * Bytes on the wire and CPU time per message for one direction and compression setting.
+ */
+struct Result {
+	double bytes;
+	double compressNs;
+	double inflateNs;
+};
+
+/**
+ * Sends messages through permessage-deflate, as a peer would, then decompresses them, as the
+ * program does.
+ * @param contextTakeover whether the sliding window is kept from one message to the next
+ */
+Result measure(const std::vector<std::string> & messages, const bool fromClient, const bool contextTakeover) {
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+	std::vector<std::vector<unsigned char>> payloads;
+	std::vector<unsigned char> buffer;
+	std::size_t bytes = 0;
+
+	auto start = std::chrono::steady_clock::now();
+	for (const auto & message : messages) {
+		if (!contextTakeover)
+			deflateReset(&stream);
+		buffer.resize(deflateBound(&stream, message.size()) + 16);
+		stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(message.data()));
+		stream.avail_in = message.size();
+		stream.next_out = buffer.data();
+		stream.avail_out = buffer.size();
+		deflate(&stream, Z_SYNC_FLUSH);
+		// Without the trailer of the flush
+		const std::size_t length = buffer.size() - stream.avail_out - 4;
+		payloads.emplace_back(buffer.begin(), buffer.begin() + length);
+		bytes += frameHeaderLength(length, fromClient) + length;
+	}
+	const auto compressTime = std::chrono::steady_clock::now() - start;
+	deflateEnd(&stream);
+
+	Inflater inflater;
+	start = std::chrono::steady_clock::now();
+	for (std::size_t i = 0; i < payloads.size(); ++i) {
+		if (!contextTakeover)
+			inflater.reset();
+		if (!inflater.inflate(reinterpret_cast<const char *>(payloads[i].data()), payloads[i].size(), 1 << 24)
+				|| inflater.length() != messages[i].size()
+				|| memcmp(inflater.data(), messages[i].data(), inflater.length()) != 0)
+			cerr << "Message " << i << " decompressed differently" << endl;
+	}
+	const auto inflateTime = std::chrono::steady_clock::now() - start;
+
+	const double n = messages.size();
+	return Result { bytes / n, std::chrono::duration<double, std::nano>(compressTime).count() / n,
+			std::chrono::duration<double, std::nano>(inflateTime).count() / n };
+}
+
+/**
+ * Prints out the results of the three settings for one direction.
+ */
+void compare(const char * direction, const std::vector<std::string> & messages, const bool fromClient) {
+	std::size_t plainBytes = 0;
+	for (const auto & message : messages)
+		plainBytes += frameHeaderLength(message.size(), fromClient) + message.size();
+	const auto shared = measure(messages, fromClient, true);
+	const auto separate = measure(messages, fromClient, false);
+	printf("%s, %zu messages\n", direction, messages.size());
+	printf("  %-28s %10s %14s %14s\n", "", "bytes/msg", "deflate ns/msg", "inflate ns/msg");
+	printf("  %-28s %10.1f %14s %14s\n", "uncompressed", static_cast<double>(plainBytes) / messages.size(), "-", "-");
+	printf("  %-28s %10.1f %14.0f %14.0f\n", "deflate, shared window", shared.bytes, shared.compressNs,
+			shared.inflateNs);
+	printf("  %-28s %10.1f %14.0f %14.0f\n", "deflate, no context takeover", separate.bytes, separate.compressNs,
+			separate.inflateNs);
+}
+
+}
+
+/**
+ * Compares bytes on the wire and CPU time per message with and without permessage-deflate,
+ * for telemetry from the simulator and for the steering commands sent back.
+ */
+int main(int argc, char ** argv) {
+	std::vector<std::string> telemetry;
+	if (argc > 2) {
+		cout << "Usage:" << endl << "   deflatebench [frame-file]" << endl;
+		return -1;
+	} else if (argc == 2) {
+		// Telemetry messages, one per line, e.g. as captured from the simulator
+		std::ifstream file(argv[1], std::ios::binary);
+		if (!file) {
+			cerr << "Cannot read frame file " << argv[1] << endl;
+			return -1;
+		}
+		for (std::string line; std::getline(file, line);)
+			if (!line.empty())
+				telemetry.push_back(line);
+	} else
+		telemetry = syntheticTelemetry();
+	if (telemetry.empty()) {
+		cerr << "No frames" << endl;
+		return -1;
+	}
+	compare("Telemetry, client to server", telemetry, true);
+	compare("Steering commands, server to client", steerMessages(telemetry.size()), false);
+	return 0;
+}
@@ -0,0 +1,216 @@
+#include "Numa.h"
+#include "PID.h"
+#include "Session.h"
+#include <cpuid.h>
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+/**
+ * State of a positional PID controller, 48 bytes: the gains, and what is written on every
+ * iteration.
+ */
+struct ControllerState {
+	double Kp;
+	double Ki;
+	double Kd;
+	double errorPrev;
+	double errorInt;
+	long long prevTimestamp;
+};
+
+/**
+ * The same state, on a cache line of its own.
+ */
+struct alignas(SessionTable::cacheLine) PaddedState {
+	ControllerState state;
+};
+
+const std::size_t maxThreads = 64;
+
+// Static, as operator new ignores over-alignment before C++17
+ControllerState packed[maxThreads];
+PaddedState padded[maxThreads];
+
+/**
+ * Runs the positional form on the given state, in the way PID::computeCorrection() does,
+ * forcing the state to memory on every iteration as a controller serving messages does.
+ * @return the sum of the control values, for the optimizer not to drop the loop
+ */
+double run(ControllerState & state, const std::size_t nIterations, const std::size_t seed) {
+	double sum = 0;
+	double error = .1 * seed;
+	for (std::size_t i = 0; i < nIterations; ++i) {
+		const long long timestamp = state.prevTimestamp + 10000;
+		const double deltaT = (timestamp - state.prevTimestamp) / 1e6;
+		state.errorInt += error * deltaT;
+		const double correction = -state.Kp * error - state.Ki * state.errorInt
+				- state.Kd * (error - state.errorPrev) / deltaT;
+		state.errorPrev = error;
+		state.prevTimestamp = timestamp;
+		sum += correction;
+		error = .999 * error - .01 * correction;
+		// Compiler only fence: the state is loaded and stored on every iteration, not kept in registers
+		std::atomic_signal_fence(std::memory_order_seq_cst);
+	}
+	return sum;
+}
+
+/**
+ * Opens a counter, disabled, of the loads of the calling thread that hit a cache line
+ * modified in the cache of another core (HITM): the cache line transfers false sharing causes.
+ * The event is MEM_LOAD_L3_HIT_RETIRED.XSNP_HITM, event 0xd2 umask 0x04, as on Intel cores
+ * since Skylake (XSNP_FWD since Ice Lake, same encoding); other processors don't have it.
+ * User space only, so that it needs no privilege beyond the default perf_event_paranoid.
+ * @return the descriptor, -1 if the event is not available
+ */
+int openHitmCounter() {
+	unsigned eax, ebx, ecx, edx;
+	char vendor[13] = { };
+	if (__get_cpuid(0, &eax, &ebx, &ecx, &edx) == 0)
+		return -1;
+	memcpy(vendor, &ebx, 4);
+	memcpy(vendor + 4, &edx, 4);
+	memcpy(vendor + 8, &ecx, 4);
+	if (strcmp(vendor, "GenuineIntel") != 0)
+		return -1;
+	perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_RAW;
+	attr.config = 0x04d2;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+/**
+ * Outcome of a run of all threads.
+ */
+struct Measure {
+	double ns;  // Wall-clock nanoseconds per iteration, the threads running concurrently
+	long long hitm;  // HITM loads of all threads, -1 if not counted
+};
+
+/**
+ * Runs one thread per state, each pinned to a CPU of its own if there are enough, all
+ * started at once once they are all ready; only the iterations are timed and counted.
+ */
+Measure measure(const std::vector<ControllerState *> & states, const std::vector<int> & cpus,
+		const std::size_t nIterations) {
+	std::atomic<std::size_t> nReady { 0 };
+	std::atomic<bool> go { false };
+	std::atomic<long long> hitm { 0 };
+	std::atomic<bool> counted { true };
+	std::vector<double> sums(states.size());
+	std::vector<std::thread> threads;
+	for (std::size_t t = 0; t < states.size(); ++t)
+		threads.emplace_back([&, t] {
+			if (!cpus.empty()) {
+				cpu_set_t set;
+				CPU_ZERO(&set);
+				CPU_SET(cpus[t % cpus.size()], &set);
+				pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+			}
+			const int counter = openHitmCounter();
+			++nReady;
+			while (!go)
+				std::this_thread::yield();
+			if (counter >= 0)
+				ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+			sums[t] = run(*states[t], nIterations, t + 1);
+			if (counter >= 0) {
+				ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+				long long count;
+				if (read(counter, &count, sizeof(count)) == sizeof(count))
+					hitm += count;
+				else
+					counted = false;
+				close(counter);
+			} else
+				counted = false;
+		});
+	// The clock starts when all threads are created and pinned
+	while (nReady < states.size())
+		std::this_thread::yield();
+	const auto start = std::chrono::steady_clock::now();
+	go = true;
+	for (auto & thread : threads)
+		thread.join();
+	const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+	return Measure { elapsed.count() / nIterations, counted ? hitm.load() : -1 };
+}
+
+/**
+ * Prints the outcome of a run.
+ */
+void print(const char * layout, const Measure & measure, const std::size_t nIterations) {
+	printf("%-28s%7.2f ns/iteration", layout, measure.ns);
+	if (measure.hitm >= 0)
+		printf(", %lld HITM loads, %.4f per iteration\n", measure.hitm,
+				static_cast<double>(measure.hitm) / nIterations);
+	else
+		printf(", HITM loads not counted\n");
+}
+
+void reset(ControllerState & state) {
+	state = { .29, .0029, .13, 0., 0., 0 };
+}
+
+}
+
+/**
+ * Shows the cost of false sharing between controllers owned by different threads: every
+ * thread updates the state of its own controller, first with the states packed next to each
+ * other, 48 bytes apart, then with every state on a cache line of its own, as SessionTable
+ * lays out sessions. With packed states, neighbouring threads write to the same cache lines,
+ * that keep moving between the caches of their cores. On a host with a single CPU, threads
+ * take turns and both layouts run at the same speed. Every run also counts the loads that hit a
+ * cache line modified by another core (HITM), on processors that have the event, see
+ * openHitmCounter(); `perf c2c record ./falsesharingbench` and `perf c2c report` tell which
+ * lines they hit.
+ * Usage: falsesharingbench [threads [iterations]]
+ */
+int main(int argc, char * argv[]) {
+	const auto cpus = NumaTopology::read().cpus();
+	const std::size_t nThreads = std::min(maxThreads,
+			argc > 1 ? std::stoul(argv[1]) : std::max<std::size_t>(cpus.size(), 2));
+	const std::size_t nIterations = argc > 2 ? std::stoul(argv[2]) : 20000000;
+
+	printf("sizeof(ControllerState) %zu, sizeof(PID) %zu, sizeof(Session) %zu, session stride %zu\n",
+			sizeof(ControllerState), sizeof(PID), sizeof(Session),
+			(sizeof(Session) + SessionTable::cacheLine - 1) / SessionTable::cacheLine * SessionTable::cacheLine);
+	printf("%zu threads on %zu CPUs, %zu iterations each\n", nThreads, cpus.size(), nIterations);
+	if (cpus.size() < nThreads)
+		printf("Fewer CPUs than threads: threads share CPUs, and can't show contention\n");
+
+	std::vector<ControllerState *> packedStates, paddedStates;
+	for (std::size_t t = 0; t < nThreads; ++t) {
+		reset(packed[t]);
+		reset(padded[t].state);
+		packedStates.push_back(&packed[t]);
+		paddedStates.push_back(&padded[t].state);
+	}
+	// Once to warm up, then measured
+	measure(packedStates, cpus, nIterations / 10);
+	const auto packedRun = measure(packedStates, cpus, nIterations);
+	measure(paddedStates, cpus, nIterations / 10);
+	const auto paddedRun = measure(paddedStates, cpus, nIterations);
+	print("packed, 48 bytes apart:", packedRun, nIterations);
+	print("padded, one per cache line:", paddedRun, nIterations);
+	printf("Padded %.2fx faster\n", packedRun.ns / paddedRun.ns);
+	return 0;
+}
@@ -0,0 +1,249 @@
+#include "FrameDecoder.h"
+#include "FrameScanner.h"
+#include "LazyJson.h"
+#include "json.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+namespace {
+
+const std::size_t imageSize = 12000;  // Bytes of JPEG data in a camera image of the simulator, about
+const unsigned syntheticFrames = 2000;
+
+unsigned long long nAllocations { 0 };  // Heap allocations made so far by the whole program
+
+/**
+ * @return telemetry messages as the simulator sends them, with a camera image of random
+ * base64 data
+ */
+std::vector<std::string> syntheticTelemetry() {
+	static const char base64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	std::mt19937 random(42);
+	std::vector<std::string> messages;
+	for (unsigned i = 0; i < syntheticFrames; ++i) {
+		char values[200];
+		snprintf(values, sizeof(values),
+				"42[\"telemetry\",{\"steering_angle\":\"%.4f\",\"throttle\":\"%.4f\",\"speed\":\"%.4f\",\"cte\":\"%.4f\",\"image\":\"",
+				5 * sin(i * .01), .3 + .05 * sin(i * .003), 30 + 2 * sin(i * .002), .8 * sin(i * .011 + 1));
+		std::string message(values);
+		for (std::size_t j = 0; j < 4 * imageSize / 3; ++j)
+			message += base64[random() % 64];
+		message += "\"}]";
+		messages.push_back(message);
+	}
+	return messages;
+}
+
+// Checks if the SocketIO event has JSON data.
+// If there is data the JSON object in string format will be returned,
+// else the empty string "" will be returned.
+std::string hasData(std::string s) {
+	auto found_null = s.find("null");
+	auto b1 = s.find_first_of("[");
+	auto b2 = s.find_last_of("]");
+	if (found_null != std::string::npos) {
+		return "";
+	} else if (b1 != std::string::npos && b2 != std::string::npos) {
+		return s.substr(b1, b2 - b1 + 1);
+	}
+	return "";
+}
+
+/**
+ * Decodes a frame and writes the reply as the original implementation did.
+ * @return the reply length
+ */
+std::size_t originalPath(const std::string & frame) {
+	const char * data = frame.data();
+	auto s = hasData(std::string(data).substr(0, frame.size()));
+	// Manual driving; also taken when the image happens to hold "null"
+	if (s == "")
+		return 0;
+	auto j = nlohmann::json::parse(s);
+	std::string event = j[0].get<std::string>();
+	if (event != "telemetry")
+		return 0;
+	const double cte = std::stod(j[1]["cte"].get<std::string>());
+	const double speed = std::stod(j[1]["speed"].get<std::string>());
+	nlohmann::json msgJson;
+	msgJson["steering_angle"] = cte;
+	msgJson["throttle"] = speed;
+	auto msg = "42[\"steer\"," + msgJson.dump() + "]";
+	return msg.size();
+}
+
+/**
+ * Decodes a frame with LazyJson, as decodeFrame() does when the extractor doesn't know the
+ * layout, and writes the reply.
+ * @param arena the arena the element index is allocated from; nullptr for the heap
+ * @return the reply length
+ */
+std::size_t lazyPath(const std::string & frame, MonotonicArena * arena) {
+	const auto info = scanFrame(frame.data(), frame.size());
+	Telemetry telemetry;
+	bool decoded;
+	MonotonicArena::setCurrent(arena);
+	{
+		LazyJson j;
+		j.parse(frame.data() + info.begin, frame.data() + info.end + 1);
+		LazyJson values;
+		decoded = j.at(0).equals("telemetry") && values.parse(j.at(1)) && values.find("cte").getNumber(telemetry.cte)
+				&& values.find("speed").getNumber(telemetry.speed);
+	}
+	MonotonicArena::setCurrent(nullptr);
+	if (arena != nullptr)
+		arena->reset();
+	if (!decoded)
+		return 0;
+	char reply[maxSteerMessage];
+	return writeSteerMessage(reply, SteerCommand { telemetry.cte, telemetry.speed });
+}
+
+/**
+ * Decodes a frame with decodeFrame() and writes the reply, as the message handler does.
+ * @return the reply length
+ */
+std::size_t decoderPath(const std::string & frame, TelemetryExtractor & extractor, MonotonicArena & arena) {
+	Telemetry telemetry;
+	double steeringAngle;
+	if (decodeFrame(frame.data(), frame.size(), extractor, arena, telemetry, steeringAngle) != FrameKind::telemetry)
+		return 0;
+	char reply[maxSteerMessage];
+	return writeSteerMessage(reply, SteerCommand { telemetry.cte, telemetry.speed });
+}
+
+/**
+ * Reads cte and speed from a telemetry object with nlohmann::json, whose objects are std::map.
+ * @return the number of values read
+ */
+std::size_t mapLookup(const std::string & object) {
+	auto j = nlohmann::json::parse(object);
+	const double cte = std::stod(j["cte"].get<std::string>());
+	const double speed = std::stod(j["speed"].get<std::string>());
+	return (cte == cte) + (speed == speed);
+}
+
+/**
+ * Reads cte and speed from a telemetry object with LazyJson.
+ * @return the number of values read
+ */
+std::size_t lazyLookup(const std::string & object, MonotonicArena & arena) {
+	ArenaScope messageScope(arena);
+	LazyJson values;
+	Telemetry telemetry;
+	values.parse(object.data(), object.data() + object.size());
+	return values.find("cte").getNumber(telemetry.cte) + values.find("speed").getNumber(telemetry.speed);
+}
+
+volatile std::size_t sink;  // Keeps the work from being optimized away
+
+/**
+ * Runs a path over all the frames, once to warm up, then measured.
+ */
+template<typename Path> void measure(const char * name, const std::vector<std::string> & frames,
+		const unsigned nRounds, Path path) {
+	for (const auto & frame : frames)
+		sink = path(frame);
+	const auto allocations = nAllocations;
+	const auto start = std::chrono::steady_clock::now();
+	for (unsigned round = 0; round < nRounds; ++round)
+		for (const auto & frame : frames)
+			sink = path(frame);
+	const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+	const double n = static_cast<double>(frames.size()) * nRounds;
+	printf("  %-44s %10.0f %12.2f\n", name, elapsed.count() / n, (nAllocations - allocations) / n);
+}
+
+}
+
+void * operator new(const std::size_t size) {
+	++nAllocations;
+	if (void * p = malloc(size == 0 ? 1 : size))
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void * p) noexcept {
+	free(p);
+}
+
+void operator delete(void * p, std::size_t) noexcept {
+	free(p);
+}
+
+/**
+ * Compares the time and heap allocations taken to decode a telemetry frame and write the
+ * reply: as the original implementation did, parsing the whole frame with nlohmann::json;
+ * with LazyJson, which the decoder falls back to when the layout of the frame isn't known,
+ * its element index allocated from the heap or from the arena of the session; and with the
+ * decoder, which takes the extractor fast path once the layout is known. Then, the same for
+ * looking up values in the telemetry object alone: in the std::map objects of nlohmann::json,
+ * and with LazyJson, which only delimits the members up to the ones asked for.
+ * Usage: framebench [frame-file [rounds]]
+ */
+int main(int argc, char ** argv) {
+	std::vector<std::string> telemetry;
+	if (argc > 3) {
+		cout << "Usage:" << endl << "   framebench [frame-file [rounds]]" << endl;
+		return -1;
+	} else if (argc >= 2) {
+		// Telemetry messages, one per line, e.g. as captured from the simulator
+		std::ifstream file(argv[1], std::ios::binary);
+		if (!file) {
+			cerr << "Cannot read frame file " << argv[1] << endl;
+			return -1;
+		}
+		for (std::string line; std::getline(file, line);)
+			if (!line.empty())
+				telemetry.push_back(line);
+	} else
+		telemetry = syntheticTelemetry();
+	if (telemetry.empty()) {
+		cerr << "No frames" << endl;
+		return -1;
+	}
+	const unsigned nRounds = argc > 2 ? std::stoul(argv[2]) : 10;
+
+	MonotonicArena arena;
+	TelemetryExtractor extractor;
+	printf("%zu telemetry frames of %zu bytes, %u rounds\n", telemetry.size(), telemetry[0].size(), nRounds);
+	printf("  %-44s %10s %12s\n", "", "ns/frame", "allocs/frame");
+	measure("original: hasData, nlohmann::json", telemetry, nRounds, originalPath);
+	measure("LazyJson, element index on the heap", telemetry, nRounds, [](const std::string & frame) {
+		return lazyPath(frame, nullptr);
+	});
+	measure("LazyJson, element index in the arena", telemetry, nRounds, [&arena](const std::string & frame) {
+		return lazyPath(frame, &arena);
+	});
+	measure("decodeFrame(), extractor fast path", telemetry, nRounds, [&extractor, &arena](const std::string & frame) {
+		return decoderPath(frame, extractor, arena);
+	});
+
+	// The telemetry object, without the image, for the cost of the object lookups alone
+	std::vector<std::string> objects;
+	for (const auto & frame : telemetry) {
+		const auto begin = frame.find('{');
+		const auto image = frame.find(",\"image\"");
+		if (begin != std::string::npos)
+			objects.push_back(frame.substr(begin, (image != std::string::npos ? image : frame.rfind('}')) - begin) + "}");
+	}
+	printf("Telemetry objects without the image, cte and speed looked up\n");
+	printf("  %-44s %10s %12s\n", "", "ns/object", "allocs/object");
+	measure("nlohmann::json, std::map objects", objects, nRounds, mapLookup);
+	measure("LazyJson", objects, nRounds, [&arena](const std::string & object) {
+		return lazyLookup(object, arena);
+	});
+	return 0;
+}
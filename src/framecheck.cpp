@@ -0,0 +1,98 @@
+#include "FrameCheck.h"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+namespace {
+
+/**
+ * Checks the frames in a buffer, one per line, as received in that order by one session, and
+ * the steering command messages sent in reply to telemetry.
+ * @param name name of the buffer, for the mismatch descriptions
+ * @return the number of mismatches
+ */
+unsigned checkFrames(const char * data, const std::size_t length, const std::string & name, std::ostream & out) {
+	TelemetryExtractor extractor;
+	MonotonicArena arena;
+	unsigned mismatches { 0 };
+	unsigned line { 1 };
+	for (const char * frame = data; frame < data + length; ++line) {
+		auto frameEnd = static_cast<const char *>(memchr(frame, '\n', data + length - frame));
+		if (frameEnd == nullptr)
+			frameEnd = data + length;
+		Telemetry telemetry;
+		double steeringAngle;
+		std::string mismatch;
+		if (checkFrame(frame, frameEnd - frame, extractor, arena, telemetry, steeringAngle, mismatch)
+				== FrameKind::telemetry
+				&& mismatch.empty())
+			mismatch = checkSteerMessage(SteerCommand { telemetry.cte, telemetry.speed });
+		if (!mismatch.empty()) {
+			out << name << ':' << line << ": " << mismatch << '\n';
+			++mismatches;
+		}
+		frame = frameEnd + 1;
+	}
+	return mismatches;
+}
+
+}
+
+#ifdef FRAMECHECK_FUZZER
+
+/**
+ * Entry point for libFuzzer: the input holds frames, one per line; its first 16 bytes are also
+ * taken as the values of a steering command.
+ */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size) {
+	const auto text = reinterpret_cast<const char *>(data);
+	unsigned mismatches = checkFrames(text, size, "input", cerr);
+	if (size >= 2 * sizeof(double)) {
+		SteerCommand command;
+		memcpy(&command.steering, data, sizeof(double));
+		memcpy(&command.throttle, data + sizeof(double), sizeof(double));
+		const auto mismatch = checkSteerMessage(command);
+		if (!mismatch.empty()) {
+			cerr << mismatch << endl;
+			++mismatches;
+		}
+	}
+	if (mismatches > 0)
+		abort();
+	return 0;
+}
+
+#else
+
+/**
+ * Replays frames saved by `pid --verify`, or found by fuzzing, through the message decoder and
+ * the reference, and prints out the differences.
+ */
+int main(int argc, char ** argv) {
+	if (argc < 2) {
+		cout << "Usage:" << endl << "   framecheck frame-file..." << endl;
+		return -1;
+	}
+	unsigned mismatches { 0 };
+	for (int i = 1; i < argc; ++i) {
+		std::ifstream file(argv[i], std::ios::binary);
+		if (!file) {
+			cerr << "Cannot read frame file " << argv[i] << endl;
+			return -1;
+		}
+		const std::string frames { std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+		mismatches += checkFrames(frames.data(), frames.size(), argv[i], cout);
+	}
+	cout << mismatches << " mismatch(es)" << endl;
+	return mismatches == 0 ? 0 : 1;
+}
+
+#endif
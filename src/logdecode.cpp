@@ -0,0 +1,35 @@
+#include "Logger.h"
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+/**
+ * Prints out in text form the content of a binary log file written by `pid --log`.
+ */
+int main(int argc, char ** argv) {
+	if (argc != 2) {
+		cout << "Usage:" << endl << "   logdecode log-file" << endl;
+		return -1;
+	}
+	auto file = fopen(argv[1], "rb");
+	if (file == nullptr || !Logger::readHeader(file)) {
+		cerr << "Cannot read log file " << argv[1] << endl;
+		return -1;
+	}
+	LogRecord record;
+	while (fread(&record, sizeof(record), 1, file) == 1) {
+		const time_t seconds = record.timestamp / 1000000;
+		tm utc;
+		gmtime_r(&seconds, &utc);
+		char timeText[32];
+		strftime(timeText, sizeof(timeText), "%Y-%m-%d %H:%M:%S", &utc);
+		char microseconds[16];
+		snprintf(microseconds, sizeof(microseconds), ".%06lld", static_cast<long long>(record.timestamp % 1000000));
+		cout << timeText << microseconds << " [" << record.session << "] " << Logger::format(record) << '\n';
+	}
+	fclose(file);
+}
@@ -1,10 +1,29 @@
-#include <uWS/uWS.h>
 #include <iostream>
 #include "json.hpp"
 #include "PID.h"
+#include "Config.h"
+#include "Session.h"
+#include "Snapshot.h"
+#include "Logger.h"
+#include "ShmServer.h"
+#include "MessageHandler.h"
+#include "ControlScheduler.h"
+#ifdef PID_IO_URING
+#include "UringServer.h"
+#else
+#include "ReplyBatcher.h"
+#include "AdminServer.h"
+#endif
+#include <memory>
+#include <cerrno>
 #include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <vector>
 #include <string>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
 
 using std::cout;
 using std::endl;
@@ -16,34 +35,155 @@ using std::stod;
 using json = nlohmann::json;
 
 /**
- * Determines the sign of the argument comparing it with 0.
- * @param val the argument
- * @return 1 if 0 is less than val, -1 if val is less than 0, 0 if neither is true
+ * Handles a request to the admin endpoint, `/admin/config`. Parameters in the query string of a
+ * POST request, if any, replace the respective values in the current configuration, and the
+ * resulting configuration, if valid, is published to all sessions. For instance:
+ *    curl -X POST 'http://127.0.0.1:4568/admin/config?steering_p=0.3&target_speed=50'
+ * @param configStore the configuration
+ * @param method the request method
+ * @param url the requested URL
+ * @return the reply to the request: the current configuration in JSON format, or an error message
  */
-template<typename T> int sign(T val) {
-	return (T(0) < val) - (val < T(0));
+std::string handleAdminRequest(ConfigStore & configStore, const std::string & method, const std::string & url) {
+	const auto queryStart = url.find('?');
+	if (url.compare(0, queryStart, "/admin/config") != 0)
+		return "{\"error\":\"unknown request\"}";
+
+	ControlConfig config = *configStore.read();
+	const std::pair<const char *, double *> fields[] = { { "steering_p", &config.steeringP }, { "steering_i",
+			&config.steeringI }, { "steering_d", &config.steeringD }, { "throttle_p", &config.throttleP }, {
+			"throttle_i", &config.throttleI }, { "throttle_d", &config.throttleD }, { "target_speed",
+			&config.targetSpeed }, { "twiddle_interval", &config.twiddleInterval }, { "busy_poll",
+			&config.busyPoll } };
+	bool changed { false };
+	if (queryStart != std::string::npos && queryStart + 1 < url.length() && method != "POST")
+		return "{\"error\":\"use POST to change the configuration\"}";
+	if (queryStart != std::string::npos) {
+		std::size_t begin = queryStart + 1;
+		while (begin < url.length()) {
+			auto end = url.find('&', begin);
+			if (end == std::string::npos)
+				end = url.length();
+			const auto pair = url.substr(begin, end - begin);
+			begin = end + 1;
+			const auto equal = pair.find('=');
+			bool found { false };
+			for (const auto & field : fields)
+				if (equal != std::string::npos && pair.compare(0, equal, field.first) == 0) {
+					char * parseEnd;
+					const auto value = strtod(pair.c_str() + equal + 1, &parseEnd);
+					if (parseEnd == pair.c_str() + equal + 1 || *parseEnd != '\0' || !std::isfinite(value))
+						return "{\"error\":\"invalid value for " + std::string(field.first) + "\"}";
+					*field.second = value;
+					found = changed = true;
+				}
+			if (!found)
+				return "{\"error\":\"unknown parameter " + pair.substr(0, equal) + "\"}";
+		}
+	}
+	if (changed) {
+		const auto invalid = invalidConfigValue(config);
+		if (invalid != nullptr)
+			return "{\"error\":\"invalid value for " + std::string(invalid) + "\"}";
+		config.version = configStore.publish(config);
+	}
+
+	json reply;
+	for (const auto & field : fields)
+		reply[field.first] = *field.second;
+	reply["version"] = config.version;
+	return reply.dump();
+}
+
+/**
+ * Handles a plain HTTP request; `/admin/latency` returns the percentiles of the time taken
+ * to reply to messages, in microseconds, `/admin/load` the admission limits and counters,
+ * `/admin/schedule` the statistics of the fixed-rate scheduler, `/admin/timers` those of the
+ * timers of the sessions, and `/admin/numa` the placement of the sessions on NUMA nodes.
+ * Requests to `/admin/` are only served on the admin port, which is bound to the loopback
+ * interface.
+ * @param configStore the configuration
+ * @param sessions the sessions
+ * @param handler the message handler
+ * @param scheduler the fixed-rate scheduler, nullptr if none
+ * @param method the request method
+ * @param url the requested URL
+ * @param admin whether the request came to the admin port
+ * @return the body of the reply
+ */
+std::string handleHttpRequest(ConfigStore & configStore, const SessionTable & sessions, const MessageHandler & handler,
+		const ControlScheduler * scheduler, const std::string & method, const std::string & url, const bool admin) {
+	if (url.length() == 1)
+		return "<h1>Hello world!</h1>";
+	if (url.compare(0, 7, "/admin/") == 0 && !admin)
+		return "{\"error\":\"the admin endpoint is only served on the loopback interface\"}";
+	if (url == "/admin/latency")
+		return handler.replyLatency().summary();
+	if (url == "/admin/load")
+		return handler.admission().stats();
+	if (url == "/admin/schedule")
+		return scheduler != nullptr ? scheduler->stats() : "{}";
+	if (url == "/admin/timers")
+		return handler.timers().stats();
+	if (url == "/admin/numa")
+		return sessions.stats();
+	if (url.compare(0, 7, "/admin/") == 0)
+		return handleAdminRequest(configStore, method, url);
+	// i guess this should be done more gracefully?
+	return std::string();
 }
 
-// Checks if the SocketIO event has JSON data.
-// If there is data the JSON object in string format will be returned,
-// else the empty string "" will be returned.
-std::string hasData(std::string s) {
-	auto found_null = s.find("null");
-	auto b1 = s.find_first_of("[");
-	auto b2 = s.find_last_of("]");
-	if (found_null != std::string::npos) {
-		return "";
-	} else if (b1 != std::string::npos && b2 != std::string::npos) {
-		return s.substr(b1, b2 - b1 + 1);
-	}
-	return "";
+/**
+ * Prepares the calling thread for low latency, as requested; failures are reported, but not fatal.
+ * @param cpu the CPU the thread is to be pinned to, -1 for none
+ * @param lockMemory whether all the process memory is to be locked in RAM, so that it never
+ * takes a page fault
+ */
+void prepareLowLatency(const int cpu, const bool lockMemory) {
+	if (cpu >= 0) {
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(cpu, &cpus);
+		if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0)
+			std::cerr << "Failed to pin the event loop to CPU " << cpu << std::endl;
+	}
+	if (lockMemory && mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+		std::cerr << "Failed to lock memory: " << strerror(errno) << std::endl;
+}
+
+#ifndef PID_IO_URING
+/**
+ * Runs the event loop, polling for events without sleeping for up to the busy polling time of
+ * the current configuration after the latest one, then sleeping until the next one. The time
+ * is read again after every sleep, so that changes made through the admin endpoint apply.
+ * @param loop the event loop
+ * @param handler the message handler, which reads the configuration
+ * @param nEvents incremented by the event handlers
+ */
+void runBusyPoll(uv_loop_t * loop, MessageHandler & handler, const unsigned long long & nEvents) {
+	while (true) {
+		const auto spinTime = handler.busyPoll();
+		if (spinTime > 0) {
+			auto seen = nEvents;
+			auto deadline = LatencyEstimator::getCurrentTimestamp() + spinTime;
+			do {
+				uv_run(loop, UV_RUN_NOWAIT);
+				if (nEvents != seen) {
+					seen = nEvents;
+					deadline = LatencyEstimator::getCurrentTimestamp() + spinTime;
+				}
+			} while (LatencyEstimator::getCurrentTimestamp() < deadline);
+		}
+		uv_run(loop, UV_RUN_ONCE);
+	}
 }
+#endif
 
 /**
  * Prints out the program usage and parameters and exits.
  */
 void printParamsError() {
-	cout << "Usage:" << endl << "   pid [tune] [p-value i-value d-value]" << endl;
+	cout << "Usage:" << endl << "   pid [--predict] [--snapshot file] [--log file] [--verify dir] [--shm name] [--deflate] [--cork microseconds] [--busy-poll microseconds] [--cpu n] [--mlock] [--latency-budget microseconds] [--max-backlog bytes] [--rate hz] [--idle-timeout seconds] [--admin-port n] [--target-speed mph] [--twiddle-interval seconds] [tune] [p-value i-value d-value]" << endl;
 	exit(-1);
 }
 
@@ -51,14 +191,107 @@ int main(int argc, char ** argv) {
 	/*
 	 * Process command line parameters. Set pParam, iParam and dParam to
 	 * the parameters for the PID controller. Set tuneParams to true
-	 * if parameters tuning (with twiddle) is requested.
+	 * if parameters tuning (with twiddle) is requested. Set predictCte to true if
+	 * the cross-track error has to be extrapolated to compensate for latency. Set
+	 * snapshotFile to the file where controllers state is saved, if requested, and
+	 * logFile to the binary log file, if requested, and verifyDir to the directory
+	 * where frames decoded differently from the reference are saved, and shmName to the shared
+	 * memory object for co-located clients, if requested. Set deflate to true if clients may
+	 * compress their messages. Set cork to the time replies may be held back to be sent
+	 * together with the following ones. Set busyPoll to the time the event loop polls without
+	 * sleeping after every event, cpu to the CPU it is pinned to, if any, and lockMemory to true
+	 * if memory is to be locked in RAM. Set latencyBudget to the 99th percentile of the reply
+	 * latency above which connections are refused, and maxBacklog to the bytes not yet sent to
+	 * a connection above which its messages are dropped. Set rate to the frequency at which
+	 * control values are sent, if not in reply to telemetry, and idleTimeout to the time after
+	 * which connections with no messages are closed. Set adminPort to the port of the admin
+	 * endpoint on the loopback interface. Set targetSpeed and twiddleInterval to the throttle
+	 * controller target and the time between twiddle iterations.
 	 */
-	if (argc != 1 && argc != 2 && argc != 4 && argc != 5)
-		printParamsError();
 
 	// Copy command line parameters into vector `args`, args[0] being the executable
 	vector<string> args(argv, argv + argc);
 
+	// Options start with "--" and may appear anywhere; take them out of `args`
+	bool predictCte { false };
+	string snapshotFile;
+	string logFile;
+	string verifyDir;
+	string shmName;
+	bool deflate { false };
+	long long cork { 0 };  // microseconds
+	long long busyPoll { 0 };  // microseconds
+	int cpu { -1 };
+	bool lockMemory { false };
+	long long latencyBudget { 0 };  // microseconds
+	size_t maxBacklog { 0 };
+	double rate { 0 };  // Hz
+	double idleTimeout { 0 };  // seconds
+	int adminPort { 4568 };
+	double targetSpeed { 40 };  // mph
+	double twiddleInterval { 64 };  // seconds
+	for (auto it = args.begin() + 1; it != args.end();) {
+		if (*it == "--predict") {
+			predictCte = true;
+			it = args.erase(it);
+		} else if (*it == "--snapshot" && it + 1 != args.end()) {
+			snapshotFile = *(it + 1);
+			it = args.erase(it, it + 2);
+		} else if (*it == "--log" && it + 1 != args.end()) {
+			logFile = *(it + 1);
+			it = args.erase(it, it + 2);
+		} else if (*it == "--verify" && it + 1 != args.end()) {
+			verifyDir = *(it + 1);
+			it = args.erase(it, it + 2);
+		} else if (*it == "--shm" && it + 1 != args.end()) {
+			shmName = *(it + 1);
+			it = args.erase(it, it + 2);
+		} else if (*it == "--deflate") {
+			deflate = true;
+			it = args.erase(it);
+		} else if (*it == "--cork" && it + 1 != args.end()) {
+			cork = stoll(*(it + 1));
+			it = args.erase(it, it + 2);
+		} else if (*it == "--busy-poll" && it + 1 != args.end()) {
+			busyPoll = stoll(*(it + 1));
+			it = args.erase(it, it + 2);
+		} else if (*it == "--cpu" && it + 1 != args.end()) {
+			cpu = stoi(*(it + 1));
+			it = args.erase(it, it + 2);
+		} else if (*it == "--mlock") {
+			lockMemory = true;
+			it = args.erase(it);
+		} else if (*it == "--latency-budget" && it + 1 != args.end()) {
+			latencyBudget = stoll(*(it + 1));
+			it = args.erase(it, it + 2);
+		} else if (*it == "--max-backlog" && it + 1 != args.end()) {
+			maxBacklog = stoul(*(it + 1));
+			it = args.erase(it, it + 2);
+		} else if (*it == "--rate" && it + 1 != args.end()) {
+			rate = stod(*(it + 1));
+			it = args.erase(it, it + 2);
+		} else if (*it == "--idle-timeout" && it + 1 != args.end()) {
+			idleTimeout = stod(*(it + 1));
+			it = args.erase(it, it + 2);
+		} else if (*it == "--admin-port" && it + 1 != args.end()) {
+			adminPort = stoi(*(it + 1));
+			it = args.erase(it, it + 2);
+		} else if (*it == "--target-speed" && it + 1 != args.end()) {
+			targetSpeed = stod(*(it + 1));
+			it = args.erase(it, it + 2);
+		} else if (*it == "--twiddle-interval" && it + 1 != args.end()) {
+			twiddleInterval = stod(*(it + 1));
+			it = args.erase(it, it + 2);
+		} else if (it->compare(0, 2, "--") == 0)
+			printParamsError();
+		else
+			++it;
+	}
+	argc = args.size();
+
+	if (argc != 1 && argc != 2 && argc != 4 && argc != 5)
+		printParamsError();
+
 	if ((argc ==2 || argc==5) && args[1]!="tune")
 		printParamsError();
 
@@ -91,116 +324,243 @@ int main(int argc, char ** argv) {
 
 	string s = tuneParams ? "Tuning starting with " : "Running with ";
 	cout << s << "P=" << pParam << " I=" << iParam << " D=" << dParam << endl;
+	if (predictCte)
+		cout << "Compensating for latency" << endl;
+
+	/*
+	 * From here on, messages go through the asynchronous logger, so that the event loop
+	 * never waits on console or file output.
+	 */
+	if (!Logger::start(logFile)) {
+		std::cerr << "Failed to open log file " << logFile << std::endl;
+		return -1;
+	}
+
+	/*
+	 * Controllers coefficients and targets, which can be changed at run-time via the admin
+	 * endpoint. The event loop reads them without locking.
+	 */
+	ControlConfig initialConfig;
+	initialConfig.steeringP = pParam;
+	initialConfig.steeringI = iParam;
+	initialConfig.steeringD = dParam;
+	initialConfig.throttleP = .1;
+	initialConfig.throttleI = .005;
+	initialConfig.throttleD = .01;
+	initialConfig.targetSpeed = targetSpeed;
+	initialConfig.twiddleInterval = twiddleInterval;
+	initialConfig.busyPoll = busyPoll;
+	initialConfig.version = 1;
+	const auto invalid = invalidConfigValue(initialConfig);
+	if (invalid != nullptr) {
+		std::cerr << "Invalid value for " << invalid << std::endl;
+		return -1;
+	}
+	ConfigStore configStore(initialConfig);
 
+	/*
+	 * Every connection from the simulator gets its own controllers; if requested, their
+	 * state is restored from the latest snapshot, and saved periodically. Their memory is
+	 * on the NUMA node of the event loop: bound to that of the CPU it is pinned to, if any;
+	 * or else on the one it starts on, by first touch, free to follow the loop elsewhere.
+	 */
+	const size_t maxSessions = 16;
+	const int loopNode = cpu >= 0 ? NumaTopology::read().nodeOf(cpu) : NumaTopology::currentNode();
+	SessionTable sessions(maxSessions, Session(initialConfig, tuneParams), { loopNode }, cpu >= 0);
+	std::unique_ptr<SnapshotWriter> snapshotWriter;
+	vector<SessionTable::Record> snapshotRecords;
+	if (!snapshotFile.empty()) {
+		if (loadSnapshot(snapshotFile, snapshotRecords))
+			cout << "Resumed " << sessions.restore(snapshotRecords) << " session(s) from " << snapshotFile << endl;
+		snapshotWriter.reset(new SnapshotWriter(snapshotFile));
+	}
+
+	// Co-located clients can skip the WebSocket connection, and get a session and a thread of their own
+	std::unique_ptr<ShmServer> shmServer;
+	if (!shmName.empty()) {
+		Session prototype(initialConfig, tuneParams);
+		prototype.id = maxSessions;  // Past the table, to tell it apart in the log
+		shmServer.reset(new ShmServer(configStore, prototype, predictCte, !logFile.empty(),
+				rate > 0 ? std::llround(1e6 / rate) : 0));
+		if (!shmServer->start(shmName)) {
+			std::cerr << "Failed to create shared memory object " << shmName << std::endl;
+			return -1;
+		}
+		cout << "Serving shared memory object " << shmName << endl;
+	}
+
+	MessageHandler handler(sessions, configStore, snapshotWriter.get(), predictCte, !logFile.empty(), verifyDir);
+	handler.setAdmissionLimits(latencyBudget, maxBacklog);
+	handler.setIdleTimeout(idleTimeout);
+	const int port = 4567;
+
+	// Timers are read with io_uring, which waits on them, or polled for readiness by libuv
+#ifdef PID_IO_URING
+	const bool nonBlocking = false;
+#else
+	const bool nonBlocking = true;
+#endif
+	if (!handler.timers().start(nonBlocking)) {
+		std::cerr << "Failed to create the session timers" << std::endl;
+		return -1;
+	}
+
+	// If requested, control values are sent at a fixed rate, rather than in reply to telemetry
+	std::unique_ptr<ControlScheduler> scheduler;
+	if (rate > 0) {
+		scheduler.reset(new ControlScheduler(std::llround(1e6 / rate), maxSessions));
+		if (!scheduler->start(nonBlocking)) {
+			std::cerr << "Failed to create the control timer" << std::endl;
+			return -1;
+		}
+		handler.setFixedRate(true);
+	}
+
+#ifdef PID_IO_URING
+	UringServer server(sessions, handler, [&configStore, &sessions, &handler, &scheduler](const std::string & method,
+			const std::string & url, const bool admin) {
+		return handleHttpRequest(configStore, sessions, handler, scheduler.get(), method, url, admin);
+	});
+	if (server.listen(port)) {
+		std::cout << "Listening to port " << port << " with io_uring" << std::endl;
+	} else {
+		std::cerr << "Failed to listen to port" << std::endl;
+		return -1;
+	}
+	if (server.listenAdmin(adminPort)) {
+		std::cout << "Admin endpoint on 127.0.0.1 port " << adminPort << std::endl;
+	} else {
+		std::cerr << "Failed to listen to admin port" << std::endl;
+		return -1;
+	}
+	if (cork > 0)
+		std::cerr << "With io_uring, replies are always gathered per loop iteration; --cork is ignored" << std::endl;
+	prepareLowLatency(cpu, lockMemory);
+	server.setDeflate(deflate);
+	if (scheduler)
+		server.setScheduler(*scheduler);
+	server.run();
+#else
+	/*
+	 * uWS decompresses the messages of all connections with a single stream, reset for every
+	 * message, which rules out context takeover; compression is only supported with io_uring.
+	 */
+	if (deflate) {
+		std::cerr << "--deflate requires the io_uring backend (CMake option IO_URING)" << std::endl;
+		return -1;
+	}
 	uWS::Hub h;
+	unsigned long long nEvents { 0 };  // Tells the busy-poll loop that something happened
+	ReplyBatcher batcher(h.getLoop(), maxSessions, cork, handler);
 
-	PID pidSteering(pParam, iParam, dParam);
-	PID pidThrottle(.1, .005, .01);
+	// Connections by session id, for the scheduler to send control values to, and to close on idle timeout
+	vector<std::unique_ptr<uWS::WebSocket<uWS::SERVER>>> sockets(maxSessions);
+	handler.setIdleHandler([&sockets](Session & session) {
+		sockets[session.id]->close(1001);
+	});
+	uv_poll_t timersPoll;
+	uv_poll_init(h.getLoop(), &timersPoll, handler.timers().fd());
+	timersPoll.data = &handler.timers();
+	uv_poll_start(&timersPoll, UV_READABLE, [](uv_poll_t * poll, int, int) {
+		static_cast<TimerWheel *>(poll->data)->onTimer();
+	});
+	uv_poll_t schedulerPoll;
+	if (scheduler) {
+		scheduler->setTask([&handler, &batcher, &sockets](Session & session) {
+			const auto & ws = sockets[session.id];
+			if (!ws || handler.admission().shed(session, batcher.backlog(session)))
+				return;
+			const auto message = handler.tick(session);
+			if (message.data != nullptr)
+				batcher.push(*ws, session, message);
+		});
+		uv_poll_init(h.getLoop(), &schedulerPoll, scheduler->fd());
+		schedulerPoll.data = scheduler.get();
+		uv_poll_start(&schedulerPoll, UV_READABLE, [](uv_poll_t * poll, int, int) {
+			static_cast<ControlScheduler *>(poll->data)->onTimer();
+		});
+	}
 
-	long long latestTwiddleTime = -1;
-	double totalError { 0 };
-	unsigned long nSamples { 0 };
 	h.onMessage(
-			[&pidSteering, &pidThrottle, &latestTwiddleTime, &totalError, &nSamples, &tuneParams](uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length, uWS::OpCode opCode) {
-				// "42" at the start of the message means there's a websocket message event.
-				// The 4 signifies a websocket message
-				// The 2 signifies a websocket event
-				if (length && length > 2 && data[0] == '4' && data[1] == '2')
-				{
-					auto s = hasData(std::string(data).substr(0, length));
-					if (s != "") {
-						auto j = json::parse(s);
-						std::string event = j[0].get<std::string>();
-						if (event == "telemetry") {
-							const double twiddleInterval = 64;  // seconds
-							// j[1] is the data JSON object
-							double cte = std::stod(j[1]["cte"].get<std::string>());
-							cte=sign(cte)*pow(cte,2);
-							const double speed = std::stod(j[1]["speed"].get<std::string>());
-							const double speedError = speed-40;// Target speed 40 mph
-
-							// double angle = std::stod(j[1]["steering_angle"].get<std::string>());
-
-							totalError+=std::abs(cte);
-							++nSamples;
-
-							/*
-							 * If tuning of steering PID coefficients is requested, run one iteration of
-							 * twiddle every (approximately) `twiddleInterval` seconds.
-							 */
-							if (tuneParams) {
-								if (latestTwiddleTime<0)  // Initialise the timestamp of the latest twiddle run
-									latestTwiddleTime=pidSteering.getCurrentTimestamp();
-								else {
-									const auto currentTime =pidSteering.getCurrentTimestamp();
-									const auto deltaT= (currentTime- latestTwiddleTime)/1000.0;  // deltaT is in seconds
-									if (deltaT> twiddleInterval) {
-										double averageError = totalError/nSamples;
-										bool paramsTuned = pidSteering.twiddle(averageError);
-										if (paramsTuned) {
-											cout << "Params tuning complete" << endl;
-											tuneParams=false;
-										}
-										totalError=0;
-										nSamples=0;
-										latestTwiddleTime=pidSteering.getCurrentTimestamp();
-									}
-								}
-							}
-
-							auto steerValue = pidSteering.computeCorrection(cte);
-							if (steerValue<-1)
-								steerValue=-1;
-							else if (steerValue > 1)
-								steerValue =1;
-							const auto throttleValue=pidThrottle.computeCorrection(speedError);
-
-							json msgJson;
-							msgJson["steering_angle"] = steerValue;
-							msgJson["throttle"] = throttleValue;	// Was .30
-							auto msg = "42[\"steer\"," + msgJson.dump() + "]";
-							ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
-						}
-					} else {
-						// Manual driving
-						std::string msg = "42[\"manual\",{}]";
-						ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
-					}
-				}
+			[&handler, &batcher, &nEvents](uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length, uWS::OpCode opCode) {
+				// uWS doesn't tell when the kernel received the message, hence the time of the event loop
+				const auto start = LatencyHistogram::now();
+				++nEvents;
+				auto session = static_cast<Session *>(ws.getUserData());
+				if (session == nullptr
+						|| handler.admission().shed(*session, batcher.backlog(*session), data, length,
+								opCode == uWS::OpCode::BINARY))
+					return;
+				const auto reply = handler.handle(*session, data, length, opCode == uWS::OpCode::BINARY, start / 1000);
+				if (reply.data != nullptr)
+					batcher.reply(ws, *session, reply, start);
 			});
 
-// We don't need this since we're not using HTTP but if it's removed the program
-// doesn't compile :-(
+	// The admin endpoint has a port of its own, on the loopback interface, see handleAdminRequest()
 	h.onHttpRequest(
-			[](uWS::HttpResponse *res, uWS::HttpRequest req, char *data, size_t, size_t) {
-				const std::string s = "<h1>Hello world!</h1>";
-				if (req.getUrl().valueLength == 1)
-				{
-					res->end(s.data(), s.length());
-				}
-				else
-				{
-					// i guess this should be done more gracefully?
-					res->end(nullptr, 0);
-				}
+			[&configStore, &sessions, &handler, &scheduler, &nEvents](uWS::HttpResponse *res,
+					uWS::HttpRequest req, char *data, size_t, size_t) {
+				++nEvents;
+				const auto url = req.getUrl();
+				const std::string path(url.value, url.valueLength);
+				// The method only matters to the admin port
+				const auto reply = handleHttpRequest(configStore, sessions, handler, scheduler.get(), std::string(), path,
+						false);
+				res->end(reply.data(), reply.length());
+			});
+	AdminServer adminServer(h.getLoop(),
+			[&configStore, &sessions, &handler, &batcher, &scheduler, &nEvents](const std::string & method,
+					const std::string & url) {
+				++nEvents;
+				return url == "/admin/stats" ?
+						batcher.stats() : handleHttpRequest(configStore, sessions, handler, scheduler.get(), method, url, true);
 			});
 
-	h.onConnection([&h](uWS::WebSocket<uWS::SERVER> ws, uWS::HttpRequest req) {
-		std::cout << "Connected!!!" << std::endl;
+	h.onConnection([&h, &sessions, &handler, &scheduler, &sockets](uWS::WebSocket<uWS::SERVER> ws, uWS::HttpRequest req) {
+		auto session = handler.admission().admit(sessions);
+		if (session == nullptr) {
+			ws.setUserData(nullptr);
+			ws.close();
+			return;
+		}
+		ws.setUserData(session);
+		Logger::log(LogEvent::connected, session->id);
+		sockets[session->id].reset(new uWS::WebSocket<uWS::SERVER>(ws));
+		handler.onOpen(*session);
+		if (scheduler)
+			scheduler->add(*session);
 	});
 
 	h.onDisconnection(
-			[&h](uWS::WebSocket<uWS::SERVER> ws, int code, char *message, size_t length) {
+			[&h, &sessions, &handler, &batcher, &scheduler, &sockets](uWS::WebSocket<uWS::SERVER> ws, int code,
+					char *message, size_t length) {
+				auto session = static_cast<Session *>(ws.getUserData());
+				if (session != nullptr) {
+					Logger::log(LogEvent::disconnected, session->id);
+					if (scheduler)
+						scheduler->remove(*session);
+					handler.onClose(*session);
+					sockets[session->id].reset();
+					batcher.drop(*session);
+					sessions.release(session);
+					ws.setUserData(nullptr);
+				}
 				ws.close();
-				std::cout << "Disconnected" << std::endl;
 			});
 
-	int port = 4567;
 	if (h.listen(port)) {
 		std::cout << "Listening to port " << port << std::endl;
 	} else {
 		std::cerr << "Failed to listen to port" << std::endl;
 		return -1;
 	}
-	h.run();
+	if (adminServer.listen(adminPort)) {
+		std::cout << "Admin endpoint on 127.0.0.1 port " << adminPort << std::endl;
+	} else {
+		std::cerr << "Failed to listen to admin port" << std::endl;
+		return -1;
+	}
+	prepareLowLatency(cpu, lockMemory);
+	runBusyPoll(h.getLoop(), handler, nEvents);
+#endif
 }
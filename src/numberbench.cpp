@@ -0,0 +1,95 @@
+#include "Numbers.h"
+#include "json.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+/**
+ * Runs a conversion over all the inputs, repeatedly.
+ * @return nanoseconds per conversion
+ */
+template<typename Input, typename Convert> double measure(const std::vector<Input> & inputs, const unsigned nRounds,
+		Convert convert) {
+	const auto start = std::chrono::steady_clock::now();
+	for (unsigned round = 0; round < nRounds; ++round)
+		for (const auto & input : inputs)
+			convert(input);
+	const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+	return elapsed.count() / (static_cast<double>(inputs.size()) * nRounds);
+}
+
+volatile double sink;  // Keeps the conversions from being optimized away
+volatile char sinkChar;
+
+/**
+ * Prints out the time taken to parse the given numbers by each parser.
+ */
+void compareParsing(const char * name, const std::vector<std::string> & texts, const unsigned nRounds) {
+	const auto parse = measure(texts, nRounds, [](const std::string & text) {
+		double value;
+		parseDouble(text.data(), text.data() + text.size(), value);
+		sink = value;
+	});
+	const auto strtodNs = measure(texts, nRounds, [](const std::string & text) {
+		sink = strtod(text.c_str(), nullptr);
+	});
+	const auto stodNs = measure(texts, nRounds, [](const std::string & text) {
+		sink = std::stod(text);
+	});
+	printf("Parsing %s\n", name);
+	printf("  %-24s %8.1f ns\n", "parseDouble()", parse);
+	printf("  %-24s %8.1f ns\n", "strtod()", strtodNs);
+	printf("  %-24s %8.1f ns\n", "std::stod()", stodNs);
+}
+
+}
+
+/**
+ * Compares parseDouble() and formatDouble() with the conversions of the C and C++ libraries
+ * and of nlohmann::json, which the message path used before: parsing values as the simulator
+ * sends them, which take the fast path, and numbers with more digits, which take the slow path;
+ * then formatting control values.
+ * Usage: numberbench [rounds]
+ */
+int main(int argc, char * argv[]) {
+	const unsigned nRounds = argc > 1 ? std::stoul(argv[1]) : 20;
+	std::mt19937_64 random(42);
+	std::uniform_real_distribution<double> values(-50, 50);
+
+	std::vector<std::string> simulator, precise;
+	std::vector<double> doubles;
+	for (unsigned i = 0; i < 100000; ++i) {
+		const double value = values(random);
+		char text[64];
+		snprintf(text, sizeof(text), "%.4f", value);
+		simulator.push_back(text);
+		snprintf(text, sizeof(text), "%.17g", value);
+		precise.push_back(text);
+		doubles.push_back(value / 50);
+	}
+	compareParsing("values as the simulator sends them, e.g. -12.4188 (fast path)", simulator, nRounds);
+	compareParsing("values with 17 significant digits (slow path)", precise, nRounds);
+
+	const auto format = measure(doubles, nRounds, [](const double value) {
+		char text[maxFormattedDouble];
+		sinkChar = *(formatDouble(text, value) - 1);
+	});
+	const auto snprintfNs = measure(doubles, nRounds, [](const double value) {
+		char text[32];
+		sinkChar = text[snprintf(text, sizeof(text), "%.17g", value) - 1];
+	});
+	const auto dump = measure(doubles, nRounds, [](const double value) {
+		sinkChar = nlohmann::json(value).dump().back();
+	});
+	printf("Formatting control values, e.g. %.17g\n", doubles[0]);
+	printf("  %-24s %8.1f ns\n", "formatDouble()", format);
+	printf("  %-24s %8.1f ns\n", "snprintf(\"%.17g\")", snprintfNs);
+	printf("  %-24s %8.1f ns\n", "nlohmann::json::dump()", dump);
+	return 0;
+}
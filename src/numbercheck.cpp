@@ -0,0 +1,147 @@
+#include "Numbers.h"
+#include <clocale>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+
+namespace {
+
+/**
+ * @return whether two doubles are the same, bit for bit
+ */
+bool same(const double a, const double b) {
+	return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+/**
+ * @return a finite double with random bits, spanning the whole range of magnitudes
+ */
+double randomDouble(std::mt19937_64 & random) {
+	double value;
+	do {
+		const uint64_t bits = random();
+		memcpy(&value, &bits, sizeof(value));
+	} while (!std::isfinite(value));
+	return value;
+}
+
+/**
+ * @return a random decimal number in JSON syntax, with up to 25 significant digits and an
+ * exponent beyond the range of doubles both ways, so that most take the slow path
+ */
+std::string randomDecimal(std::mt19937_64 & random) {
+	std::string text = random() % 2 ? "-" : "";
+	const auto nDigits = 1 + random() % 25;
+	const auto point = random() % (nDigits + 1);
+	text += static_cast<char>('1' + random() % 9);
+	for (unsigned i = 1; i < nDigits; ++i) {
+		if (i == point)
+			text += '.';
+		text += static_cast<char>('0' + random() % 10);
+	}
+	if (random() % 4 != 0)
+		text += "e" + std::to_string(static_cast<int>(random() % 660) - 340);
+	return text;
+}
+
+/**
+ * Formats random doubles and parses them back.
+ * @return the number of mismatches
+ */
+unsigned checkRoundTrips(std::mt19937_64 & random, const unsigned long n) {
+	unsigned mismatches { 0 };
+	for (unsigned long i = 0; i < n; ++i) {
+		const double value = randomDouble(random);
+		char text[maxFormattedDouble + 1];
+		const auto end = formatDouble(text, value);
+		*end = '\0';
+		double parsed;
+		if (!parseDouble(text, end, parsed) || !same(parsed, value) || !same(strtod(text, nullptr), value)) {
+			if (mismatches++ < 10)
+				printf("Round trip of %.17g: %s\n", value, text);
+		}
+	}
+	return mismatches;
+}
+
+/**
+ * Parses random decimal numbers with parseDouble() and strtod(), which must agree, in the
+ * current locale of the process.
+ * @return the number of mismatches
+ */
+unsigned checkParsing(std::mt19937_64 & random, const unsigned long n) {
+	unsigned mismatches { 0 };
+	for (unsigned long i = 0; i < n; ++i) {
+		const auto text = randomDecimal(random);
+		double parsed;
+		const bool success = parseDouble(text.data(), text.data() + text.size(), parsed);
+		// strtod() in the "C" locale, which is the program's
+		const double expected = std::strtod(text.c_str(), nullptr);
+		if (success != std::isfinite(expected) || (success && !same(parsed, expected))) {
+			if (mismatches++ < 10)
+				printf("Parsing %s: %.17g instead of %.17g\n", text.c_str(), success ? parsed : NAN, expected);
+		}
+	}
+	return mismatches;
+}
+
+/**
+ * Parses random decimal numbers with a locale whose decimal point is a comma, if one is
+ * installed, against the results in the "C" locale.
+ * @return the number of mismatches
+ */
+unsigned checkLocale(std::mt19937_64 & random, const unsigned long n) {
+	static const char * const locales[] = { "de_DE.UTF-8", "de_DE.utf8", "fr_FR.UTF-8", "fr_FR.utf8", "de_DE",
+			"fr_FR" };
+	const char * name = nullptr;
+	for (const auto candidate : locales)
+		if (setlocale(LC_NUMERIC, candidate) != nullptr && strcmp(localeconv()->decimal_point, ",") == 0) {
+			name = candidate;
+			break;
+		}
+	if (name == nullptr) {
+		setlocale(LC_NUMERIC, "C");
+		printf("No locale with a decimal comma installed; locale independence not checked\n");
+		return 0;
+	}
+	unsigned mismatches { 0 };
+	for (unsigned long i = 0; i < n; ++i) {
+		const auto text = randomDecimal(random);
+		double parsed;
+		const bool success = parseDouble(text.data(), text.data() + text.size(), parsed);
+		setlocale(LC_NUMERIC, "C");
+		const double expected = std::strtod(text.c_str(), nullptr);
+		setlocale(LC_NUMERIC, name);
+		if (success != std::isfinite(expected) || (success && !same(parsed, expected))) {
+			if (mismatches++ < 10)
+				printf("Parsing %s in %s: %.17g instead of %.17g\n", text.c_str(), name, success ? parsed : NAN,
+						expected);
+		}
+	}
+	setlocale(LC_NUMERIC, "C");
+	printf("Parsed in locale %s\n", name);
+	return mismatches;
+}
+
+}
+
+/**
+ * Checks that formatDouble() and parseDouble() round-trip random doubles exactly, and that
+ * parseDouble() reads random decimal numbers as strtod() does in the "C" locale, also while
+ * the process is in a locale with a decimal comma.
+ * Usage: numbercheck [count [seed]]
+ */
+int main(int argc, char * argv[]) {
+	const unsigned long n = argc > 1 ? std::stoul(argv[1]) : 1000000;
+	std::mt19937_64 random(argc > 2 ? std::stoull(argv[2]) : 1);
+	const auto roundTrips = checkRoundTrips(random, n);
+	const auto parsing = checkParsing(random, n);
+	const auto locale = checkLocale(random, n);
+	printf("%lu doubles: %u round trip mismatch(es), %u parsing mismatch(es), %u in another locale\n", n, roundTrips,
+			parsing, locale);
+	return roundTrips + parsing + locale == 0 ? 0 : 1;
+}
@@ -0,0 +1,145 @@
+#include "PlantModel.h"
+#include "TaskPool.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+namespace {
+
+using Gains = std::array<double, 3>;
+
+const char * const names[] = { "P", "I", "D" };
+
+void printUsage() {
+	cerr << "Usage:" << endl
+			<< "   pidtune [--workers n] [--exclude-cpus list] [--scenarios n] [--chunk n] [--duration seconds] [--dead-time periods] [P I D]"
+			<< endl;
+	exit(-1);
+}
+
+/**
+ * Evaluates candidate gains on the pool: every candidate drives the same scenarios, split in
+ * chunks, one task per chunk and candidate.
+ * @return the mean squared cross-track error of every candidate, over the scenarios
+ */
+std::vector<double> evaluate(TaskPool & pool, const PlantModel & plant, const std::vector<Gains> & candidates,
+		const std::size_t nScenarios, const std::size_t chunk) {
+	std::vector<double> errors(candidates.size() * nScenarios);
+	for (std::size_t c = 0; c < candidates.size(); ++c)
+		for (std::size_t first = 0; first < nScenarios; first += chunk) {
+			const auto n = std::min(chunk, nScenarios - first);
+			double * const results = &errors[c * nScenarios + first];
+			const auto & gains = candidates[c];
+			pool.submit([&plant, &gains, first, n, results] {
+				plant.rollout(gains, first, n, results);
+			});
+		}
+	pool.wait();
+	std::vector<double> means(candidates.size(), 0.);
+	for (std::size_t c = 0; c < candidates.size(); ++c) {
+		for (std::size_t i = 0; i < nScenarios; ++i)
+			means[c] += errors[c * nScenarios + i];
+		means[c] /= nScenarios;
+	}
+	return means;
+}
+
+}
+
+/**
+ * Tunes the steering gains offline, against the vehicle model of PlantModel, rather than on
+ * the road with twiddle. Runs a coordinate search like twiddle, but tries both directions of
+ * every gain at once, each candidate driving many scenarios, on a work-stealing pool. Prints
+ * the tuned gains, to be given to pid.
+ */
+int main(int argc, char * argv[]) {
+	std::vector<std::string> args(argv + 1, argv + argc);
+	std::size_t nWorkers { 0 };
+	std::vector<int> excludedCpus;
+	std::size_t nScenarios { 64 };
+	std::size_t chunk { 4 };
+	PlantModel plant;
+	Gains gains { { .292904, .00285759, .125998 } };
+	std::vector<double> positional;
+	for (std::size_t i = 0; i < args.size(); ++i) {
+		const bool hasValue = i + 1 < args.size();
+		if (args[i] == "--workers" && hasValue)
+			nWorkers = std::stoul(args[++i]);
+		else if (args[i] == "--exclude-cpus" && hasValue) {
+			std::istringstream list(args[++i]);
+			std::string cpu;
+			while (std::getline(list, cpu, ','))
+				excludedCpus.push_back(std::stoi(cpu));
+		} else if (args[i] == "--scenarios" && hasValue)
+			nScenarios = std::stoul(args[++i]);
+		else if (args[i] == "--chunk" && hasValue)
+			chunk = std::stoul(args[++i]);
+		else if (args[i] == "--duration" && hasValue)
+			plant.duration = std::stod(args[++i]);
+		else if (args[i] == "--dead-time" && hasValue)
+			plant.deadTime = std::stoul(args[++i]);
+		else if (args[i].compare(0, 2, "--") == 0)
+			printUsage();
+		else
+			positional.push_back(std::stod(args[i]));
+	}
+	if (positional.size() == 3)
+		std::copy(positional.begin(), positional.end(), gains.begin());
+	else if (!positional.empty() || nScenarios == 0 || chunk == 0)
+		printUsage();
+
+	TaskPool pool(nWorkers, excludedCpus);
+	cout << "Tuning with " << pool.size() << " workers, " << nScenarios << " scenarios of " << plant.duration << " s"
+			<< endl;
+	const auto start = std::chrono::steady_clock::now();
+
+	auto best = evaluate(pool, plant, { gains }, nScenarios, chunk)[0];
+	printf("P=%g I=%g D=%g error %.6f\n", gains[0], gains[1], gains[2], best);
+	Gains deltas;
+	for (unsigned i = 0; i < 3; ++i)
+		deltas[i] = gains[i] / 5;
+	unsigned nRounds = 0;
+	// Until every gain moves by less than 1%
+	while (nRounds < 200) {
+		bool converged = true;
+		for (unsigned i = 0; i < 3; ++i)
+			converged = converged && deltas[i] < gains[i] / 100;
+		if (converged)
+			break;
+		++nRounds;
+		std::vector<Gains> candidates;
+		for (unsigned i = 0; i < 3; ++i)
+			for (const double sign : { 1., -1. }) {
+				auto candidate = gains;
+				candidate[i] = std::max(0., candidate[i] + sign * deltas[i]);
+				candidates.push_back(candidate);
+			}
+		const auto errors = evaluate(pool, plant, candidates, nScenarios, chunk);
+		const auto bestCandidate = std::min_element(errors.begin(), errors.end()) - errors.begin();
+		for (unsigned i = 0; i < 3; ++i)
+			if (std::min(errors[2 * i], errors[2 * i + 1]) >= best)
+				deltas[i] *= .9;
+		if (errors[bestCandidate] < best) {
+			best = errors[bestCandidate];
+			gains = candidates[bestCandidate];
+			deltas[bestCandidate / 2] *= 1.1;
+			printf("%s %s: P=%g I=%g D=%g error %.6f\n", names[bestCandidate / 2], bestCandidate % 2 == 0 ? "up" : "down",
+					gains[0], gains[1], gains[2], best);
+		}
+	}
+	const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	printf("Tuned in %u rounds, %.2f s: P=%g I=%g D=%g error %.6f\n", nRounds, elapsed.count(), gains[0], gains[1],
+			gains[2], best);
+	printf("Run with: pid %.6g %.6g %.6g\n", gains[0], gains[1], gains[2]);
+	cout << pool.stats() << endl;
+	return 0;
+}
@@ -0,0 +1,62 @@
+#include "PlantModel.h"
+#include "TaskPool.h"
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+/**
+ * Measures how batch evaluations scale on TaskPool: the same set of rollouts, candidates
+ * with random gains driving a fixed set of scenarios, is run with 1 worker, 2, and so on up to
+ * one per CPU. Rollouts have uneven costs, as vehicles leaving the track cost less, which is
+ * what stealing evens out. Prints throughput, speed-up over one worker, and steals.
+ * Usage: poolbench [candidates [scenarios per candidate]]
+ */
+int main(int argc, char * argv[]) {
+	const std::size_t nCandidates = argc > 1 ? std::stoul(argv[1]) : 96;
+	const std::size_t nScenarios = argc > 2 ? std::stoul(argv[2]) : 16;
+	const std::size_t chunk = 4;
+	PlantModel plant;
+	plant.duration = 20;
+
+	std::mt19937 random(42);
+	std::uniform_real_distribution<double> uniform(.2, 2);
+	std::vector<std::array<double, 3>> candidates;
+	for (std::size_t c = 0; c < nCandidates; ++c)
+		candidates.push_back({ { .29 * uniform(random), .0029 * uniform(random), .13 * uniform(random) } });
+	std::vector<double> errors(nCandidates * nScenarios);
+
+	const auto nCpus = NumaTopology::read().cpus().size();
+	cout << nCandidates * nScenarios << " rollouts of " << plant.duration << " s, in tasks of " << chunk
+			<< " scenarios, " << nCpus << " CPUs" << endl;
+	double baseline = 0;
+	for (std::size_t nWorkers = 1; nWorkers <= nCpus; ++nWorkers) {
+		TaskPool pool(nWorkers, { });
+		const auto start = std::chrono::steady_clock::now();
+		for (std::size_t c = 0; c < nCandidates; ++c)
+			for (std::size_t first = 0; first < nScenarios; first += chunk) {
+				const auto n = std::min(chunk, nScenarios - first);
+				double * const results = &errors[c * nScenarios + first];
+				const auto & gains = candidates[c];
+				pool.submit([&plant, &gains, first, n, results] {
+					plant.rollout(gains, first, n, results);
+				});
+			}
+		pool.wait();
+		const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		const double throughput = nCandidates * nScenarios / elapsed.count();
+		if (nWorkers == 1)
+			baseline = throughput;
+		printf("%3zu workers: %9.1f rollouts/s, speed-up %5.2f, efficiency %3.0f%%\n", nWorkers, throughput,
+				throughput / baseline, 100 * throughput / baseline / nWorkers);
+		cout << "    " << pool.stats() << endl;
+	}
+	return 0;
+}
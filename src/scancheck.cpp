@@ -0,0 +1,79 @@
+#include "FrameScanner.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+/**
+ * Generates a random frame: mostly the characters the scanner looks at, with runs long
+ * enough to span blocks, such as a camera image, and often a Socket.IO event prefix.
+ */
+std::string randomFrame(std::mt19937 & random) {
+	static const char * const pieces[] = { "[", "]", "{", "}", "\"", "\\", "\\\\", "\\\"", "n", "null", " ", ",",
+			":", "a", "0" };
+	const std::size_t nPieces = sizeof(pieces) / sizeof(pieces[0]);
+	std::string frame = random() % 4 != 0 ? "42[" : "";
+	const auto nTokens = random() % 96;
+	for (unsigned i = 0; i < nTokens; ++i) {
+		if (random() % 16 == 0)
+			// A run without quotes nor backslashes, possibly many blocks long
+			frame.append(random() % 300, static_cast<char>("abnx[]{}"[random() % 8]));
+		else
+			frame += pieces[random() % nPieces];
+	}
+	if (random() % 2 == 0)
+		frame += ']';
+	return frame;
+}
+
+bool same(const FrameInfo & a, const FrameInfo & b) {
+	return a.isEvent == b.isEvent && a.hasArray == b.hasArray && a.hasNull == b.hasNull
+			&& a.begin == b.begin && a.end == b.end;
+}
+
+void print(const char * name, const FrameInfo & info) {
+	printf("  %-6s isEvent=%d hasArray=%d hasNull=%d begin=%zu end=%zu\n", name, info.isEvent, info.hasArray,
+			info.hasNull, info.begin, info.end);
+}
+
+}
+
+/**
+ * Compares the frame scanner kernels for every instruction set the processor supports with
+ * the scalar kernels, on random frames, at random alignments.
+ * Usage: scancheck [frames [seed]]
+ */
+int main(int argc, char * argv[]) {
+	const unsigned long nFrames = argc > 1 ? std::stoul(argv[1]) : 200000;
+	std::mt19937 random(argc > 2 ? std::stoul(argv[2]) : 1);
+	const std::pair<ScanKernel, const char *> kernels[] = { { ScanKernel::sse2, "sse2" }, { ScanKernel::avx2, "avx2" } };
+	for (const auto & kernel : kernels)
+		printf("%s: %s\n", kernel.second, scanKernelSupported(kernel.first) ? "checked" : "not supported");
+
+	std::vector<char> buffer;
+	for (unsigned long i = 0; i < nFrames; ++i) {
+		const auto frame = randomFrame(random);
+		const auto offset = random() % 64;
+		buffer.assign(offset + frame.size(), '\0');
+		std::copy(frame.begin(), frame.end(), buffer.begin() + offset);
+		const char * data = buffer.data() + offset;
+		const auto expected = scanFrame(data, frame.size(), ScanKernel::scalar);
+		for (const auto & kernel : kernels) {
+			if (!scanKernelSupported(kernel.first))
+				continue;
+			const auto actual = scanFrame(data, frame.size(), kernel.first);
+			if (!same(actual, expected)) {
+				printf("Mismatch on frame %lu: %s\n", i, frame.c_str());
+				print("scalar", expected);
+				print(kernel.second, actual);
+				return 1;
+			}
+		}
+	}
+	printf("%lu frames, no mismatch\n", nFrames);
+	return 0;
+}
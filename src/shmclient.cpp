@@ -0,0 +1,326 @@
+#include "BinaryProtocol.h"
+#include "SharedRing.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+long long now() {
+	return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+BinaryTelemetry makeTelemetry(const uint32_t sequence) {
+	// Weaving around the center-line, at about the target speed
+	return BinaryTelemetry { makeBinaryHeader(BinaryType::telemetry), sequence, 0, sin(sequence * .01), 40
+			+ cos(sequence * .003) };
+}
+
+/**
+ * Runs the round trips over the shared-memory transport.
+ * @param latencies filled with the round trip times in nanoseconds
+ * @return true if successful
+ */
+bool runShm(const string & name, const uint32_t count, vector<long long> & latencies) {
+	SharedChannel channel;
+	if (!channel.attach(name)) {
+		cerr << "Failed to attach to shared memory object " << name << endl;
+		return false;
+	}
+	auto & requests = channel.toServer();
+	auto & replies = channel.toClient();
+	// Replies left over by a previous client
+	BinarySteer reply;
+	while (replies.pop(reply))
+		;
+	for (uint32_t sequence = 0; sequence < count; ++sequence) {
+		const auto sent = now();
+		while (!requests.push(makeTelemetry(sequence)))
+			;
+		do {
+			while (!replies.pop(reply))
+				if (!replies.wait(1000000)) {
+					cerr << "No reply from the server" << endl;
+					return false;
+				}
+		} while (reply.sequence != sequence);
+		latencies.push_back(now() - sent);
+	}
+	return true;
+}
+
+/**
+ * State of one WebSocket connection of the benchmark.
+ */
+struct Client {
+	int fd;
+	uint32_t sequence;  // Sequence number of the telemetry waiting for a reply
+	uint32_t count;  // Number of round trips to run
+	long long sent;  // When the telemetry waiting for a reply was sent, in nanoseconds
+	string input;  // Bytes received and not handled yet
+};
+
+/**
+ * Writes all the given bytes to a blocking socket.
+ * @return true if successful
+ */
+bool writeAll(const int fd, const char * data, size_t length) {
+	while (length > 0) {
+		const auto n = write(fd, data, length);
+		if (n < 0 && errno != EINTR)
+			return false;
+		if (n > 0) {
+			data += n;
+			length -= n;
+		}
+	}
+	return true;
+}
+
+/**
+ * Sends a message in a single frame, masked as client frames must be.
+ * @param opCode 0x2 for binary, 0x8 for close
+ * @return true if successful
+ */
+bool sendFrame(const int fd, const uint8_t opCode, const void * payload, const size_t length) {
+	static const uint8_t mask[4] = { 0x5A, 0xC3, 0x96, 0x0F };
+	char frame[4 + 4 + 256];
+	if (length > 256)
+		return false;
+	size_t header = 0;
+	frame[header++] = static_cast<char>(0x80 | opCode);
+	if (length < 126)
+		frame[header++] = static_cast<char>(0x80 | length);
+	else {
+		frame[header++] = static_cast<char>(0x80 | 126);
+		frame[header++] = static_cast<char>(length >> 8);
+		frame[header++] = static_cast<char>(length);
+	}
+	memcpy(frame + header, mask, 4);
+	header += 4;
+	for (size_t i = 0; i < length; ++i)
+		frame[header + i] = static_cast<char>(static_cast<const uint8_t *>(payload)[i] ^ mask[i % 4]);
+	return writeAll(fd, frame, header + length);
+}
+
+/**
+ * Connects to the server on localhost and upgrades the connection to WebSocket.
+ * @return the socket, blocking, -1 if failed
+ */
+int connectWebSocket(const int port) {
+	const int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = htons(port);
+	const int enable = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+	const string request = "GET / HTTP/1.1\r\nHost: localhost:" + to_string(port)
+			+ "\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+					"Sec-WebSocket-Version: 13\r\n\r\n";
+	if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0
+			|| !writeAll(fd, request.data(), request.size())) {
+		close(fd);
+		return -1;
+	}
+	// The reply ends with an empty line; the server sends nothing more before the client does
+	string reply;
+	char buffer[1024];
+	while (reply.find("\r\n\r\n") == string::npos) {
+		const auto n = read(fd, buffer, sizeof(buffer));
+		if (n <= 0) {
+			close(fd);
+			return -1;
+		}
+		reply.append(buffer, n);
+	}
+	if (reply.compare(0, 12, "HTTP/1.1 101") != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/**
+ * Takes the next complete frame out of the bytes received from the server, which doesn't mask
+ * its frames nor fragment its messages.
+ * @return false if there is no complete frame yet
+ */
+bool nextFrame(string & input, uint8_t & opCode, string & payload) {
+	if (input.size() < 2)
+		return false;
+	opCode = input[0] & 0x0F;
+	size_t length = input[1] & 0x7F;
+	size_t header = 2;
+	if (length == 126) {
+		if (input.size() < 4)
+			return false;
+		length = static_cast<uint8_t>(input[2]) << 8 | static_cast<uint8_t>(input[3]);
+		header = 4;
+	} else if (length == 127) {
+		if (input.size() < 10)
+			return false;
+		length = 0;
+		for (int i = 2; i < 10; ++i)
+			length = length << 8 | static_cast<uint8_t>(input[i]);
+		header = 10;
+	}
+	if (input.size() < header + length)
+		return false;
+	payload.assign(input, header, length);
+	input.erase(0, header + length);
+	return true;
+}
+
+/**
+ * Sends the next telemetry message of a connection.
+ */
+bool sendTelemetry(Client & client) {
+	const auto message = makeTelemetry(client.sequence);
+	client.sent = now();
+	return sendFrame(client.fd, 0x2, &message, sizeof(message));
+}
+
+/**
+ * Runs the round trips over WebSocket connections to localhost, all at the same time; the
+ * round trips are split evenly among the connections. Sockets are written and read directly,
+ * and polled, so that the client adds as little as possible to the latency it measures.
+ * @param latencies filled with the round trip times in nanoseconds
+ * @return true if successful
+ */
+bool runWebSocket(const int port, const uint32_t count, const uint32_t nConnections, vector<long long> & latencies) {
+	vector<Client> clients(nConnections);
+	vector<pollfd> polls(nConnections);
+	for (uint32_t i = 0; i < nConnections; ++i) {
+		clients[i].fd = connectWebSocket(port);
+		if (clients[i].fd < 0) {
+			cerr << "Connection to port " << port << " failed" << endl;
+			for (uint32_t j = 0; j < i; ++j)
+				close(clients[j].fd);
+			return false;
+		}
+		clients[i].sequence = 0;
+		clients[i].count = count / nConnections + (i < count % nConnections);
+		polls[i] = pollfd { clients[i].fd, POLLIN, 0 };
+		const BinaryHello hello { makeBinaryHeader(BinaryType::hello) };
+		sendFrame(clients[i].fd, 0x2, &hello, sizeof(hello));
+	}
+
+	uint32_t nOpen { nConnections };
+	bool success { true };
+	string payload;
+	while (nOpen > 0 && success) {
+		if (poll(polls.data(), polls.size(), 1000) <= 0) {
+			cerr << "No reply from the server" << endl;
+			success = false;
+			break;
+		}
+		for (uint32_t i = 0; i < nConnections; ++i) {
+			if (polls[i].fd < 0 || polls[i].revents == 0)
+				continue;
+			auto & client = clients[i];
+			char buffer[4096];
+			const auto n = read(client.fd, buffer, sizeof(buffer));
+			if (n <= 0) {
+				cerr << "Connection closed by the server" << endl;
+				success = false;
+				break;
+			}
+			client.input.append(buffer, n);
+			uint8_t opCode;
+			BinaryHello hello;
+			BinarySteer reply;
+			while (polls[i].fd >= 0 && nextFrame(client.input, opCode, payload)) {
+				if (opCode != 0x2)
+					continue;
+				if (readBinary(payload.data(), payload.size(), BinaryType::hello, hello))
+					sendTelemetry(client);
+				else if (readBinary(payload.data(), payload.size(), BinaryType::steer, reply)
+						&& reply.sequence == client.sequence) {
+					latencies.push_back(now() - client.sent);
+					if (++client.sequence < client.count)
+						sendTelemetry(client);
+					else {
+						sendFrame(client.fd, 0x8, nullptr, 0);
+						polls[i].fd = -1;
+						--nOpen;
+					}
+				}
+			}
+		}
+	}
+	for (auto & client : clients)
+		close(client.fd);
+	return success && latencies.size() == count;
+}
+
+void printStatistics(vector<long long> & latencies) {
+	sort(latencies.begin(), latencies.end());
+	const auto percentile = [&latencies](const double p) {
+		return latencies[static_cast<size_t>(p * (latencies.size() - 1))] / 1000.;
+	};
+	printf("%zu round trips, microseconds: min %.2f, median %.2f, 99%% %.2f, 99.9%% %.2f, max %.2f\n",
+			latencies.size(), percentile(0), percentile(.5), percentile(.99), percentile(.999), percentile(1));
+}
+
+void printParamsError() {
+	cout << "Usage:" << endl << "   shmclient [--count n] (--shm name | --websocket port [--connections n])" << endl;
+	exit(-1);
+}
+
+}
+
+/**
+ * Stand-in for a simulator co-located with `pid`: sends synthetic telemetry over the
+ * shared-memory transport, or over WebSocket connections with the binary protocol, waits for
+ * every reply before sending the next message on the same connection, and prints out round
+ * trip latency statistics. With many connections, it serves as a load generator to compare
+ * network backends.
+ */
+int main(int argc, char ** argv) {
+	vector<string> args(argv + 1, argv + argc);
+	uint32_t count { 100000 };
+	string shmName;
+	int port { 0 };
+	uint32_t nConnections { 1 };
+	for (size_t i = 0; i + 1 < args.size(); i += 2) {
+		if (args[i] == "--count")
+			count = stoul(args[i + 1]);
+		else if (args[i] == "--shm")
+			shmName = args[i + 1];
+		else if (args[i] == "--websocket")
+			port = stoi(args[i + 1]);
+		else if (args[i] == "--connections")
+			nConnections = stoul(args[i + 1]);
+		else
+			printParamsError();
+	}
+	if (args.size() % 2 != 0 || count == 0 || shmName.empty() == (port == 0) || nConnections == 0
+			|| nConnections > count)
+		printParamsError();
+
+	vector<long long> latencies;
+	latencies.reserve(count);
+	const bool success = shmName.empty() ? runWebSocket(port, count, nConnections, latencies) : runShm(shmName, count, latencies);
+	if (!success)
+		return -1;
+	printStatistics(latencies);
+	return 0;
+}